@@ -4,6 +4,8 @@
 #include <vector>
 
 #include "indices.h"
+#include "input_basis.h"
+#include "cost_residuals.h"
 #include "config.h"
 #include <cppad/cppad.hpp>
 #include <cppad/ipopt/solve.hpp>
@@ -20,9 +22,39 @@ class FG_eval
         // Fitted polynomial coefficients
         Eigen::VectorXd coeffs;
         Indices &idx;
-        FG_eval(Eigen::VectorXd coeffs, Indices &idx) : coeffs(coeffs), idx(idx) {}
+        // Maps the optimized parameters to the actuations of every step
+        const InputBasis &inputs;
+        FG_eval(Eigen::VectorXd coeffs, Indices &idx, const InputBasis &inputs)
+            : coeffs(coeffs), idx(idx), inputs(inputs) {}
 
         typedef CPPAD_TESTVECTOR(AD<double>) ADvector;
+
+        // Number of the residuals of the cost
+        size_t ResidualsNum()
+        {
+            return CostResidualsNum(idx.N);
+        }
+
+        // Weighted residuals of the cost (see cost_residuals.h)
+        void Residuals(ADvector &r, const ADvector &vars)
+        {
+            Config config = Config::GetConfig();
+
+            // Actuations of every step
+            ADvector delta(idx.N - 1);
+            ADvector a(idx.N - 1);
+            inputs.ExpandAll<AD<double>>(vars, idx.delta_start, delta);
+            inputs.ExpandAll<AD<double>>(vars, idx.a_start, a);
+
+            // The part of the cost based on the reference state.
+            for (size_t t = 0; t < idx.N; t++)
+            {
+                SetStateResiduals(r, t, vars[idx.cte_start + t], vars[idx.epsi_start + t], vars[idx.v_start + t], config);
+            }
+
+            SetActuatorResiduals(r, idx.N, delta, a, config);
+        }
+
         void operator()(ADvector& fg, const ADvector& vars)
         {
             // TODO: implement MPC
@@ -35,26 +67,22 @@ class FG_eval
             fg[0] = 0;
 
             Config config = Config::GetConfig();
-            // The part of the cost based on the reference state.
-            for (size_t t = 0; t < idx.N; t++)
-            {
-                fg[0] += config.cte_w * CppAD::pow(vars[idx.cte_start + t], 2);
-                fg[0] += config.epsi_w * CppAD::pow(vars[idx.epsi_start + t], 2);
-                fg[0] += config.velocity_diff_w * CppAD::pow(vars[idx.v_start + t] - config.target_v, 2);
-            }
 
-            // Minimize the use of actuators.
-            for (size_t t = 0; t < idx.N - 1; t++)
-            {
-                fg[0] += config.delta_w * CppAD::pow(vars[idx.delta_start + t], 2);
-                fg[0] += config.a_w * CppAD::pow(vars[idx.a_start + t], 2);
-            }
+            // Actuations of every step
+            ADvector delta(idx.N - 1);
+            ADvector a(idx.N - 1);
+            inputs.ExpandAll<AD<double>>(vars, idx.delta_start, delta);
+            inputs.ExpandAll<AD<double>>(vars, idx.a_start, a);
+
+            // Time step of every stage
+            vector<double> stage_dt = config.GetStageDt(idx.N - 1);
 
-            // Minimize the value gap between sequential actuations.
-            for (size_t t = 0; t < idx.N - 2; t++)
+            // The cost is the sum of squared residuals.
+            ADvector r(ResidualsNum());
+            Residuals(r, vars);
+            for (size_t i = 0; i < r.size(); i++)
             {
-                fg[0] += config.delta_diff_w * CppAD::pow(vars[idx.delta_start + t + 1] - vars[idx.delta_start + t], 2);
-                fg[0] += config.a_diff_w * CppAD::pow(vars[idx.a_start + t + 1] - vars[idx.a_start + t], 2);
+                fg[0] += r[i] * r[i];
             }
 
             //
@@ -95,8 +123,9 @@ class FG_eval
                 AD<double> epsi0 = vars[idx.epsi_start + t - 1];
 
                 // Only consider the actuation at time t.
-                AD<double> delta0 = vars[idx.delta_start + t - 1];
-                AD<double> a0 = vars[idx.a_start + t - 1];
+                AD<double> delta0 = delta[t - 1];
+                AD<double> a0 = a[t - 1];
+                double dt = stage_dt[t - 1];
 
                 AD<double> f0 = coeffs[0] + (coeffs[1] * x0) + (coeffs[2] * x0 * x0) + (coeffs[3] * x0 * x0 * x0);
                 AD<double> psides0 = CppAD::atan(coeffs[1] + (2 * coeffs[2] * x0) + (3 * coeffs[3] * x0 * x0));
@@ -111,12 +140,12 @@ class FG_eval
                 // v_[t+1] = v[t] + a[t] * dt
                 // cte[t+1] = f(x[t]) - y[t] + v[t] * sin(epsi[t]) * dt
                 // epsi[t+1] = psi[t] - psides[t] + v[t] * delta[t] / Lf * dt
-                fg[1 + idx.x_start + t] = x1 - (x0 + v0 * CppAD::cos(psi0) * config.dt);
-                fg[1 + idx.y_start + t] = y1 - (y0 + v0 * CppAD::sin(psi0) * config.dt);
-                fg[1 + idx.psi_start + t] = psi1 - (psi0 + v0 * delta0 / Lf * config.dt);
-                fg[1 + idx.v_start + t] = v1 - (v0 + a0 * config.dt);
-                fg[1 + idx.cte_start + t] = cte1 - ((f0 - y0) + (v0 * CppAD::sin(epsi0) * config.dt));
-                fg[1 + idx.epsi_start + t] = epsi1 - ((psi0 - psides0) + v0 * delta0 / Lf * config.dt);
+                fg[1 + idx.x_start + t] = x1 - (x0 + v0 * CppAD::cos(psi0) * dt);
+                fg[1 + idx.y_start + t] = y1 - (y0 + v0 * CppAD::sin(psi0) * dt);
+                fg[1 + idx.psi_start + t] = psi1 - (psi0 + v0 * delta0 / Lf * dt);
+                fg[1 + idx.v_start + t] = v1 - (v0 + a0 * dt);
+                fg[1 + idx.cte_start + t] = cte1 - ((f0 - y0) + (v0 * CppAD::sin(epsi0) * dt));
+                fg[1 + idx.epsi_start + t] = epsi1 - ((psi0 - psides0) + v0 * delta0 / Lf * dt);
             }
         }
 };
@@ -0,0 +1,124 @@
+#ifndef MPC_FG_EVAL_FRENET_H
+#define MPC_FG_EVAL_FRENET_H
+
+#include <vector>
+
+#include "indices.h"
+#include "input_basis.h"
+#include "cost_residuals.h"
+#include "config.h"
+#include <cppad/cppad.hpp>
+#include <cppad/ipopt/solve.hpp>
+
+using CppAD::AD;
+
+// Cost and constraints of the problem formulated in path coordinates:
+// s - progress along the track, n - lateral offset from the track (positive to the left),
+// mu - heading error relative to the track direction, v - velocity.
+// Curvature of the track is not recomputed, it is taken from the precomputed curvature profile
+// sampled at every step of the horizon.
+class FG_eval_frenet
+{
+    public:
+        // Track curvature at every step of the horizon
+        vector<double> curvature;
+        FrenetIndices &idx;
+        const InputBasis &inputs;
+        FG_eval_frenet(vector<double> curvature, FrenetIndices &idx, const InputBasis &inputs)
+            : curvature(curvature), idx(idx), inputs(inputs) {}
+
+        typedef CPPAD_TESTVECTOR(AD<double>) ADvector;
+
+        // Number of the residuals of the cost
+        size_t ResidualsNum()
+        {
+            return CostResidualsNum(idx.N);
+        }
+
+        // Weighted residuals of the cost (see cost_residuals.h)
+        void Residuals(ADvector &r, const ADvector &vars)
+        {
+            Config config = Config::GetConfig();
+
+            // Actuations of every step
+            ADvector delta(idx.N - 1);
+            ADvector a(idx.N - 1);
+            inputs.ExpandAll<AD<double>>(vars, idx.delta_start, delta);
+            inputs.ExpandAll<AD<double>>(vars, idx.a_start, a);
+
+            // Lateral offset and heading error are the tracking errors themselves,
+            // so the same weights as for cte and epsi are used.
+            for (size_t t = 0; t < idx.N; t++)
+            {
+                SetStateResiduals(r, t, vars[idx.n_start + t], vars[idx.mu_start + t], vars[idx.v_start + t], config);
+            }
+
+            SetActuatorResiduals(r, idx.N, delta, a, config);
+        }
+
+        void operator()(ADvector& fg, const ADvector& vars)
+        {
+            fg[0] = 0;
+
+            Config config = Config::GetConfig();
+
+            // Actuations of every step
+            ADvector delta(idx.N - 1);
+            ADvector a(idx.N - 1);
+            inputs.ExpandAll<AD<double>>(vars, idx.delta_start, delta);
+            inputs.ExpandAll<AD<double>>(vars, idx.a_start, a);
+
+            // Time step of every stage
+            vector<double> stage_dt = config.GetStageDt(idx.N - 1);
+
+            // The cost is the sum of squared residuals.
+            ADvector r(ResidualsNum());
+            Residuals(r, vars);
+            for (size_t i = 0; i < r.size(); i++)
+            {
+                fg[0] += r[i] * r[i];
+            }
+
+            // Initial constraints
+            fg[1 + idx.s_start] = vars[idx.s_start];
+            fg[1 + idx.n_start] = vars[idx.n_start];
+            fg[1 + idx.mu_start] = vars[idx.mu_start];
+            fg[1 + idx.v_start] = vars[idx.v_start];
+
+            for (size_t t = 1; t < idx.N; t++)
+            {
+                // The state at time t+1 .
+                AD<double> s1 = vars[idx.s_start + t];
+                AD<double> n1 = vars[idx.n_start + t];
+                AD<double> mu1 = vars[idx.mu_start + t];
+                AD<double> v1 = vars[idx.v_start + t];
+
+                // The state at time t.
+                AD<double> s0 = vars[idx.s_start + t - 1];
+                AD<double> n0 = vars[idx.n_start + t - 1];
+                AD<double> mu0 = vars[idx.mu_start + t - 1];
+                AD<double> v0 = vars[idx.v_start + t - 1];
+
+                // Only consider the actuation at time t.
+                AD<double> delta0 = delta[t - 1];
+                AD<double> a0 = a[t - 1];
+                double dt = stage_dt[t - 1];
+
+                double k0 = curvature[t - 1];
+
+                // Model in path coordinates:
+                // s_[t+1] = s[t] + v[t] * cos(mu[t]) / (1 - n[t] * k[t]) * dt
+                // n_[t+1] = n[t] + v[t] * sin(mu[t]) * dt
+                // mu_[t+1] = mu[t] + (v[t] / Lf * delta[t] - k[t] * ds[t]) * dt
+                // v_[t+1] = v[t] + a[t] * dt
+                AD<double> ds0 = v0 * CppAD::cos(mu0) / (1 - n0 * k0);
+                fg[1 + idx.s_start + t] = s1 - (s0 + ds0 * dt);
+                fg[1 + idx.n_start + t] = n1 - (n0 + v0 * CppAD::sin(mu0) * dt);
+                fg[1 + idx.mu_start + t] = mu1 - (mu0 + (v0 * delta0 / Lf - k0 * ds0) * dt);
+                fg[1 + idx.v_start + t] = v1 - (v0 + a0 * dt);
+            }
+        }
+};
+
+
+#endif //MPC_FG_EVAL_FRENET_H
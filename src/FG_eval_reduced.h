@@ -0,0 +1,121 @@
+#ifndef MPC_FG_EVAL_REDUCED_H
+#define MPC_FG_EVAL_REDUCED_H
+
+#include <vector>
+
+#include "indices.h"
+#include "input_basis.h"
+#include "cost_residuals.h"
+#include "config.h"
+#include <cppad/cppad.hpp>
+#include <cppad/ipopt/solve.hpp>
+#include "Eigen-3.3/Eigen/Core"
+
+using CppAD::AD;
+
+// FG_eval without cte and epsi states. They are functions of x, y, psi and the polynomial,
+// so the tracking errors are calculated in the cost:
+// cte = f(x) - y, epsi = psi - atan(f'(x)).
+// This removes 2N variables and 2N equality constraints.
+class FG_eval_reduced
+{
+    public:
+        // Fitted polynomial coefficients
+        Eigen::VectorXd coeffs;
+        ReducedIndices &idx;
+        const InputBasis &inputs;
+        FG_eval_reduced(Eigen::VectorXd coeffs, ReducedIndices &idx, const InputBasis &inputs)
+            : coeffs(coeffs), idx(idx), inputs(inputs) {}
+
+        typedef CPPAD_TESTVECTOR(AD<double>) ADvector;
+
+        // Number of the residuals of the cost
+        size_t ResidualsNum()
+        {
+            return CostResidualsNum(idx.N);
+        }
+
+        // Weighted residuals of the cost (see cost_residuals.h)
+        void Residuals(ADvector &r, const ADvector &vars)
+        {
+            Config config = Config::GetConfig();
+
+            // Actuations of every step
+            ADvector delta(idx.N - 1);
+            ADvector a(idx.N - 1);
+            inputs.ExpandAll<AD<double>>(vars, idx.delta_start, delta);
+            inputs.ExpandAll<AD<double>>(vars, idx.a_start, a);
+
+            // The part of the cost based on the reference state.
+            for (size_t t = 0; t < idx.N; t++)
+            {
+                AD<double> x = vars[idx.x_start + t];
+                AD<double> f = coeffs[0] + (coeffs[1] * x) + (coeffs[2] * x * x) + (coeffs[3] * x * x * x);
+                AD<double> psides = CppAD::atan(coeffs[1] + (2 * coeffs[2] * x) + (3 * coeffs[3] * x * x));
+                AD<double> cte = f - vars[idx.y_start + t];
+                AD<double> epsi = vars[idx.psi_start + t] - psides;
+
+                SetStateResiduals(r, t, cte, epsi, vars[idx.v_start + t], config);
+            }
+
+            SetActuatorResiduals(r, idx.N, delta, a, config);
+        }
+
+        void operator()(ADvector& fg, const ADvector& vars)
+        {
+            fg[0] = 0;
+
+            Config config = Config::GetConfig();
+
+            // Actuations of every step
+            ADvector delta(idx.N - 1);
+            ADvector a(idx.N - 1);
+            inputs.ExpandAll<AD<double>>(vars, idx.delta_start, delta);
+            inputs.ExpandAll<AD<double>>(vars, idx.a_start, a);
+
+            // Time step of every stage
+            vector<double> stage_dt = config.GetStageDt(idx.N - 1);
+
+            // The cost is the sum of squared residuals.
+            ADvector r(ResidualsNum());
+            Residuals(r, vars);
+            for (size_t i = 0; i < r.size(); i++)
+            {
+                fg[0] += r[i] * r[i];
+            }
+
+            // Initial constraints
+            fg[1 + idx.x_start] = vars[idx.x_start];
+            fg[1 + idx.y_start] = vars[idx.y_start];
+            fg[1 + idx.psi_start] = vars[idx.psi_start];
+            fg[1 + idx.v_start] = vars[idx.v_start];
+
+            // The rest of the constraints, the same equations as in FG_eval
+            for (size_t t = 1; t < idx.N; t++)
+            {
+                // The state at time t+1 .
+                AD<double> x1 = vars[idx.x_start + t];
+                AD<double> y1 = vars[idx.y_start + t];
+                AD<double> psi1 = vars[idx.psi_start + t];
+                AD<double> v1 = vars[idx.v_start + t];
+
+                // The state at time t.
+                AD<double> x0 = vars[idx.x_start + t - 1];
+                AD<double> y0 = vars[idx.y_start + t - 1];
+                AD<double> psi0 = vars[idx.psi_start + t - 1];
+                AD<double> v0 = vars[idx.v_start + t - 1];
+
+                // Only consider the actuation at time t.
+                AD<double> delta0 = delta[t - 1];
+                AD<double> a0 = a[t - 1];
+                double dt = stage_dt[t - 1];
+
+                fg[1 + idx.x_start + t] = x1 - (x0 + v0 * CppAD::cos(psi0) * dt);
+                fg[1 + idx.y_start + t] = y1 - (y0 + v0 * CppAD::sin(psi0) * dt);
+                fg[1 + idx.psi_start + t] = psi1 - (psi0 + v0 * delta0 / Lf * dt);
+                fg[1 + idx.v_start + t] = v1 - (v0 + a0 * dt);
+            }
+        }
+};
+
+#endif //MPC_FG_EVAL_REDUCED_H
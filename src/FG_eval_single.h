@@ -0,0 +1,119 @@
+#ifndef MPC_FG_EVAL_SINGLE_H
+#define MPC_FG_EVAL_SINGLE_H
+
+#include <vector>
+
+#include "indices.h"
+#include "input_basis.h"
+#include "cost_residuals.h"
+#include "config.h"
+#include <cppad/cppad.hpp>
+#include <cppad/ipopt/solve.hpp>
+#include "Eigen-3.3/Eigen/Core"
+
+using CppAD::AD;
+
+// State of the kinematic model, T is double or AD<double>
+template <class T>
+struct ModelState
+{
+    T x;
+    T y;
+    T psi;
+    T v;
+    T cte;
+    T epsi;
+};
+
+// Applies the model equations of FG_eval to the state for one time step
+template <class T>
+ModelState<T> ModelStep(const ModelState<T> &s0, const T &delta0, const T &a0,
+                        const Eigen::VectorXd &coeffs, double dt)
+{
+    T f0 = coeffs[0] + (coeffs[1] * s0.x) + (coeffs[2] * s0.x * s0.x) + (coeffs[3] * s0.x * s0.x * s0.x);
+    T psides0 = CppAD::atan(coeffs[1] + (2 * coeffs[2] * s0.x) + (3 * coeffs[3] * s0.x * s0.x));
+
+    ModelState<T> s1;
+    s1.x = s0.x + s0.v * CppAD::cos(s0.psi) * dt;
+    s1.y = s0.y + s0.v * CppAD::sin(s0.psi) * dt;
+    s1.psi = s0.psi + s0.v * delta0 / Lf * dt;
+    s1.v = s0.v + a0 * dt;
+    s1.cte = (f0 - s0.y) + (s0.v * CppAD::sin(s0.epsi) * dt);
+    s1.epsi = (s0.psi - psides0) + s0.v * delta0 / Lf * dt;
+    return s1;
+}
+
+// Single shooting version of FG_eval: only actuations are optimized,
+// states are rolled out from the initial state inside the cost, so there are no equality constraints.
+// The cost is the same as in FG_eval.
+class FG_eval_single
+{
+    public:
+        // Fitted polynomial coefficients
+        Eigen::VectorXd coeffs;
+        // The initial state [x, y, psi, v, cte, epsi]
+        Eigen::VectorXd state;
+        ShootingIndices &idx;
+        const InputBasis &inputs;
+        FG_eval_single(Eigen::VectorXd coeffs, Eigen::VectorXd state, ShootingIndices &idx,
+                       const InputBasis &inputs)
+            : coeffs(coeffs), state(state), idx(idx), inputs(inputs) {}
+
+        typedef CPPAD_TESTVECTOR(AD<double>) ADvector;
+
+        // Number of the residuals of the cost
+        size_t ResidualsNum()
+        {
+            return CostResidualsNum(idx.N);
+        }
+
+        // Weighted residuals of the cost (see cost_residuals.h),
+        // the states are rolled out from the initial one with the actuations
+        void Residuals(ADvector &r, const ADvector &vars)
+        {
+            Config config = Config::GetConfig();
+
+            // Actuations of every step
+            ADvector delta(idx.N - 1);
+            ADvector a(idx.N - 1);
+            inputs.ExpandAll<AD<double>>(vars, idx.delta_start, delta);
+            inputs.ExpandAll<AD<double>>(vars, idx.a_start, a);
+
+            // Time step of every stage
+            vector<double> stage_dt = config.GetStageDt(idx.N - 1);
+
+            ModelState<AD<double>> s;
+            s.x = state[0];
+            s.y = state[1];
+            s.psi = state[2];
+            s.v = state[3];
+            s.cte = state[4];
+            s.epsi = state[5];
+
+            // The part of the cost based on the reference state.
+            for (size_t t = 0; t < idx.N; t++)
+            {
+                if(t > 0)
+                {
+                    s = ModelStep(s, delta[t - 1], a[t - 1], coeffs, stage_dt[t - 1]);
+                }
+                SetStateResiduals(r, t, s.cte, s.epsi, s.v, config);
+            }
+
+            SetActuatorResiduals(r, idx.N, delta, a, config);
+        }
+
+        void operator()(ADvector& fg, const ADvector& vars)
+        {
+            // The cost is the sum of squared residuals, there are no constraints.
+            fg[0] = 0;
+            ADvector r(ResidualsNum());
+            Residuals(r, vars);
+            for (size_t i = 0; i < r.size(); i++)
+            {
+                fg[0] += r[i] * r[i];
+            }
+        }
+};
+
+#endif //MPC_FG_EVAL_SINGLE_H
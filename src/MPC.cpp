@@ -1,11 +1,273 @@
 #include "MPC.h"
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <cppad/cppad.hpp>
 #include <cppad/ipopt/solve.hpp>
+#include <coin/IpoptConfig.h>
 
 #include "utils.h"
 #include "config.h"
 #include "indices.h"
 #include "FG_eval.h"
+#include "FG_eval_frenet.h"
+#include "FG_eval_single.h"
+#include "FG_eval_reduced.h"
+#include "input_basis.h"
+#include "ltv_mpc.h"
+#include "parallel_ltv.h"
+#include "deadline_callback.h"
+#include "metrics.h"
+#include "solution_cache.h"
+
+typedef CPPAD_TESTVECTOR(double) Dvector;
+
+// IPOPT serializes the calls of MUMPS since 3.14, the older versions can't run it on several threads at once
+#if defined(IPOPT_VERSION_MAJOR) && (IPOPT_VERSION_MAJOR > 3 || (IPOPT_VERSION_MAJOR == 3 && IPOPT_VERSION_MINOR >= 14))
+const bool K_MUMPS_THREAD_SAFE = true;
+#else
+const bool K_MUMPS_THREAD_SAFE = false;
+#endif
+
+// Held by the running IPOPT solve while the solves can't run concurrently (see MPC::ConcurrentSolves)
+static timed_mutex ipopt_mutex;
+
+static const char *LinearSolverName(LinearSolver solver)
+{
+    switch(solver)
+    {
+        case LinearSolver::Ma27:
+            return "ma27";
+        case LinearSolver::Ma57:
+            return "ma57";
+        default:
+            return "mumps";
+    }
+}
+
+// Problem solved to check the linear solver: minimize (x0 - 1)**2 + (x1 - 2)**2 subject to x0 + x1 = 1
+class LinearSolverCheck
+{
+    public:
+        typedef CPPAD_TESTVECTOR(CppAD::AD<double>) ADvector;
+
+        void operator()(ADvector &fg, const ADvector &x)
+        {
+            fg[0] = (x[0] - 1) * (x[0] - 1) + (x[1] - 2) * (x[1] - 2);
+            fg[1] = x[0] + x[1];
+        }
+};
+
+// Sets limits of the variables. Only actuators are limited,
+// all the other variables are set to the max negative and positive values.
+static void SetVarsBounds(Dvector &vars_lowerbound, Dvector &vars_upperbound,
+                          size_t delta_start, size_t a_start, size_t n_vars)
+{
+    for (size_t i = 0; i < delta_start; i++)
+    {
+        vars_lowerbound[i] = -1.0e19;
+        vars_upperbound[i] = 1.0e19;
+    }
+
+    // The upper and lower limits of delta are set to -25 and 25
+    // degrees (values in radians).
+    // NOTE: Feel free to change this to something else.
+    for (size_t i = delta_start; i < a_start; i++)
+    {
+        vars_lowerbound[i] = -K_MAX_DELTA;
+        vars_upperbound[i] = K_MAX_DELTA;
+    }
+
+    // Acceleration/decceleration upper and lower limits.
+    // NOTE: Feel free to change this to something else.
+
+    // This is not an actuator value this is a real acceleration.
+    for (size_t i = a_start; i < n_vars; i++)
+    {
+        vars_lowerbound[i] = -K_MAX_ACCELERATION;
+        vars_upperbound[i] = K_MAX_ACCELERATION;
+    }
+}
+
+// Result of the optimizer run
+struct SolverResult
+{
+    CppAD::ipopt::solve_result<Dvector> solution;
+
+    // true if the optimizer was stopped at the deadline
+    bool stopped_by_deadline = false;
+
+    // the best feasible iterate found before the optimizer stopped
+    Dvector best_x;
+    double best_obj = numeric_limits<double>::max();
+    bool has_best_x = false;
+
+    // maximum violation of the bounds and the constraints by the final point, infinity if there is none
+    double final_violation = numeric_limits<double>::infinity();
+
+    int iterations = 0;
+};
+
+// Runs optimizer for the given problem until it converges, the deadline is reached or it is cancelled
+template <class FG>
+static SolverResult RunSolver(FG &fg_eval, const Dvector &vars,
+                              const Dvector &vars_lowerbound, const Dvector &vars_upperbound,
+                              const Dvector &constraints_lowerbound, const Dvector &constraints_upperbound,
+                              chrono::steady_clock::time_point deadline, const atomic<bool> *cancel)
+{
+    typedef typename FG::ADvector ADvector;
+
+    SolverResult result;
+    result.solution.status = CppAD::ipopt::solve_result<Dvector>::not_defined;
+    Metrics::Instance.solves++;
+
+    // wait for the running solve if they can't run concurrently, the solve which can't start in time is not run
+    Config config = Config::GetConfig();
+    unique_lock<timed_mutex> ipopt_lock(ipopt_mutex, defer_lock);
+    if(!MPC::ConcurrentSolves(config))
+    {
+        while(!ipopt_lock.try_lock_for(chrono::milliseconds(1)))
+        {
+            if(chrono::steady_clock::now() >= deadline || (cancel != nullptr && *cancel))
+            {
+                result.stopped_by_deadline = true;
+                Metrics::Instance.deadline_stops++;
+                return result;
+            }
+        }
+    }
+
+    // NOTE: Setting sparse to true allows the solver to take advantage
+    // of sparse routines, this makes the computation MUCH FASTER.
+    // The same as "Sparse true forward" and "Sparse true reverse" options of CppAD::ipopt::solve,
+    // which is replaced here to be able to stop the optimizer at the wall clock deadline.
+    bool retape = false;
+    bool sparse_forward = true;
+    bool sparse_reverse = true;
+    DeadlineCallback<Dvector, ADvector, FG> *callback =
+        new DeadlineCallback<Dvector, ADvector, FG>(1, vars.size(), constraints_lowerbound.size(),
+                                                    vars, vars_lowerbound, vars_upperbound,
+                                                    constraints_lowerbound, constraints_upperbound,
+                                                    fg_eval, retape, sparse_forward, sparse_reverse,
+                                                    result.solution, deadline);
+    callback->cancel = cancel;
+    Ipopt::SmartPtr<Ipopt::TNLP> nlp = callback;
+
+    // the approximation must outlive the optimizer run
+    std::unique_ptr<GaussNewtonHessian<FG>> gauss_newton;
+    if(config.hessian == HessianType::GaussNewton)
+    {
+        gauss_newton.reset(new GaussNewtonHessian<FG>(fg_eval, vars.size()));
+        callback->gauss_newton = gauss_newton.get();
+    }
+
+    // options for IPOPT solver
+    Ipopt::SmartPtr<Ipopt::IpoptApplication> app = new Ipopt::IpoptApplication();
+    // Set this to 5 if you'd like more print information
+    app->Options()->SetIntegerValue("print_level", 0);
+    app->Options()->SetStringValue("sb", "yes");
+    app->Options()->SetStringValue("linear_solver", LinearSolverName(config.linear_solver));
+    // CPU time limit is kept as an additional limit, the wall clock deadline is checked on every iteration.
+    app->Options()->SetNumericValue("max_cpu_time", config.max_cpu_time);
+
+    if(app->Initialize() != Ipopt::Solve_Succeeded)
+    {
+        return result;
+    }
+
+    // solve the problem
+    app->OptimizeTNLP(nlp);
+
+    result.stopped_by_deadline = callback->stopped_by_deadline;
+    result.has_best_x = callback->has_best_x;
+    result.best_x = callback->best_x;
+    result.best_obj = callback->best_obj;
+    result.iterations = callback->iterations;
+
+    const Dvector &x = result.solution.x;
+    const Dvector &g = result.solution.g;
+    if(x.size() == vars.size() && g.size() == constraints_lowerbound.size())
+    {
+        result.final_violation = 0;
+        for(size_t i = 0; i < x.size(); i++)
+        {
+            result.final_violation = max(result.final_violation,
+                                         max(vars_lowerbound[i] - x[i], x[i] - vars_upperbound[i]));
+        }
+        for(size_t i = 0; i < g.size(); i++)
+        {
+            result.final_violation = max(result.final_violation,
+                                         max(constraints_lowerbound[i] - g[i], g[i] - constraints_upperbound[i]));
+        }
+    }
+
+    if(result.solution.status == CppAD::ipopt::solve_result<Dvector>::success)
+    {
+        Metrics::Instance.solve_success++;
+    }
+    else if(result.solution.status == CppAD::ipopt::solve_result<Dvector>::stop_at_acceptable_point)
+    {
+        Metrics::Instance.solve_acceptable++;
+    }
+    if(result.stopped_by_deadline)
+    {
+        Metrics::Instance.deadline_stops++;
+    }
+
+    return result;
+}
+
+// Returns variables to take the actuations from:
+// the solution if the optimizer converged to the desired or the acceptable tolerances,
+// otherwise the final point if it is feasible and not worse than the best feasible iterate, or that iterate.
+// Returns nullptr if there is nothing to use.
+static const Dvector *SelectResult(const SolverResult &result, MPCSolution &sl)
+{
+    typedef CppAD::ipopt::solve_result<Dvector> Result;
+
+    sl.ok = result.solution.status == Result::success || result.solution.status == Result::stop_at_acceptable_point;
+    sl.iterations = result.iterations;
+    if(sl.ok)
+    {
+        sl.feasible = true;
+        return &result.solution.x;
+    }
+
+    if(result.final_violation <= K_FEASIBILITY_TOL &&
+       (!result.has_best_x || result.solution.obj_value <= result.best_obj))
+    {
+        Metrics::Instance.fallback_final_point++;
+        sl.feasible = true;
+        return &result.solution.x;
+    }
+
+    if(result.has_best_x)
+    {
+        Metrics::Instance.fallback_best_iterate++;
+        sl.feasible = true;
+        return &result.best_x;
+    }
+
+    sl.feasible = false;
+    return nullptr;
+}
+
+// Fills planned actuations of the solution from the variables
+static void FillActuations(const Dvector &x, const InputBasis &inputs, size_t delta_start, size_t a_start,
+                           MPCSolution &sl)
+{
+    for(size_t i = 0; i < inputs.StepsNum(); i++)
+    {
+        sl.delta_vals.push_back(inputs.Expand<double>(x, delta_start, i));
+        sl.a_vals.push_back(inputs.Expand<double>(x, a_start, i));
+    }
+    sl.dt_vals = Config::GetConfig().GetStageDt(inputs.StepsNum());
+    if(!sl.delta_vals.empty())
+    {
+        sl.delta = sl.delta_vals[0];
+        sl.acceleration = sl.a_vals[0];
+    }
+}
 
 //
 // MPC class definition implementation.
@@ -13,16 +275,73 @@
 MPC::MPC() {}
 MPC::~MPC() {}
 
+bool MPC::ConcurrentSolves(const Config &config)
+{
+    if(config.linear_solver == LinearSolver::Mumps && !K_MUMPS_THREAD_SAFE)
+    {
+        return false;
+    }
+
+    // 1 if the test problem was solved with the linear solver, 0 if it failed, -1 if it is not run yet
+    static mutex check_mutex;
+    static int checked[3] = {-1, -1, -1};
+    lock_guard<mutex> lock(check_mutex);
+    int &result = checked[(int)config.linear_solver];
+    if(result < 0)
+    {
+        // the HSL solvers are loaded at runtime, IPOPT fails if it is built without them
+        Dvector xi(2), xl(2), xu(2), gl(1), gu(1);
+        xi[0] = xi[1] = 0;
+        xl[0] = xl[1] = -10;
+        xu[0] = xu[1] = 10;
+        gl[0] = gu[0] = 1;
+        LinearSolverCheck check;
+        CppAD::ipopt::solve_result<Dvector> solution;
+        string options = string("Integer print_level 0\nString sb yes\nString linear_solver ")
+                         + LinearSolverName(config.linear_solver) + "\n";
+        CppAD::ipopt::solve<Dvector, LinearSolverCheck>(options, xi, xl, xu, gl, gu, check, solution);
+        result = solution.status == CppAD::ipopt::solve_result<Dvector>::success
+                 && fabs(solution.x[0]) < 1e-6 && fabs(solution.x[1] - 1) < 1e-6 ? 1 : 0;
+    }
+    return result == 1;
+}
+
+chrono::steady_clock::time_point MPC::GetDeadline()
+{
+    if(has_deadline)
+    {
+        return deadline;
+    }
+    auto timeout = chrono::duration<double>(Config::GetConfig().solve_deadline);
+    return chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(timeout);
+}
+
 MPCSolution MPC::Solve(Eigen::VectorXd state, Eigen::VectorXd coeffs, int points_num)
 {
-    //indices depend on number of points to fit
-    Indices idx(points_num);
+    Config config = Config::GetConfig();
+    if(config.solver == SolverType::LtvQp)
+    {
+        return SolveLtv(state, coeffs, points_num);
+    }
+    if(config.solver == SolverType::ParallelLtv)
+    {
+        return SolveParallelLtv(state, coeffs, points_num);
+    }
+    if(config.shooting == Shooting::Single)
+    {
+        return SolveSingleShooting(state, coeffs, points_num);
+    }
+    if(config.state_model == StateModel::Reduced)
+    {
+        return SolveReduced(state, coeffs, points_num);
+    }
 
-    bool ok = true;
-    typedef CPPAD_TESTVECTOR(double) Dvector;
+    //indices depend on number of points to fit and number of parameters of the actuator sequences
+    InputBasis inputs = InputBasis::FromConfig(config, points_num - 1);
+    Indices idx(points_num, inputs.ParamsNum());
 
     // number of variables
-    size_t n_vars = (idx.N * 6) + ((idx.N - 1) * 2);
+    size_t n_vars = (idx.N * 6) + (idx.inputs_num * 2);
 
     // number of constraints
     size_t n_constraints = idx.N * 6;
@@ -42,40 +361,159 @@ MPCSolution MPC::Solve(Eigen::VectorXd state, Eigen::VectorXd coeffs, int points
         vars[i] = 0;
     }
 
+    // Start from the solution of the closest cached problem if there is one, its initial state is replaced by ours
+    bool warm_start = false;
+    if(solution_cache != nullptr)
+    {
+        vector<double> cached;
+        warm_start = solution_cache->Find(state, coeffs, points_num, n_vars, config.solution_cache_distance, cached);
+        if(warm_start)
+        {
+            for (size_t i = 0; i < n_vars; i++)
+            {
+                vars[i] = cached[i];
+            }
+            vars[idx.x_start] = x;
+            vars[idx.y_start] = y;
+            vars[idx.psi_start] = psi;
+            vars[idx.v_start] = v;
+            vars[idx.cte_start] = cte;
+            vars[idx.epsi_start] = epsi;
+        }
+    }
+
     Dvector vars_lowerbound(n_vars);
     Dvector vars_upperbound(n_vars);
+    SetVarsBounds(vars_lowerbound, vars_upperbound, idx.delta_start, idx.a_start, n_vars);
 
-    // Set all non-actuators upper and lowerlimits
-    // to the max negative and positive values.
-    for (size_t i = 0; i < idx.delta_start; i++)
+    // Lower and upper limits for the constraints
+    // Should be 0 besides initial state.
+    Dvector constraints_lowerbound(n_constraints);
+    Dvector constraints_upperbound(n_constraints);
+    for (size_t i = 0; i < n_constraints; i++)
     {
-        vars_lowerbound[i] = -1.0e19;
-        vars_upperbound[i] = 1.0e19;
+        constraints_lowerbound[i] = 0;
+        constraints_upperbound[i] = 0;
     }
 
-    // The upper and lower limits of delta are set to -25 and 25
-    // degrees (values in radians).
-    // NOTE: Feel free to change this to something else.
-    for (size_t i = idx.delta_start; i < idx.a_start; i++)
+    constraints_lowerbound[idx.x_start] = x;
+    constraints_lowerbound[idx.y_start] = y;
+    constraints_lowerbound[idx.psi_start] = psi;
+    constraints_lowerbound[idx.v_start] = v;
+    constraints_lowerbound[idx.cte_start] = cte;
+    constraints_lowerbound[idx.epsi_start] = epsi;
+
+    constraints_upperbound[idx.x_start] = x;
+    constraints_upperbound[idx.y_start] = y;
+    constraints_upperbound[idx.psi_start] = psi;
+    constraints_upperbound[idx.v_start] = v;
+    constraints_upperbound[idx.cte_start] = cte;
+    constraints_upperbound[idx.epsi_start] = epsi;
+
+    // object that computes objective and constraints
+    FG_eval fg_eval(coeffs, idx, inputs);
+
+    auto result = RunSolver(fg_eval, vars, vars_lowerbound, vars_upperbound,
+                            constraints_lowerbound, constraints_upperbound, GetDeadline(), cancel);
+
+    MPCSolution sl;
+    const Dvector *solution_x = SelectResult(result, sl);
+    sl.warm_start = warm_start;
+    if(solution_cache != nullptr)
     {
-        vars_lowerbound[i] = -0.436332;
-        vars_upperbound[i] = 0.436332;
+        // iterations of the warm and cold starts show how much the cache saves
+        if(warm_start)
+        {
+            Metrics::Instance.cache_hits++;
+            Metrics::Instance.cache_hit_iterations += sl.iterations;
+        }
+        else
+        {
+            Metrics::Instance.cache_misses++;
+            Metrics::Instance.cache_miss_iterations += sl.iterations;
+        }
+        if(sl.ok)
+        {
+            solution_cache->Add(state, coeffs, points_num, vector<double>(solution_x->data(), solution_x->data() + n_vars));
+        }
+    }
+    if(solution_x == nullptr)
+    {
+        return sl;
     }
 
-    // Acceleration/decceleration upper and lower limits.
-    // NOTE: Feel free to change this to something else.
+    FillActuations(*solution_x, inputs, idx.delta_start, idx.a_start, sl);
+    // exclude last point because it is a car position, we don't need it
+    for(size_t i = 0; i < idx.N - 1; i++)
+    {
+        sl.x_vals.push_back((*solution_x)[idx.x_start + 1 + i]);
+        sl.y_vals.push_back((*solution_x)[idx.y_start + 1 + i]);
+    }
 
-    // The maximum acceleration that I observed on my pc was about 4 meters per second per second,
-    // so acceleration will be +- 4 m/s**2
-    // This is not an actuator value this is a real acceleration.
-    for (size_t i = idx.a_start; i < n_vars; i++)
+    return sl;
+}
+
+MPCSolution MPC::SolveLtv(Eigen::VectorXd state, Eigen::VectorXd coeffs, int points_num)
+{
+    // the dense QP has fixed-size storage, longer horizons are split into segments
+    if(points_num > K_LTV_MAX_POINTS)
     {
-        vars_lowerbound[i] = -4.0;
-        vars_upperbound[i] = 4.0;
+        Metrics::Instance.ltv_long_horizons++;
+        return SolveParallelLtv(state, coeffs, points_num);
     }
 
-    // Lower and upper limits for the constraints
-    // Should be 0 besides initial state.
+    LtvMpc ltv;
+    MPCSolution sl = ltv.Solve(state, coeffs, points_num, previous_delta, previous_a);
+    sl.warm_start = !previous_delta.empty();
+
+    Metrics::Instance.solves++;
+    if(sl.ok)
+    {
+        Metrics::Instance.solve_success++;
+    }
+    return sl;
+}
+
+MPCSolution MPC::SolveParallelLtv(Eigen::VectorXd state, Eigen::VectorXd coeffs, int points_num)
+{
+    ParallelLtvMpc ltv(thread_pool);
+    MPCSolution sl = ltv.Solve(state, coeffs, points_num, previous_delta, previous_a);
+    sl.warm_start = !previous_delta.empty();
+
+    Metrics::Instance.solves++;
+    if(sl.ok)
+    {
+        Metrics::Instance.solve_success++;
+    }
+    return sl;
+}
+
+MPCSolution MPC::SolveReduced(Eigen::VectorXd state, Eigen::VectorXd coeffs, int points_num)
+{
+    InputBasis inputs = InputBasis::FromConfig(Config::GetConfig(), points_num - 1);
+    ReducedIndices idx(points_num, inputs.ParamsNum());
+
+    // number of variables
+    size_t n_vars = (idx.N * 4) + (idx.inputs_num * 2);
+
+    // number of constraints
+    size_t n_constraints = idx.N * 4;
+
+    double x = state[0];
+    double y = state[1];
+    double psi = state[2];
+    double v = state[3];
+
+    Dvector vars(n_vars);
+    for (size_t i = 0; i < n_vars; i++)
+    {
+        vars[i] = 0;
+    }
+
+    Dvector vars_lowerbound(n_vars);
+    Dvector vars_upperbound(n_vars);
+    SetVarsBounds(vars_lowerbound, vars_upperbound, idx.delta_start, idx.a_start, n_vars);
+
     Dvector constraints_lowerbound(n_constraints);
     Dvector constraints_upperbound(n_constraints);
     for (size_t i = 0; i < n_constraints; i++)
@@ -88,57 +526,141 @@ MPCSolution MPC::Solve(Eigen::VectorXd state, Eigen::VectorXd coeffs, int points
     constraints_lowerbound[idx.y_start] = y;
     constraints_lowerbound[idx.psi_start] = psi;
     constraints_lowerbound[idx.v_start] = v;
-    constraints_lowerbound[idx.cte_start] = cte;
-    constraints_lowerbound[idx.epsi_start] = epsi;
 
     constraints_upperbound[idx.x_start] = x;
     constraints_upperbound[idx.y_start] = y;
     constraints_upperbound[idx.psi_start] = psi;
     constraints_upperbound[idx.v_start] = v;
-    constraints_upperbound[idx.cte_start] = cte;
-    constraints_upperbound[idx.epsi_start] = epsi;
 
-    // object that computes objective and constraints
-    FG_eval fg_eval(coeffs, idx);
-    //
-    // NOTE: You don't have to worry about these options
-    //
-    // options for IPOPT solver
-    std::string options;
-    // Uncomment this if you'd like more print information
-    options += "Integer print_level  0\n";
-    // NOTE: Setting sparse to true allows the solver to take advantage
-    // of sparse routines, this makes the computation MUCH FASTER. If you
-    // can uncomment 1 of these and see if it makes a difference or not but
-    // if you uncomment both the computation time should go up in orders of
-    // magnitude.
-    options += "Sparse  true        forward\n";
-    options += "Sparse  true        reverse\n";
-    // NOTE: Currently the solver has a maximum time limit of 0.5 seconds.
-    // Change this as you see fit.
-    options += "Numeric max_cpu_time          " + std::to_string(Config::GetConfig().max_cpu_time) + "\n";
-
-    // place to return solution
-    CppAD::ipopt::solve_result<Dvector> solution;
+    FG_eval_reduced fg_eval(coeffs, idx, inputs);
 
-    // solve the problem
-    CppAD::ipopt::solve<Dvector, FG_eval>(options, vars,
-                                          vars_lowerbound, vars_upperbound,
-                                          constraints_lowerbound, constraints_upperbound,
-                                          fg_eval, solution);
+    auto result = RunSolver(fg_eval, vars, vars_lowerbound, vars_upperbound,
+                            constraints_lowerbound, constraints_upperbound, GetDeadline(), cancel);
 
-    // Check some of the solution values
-    ok &= solution.status == CppAD::ipopt::solve_result<Dvector>::success;
+    MPCSolution sl;
+    const Dvector *solution_x = SelectResult(result, sl);
+    if(solution_x == nullptr)
+    {
+        return sl;
+    }
 
+    FillActuations(*solution_x, inputs, idx.delta_start, idx.a_start, sl);
+    for(size_t i = 0; i < idx.N - 1; i++)
+    {
+        sl.x_vals.push_back((*solution_x)[idx.x_start + 1 + i]);
+        sl.y_vals.push_back((*solution_x)[idx.y_start + 1 + i]);
+    }
+
+    return sl;
+}
+
+MPCSolution MPC::SolveSingleShooting(Eigen::VectorXd state, Eigen::VectorXd coeffs, int points_num)
+{
+    InputBasis inputs = InputBasis::FromConfig(Config::GetConfig(), points_num - 1);
+    ShootingIndices idx(points_num, inputs.ParamsNum());
+
+    // only actuations are variables and there are no constraints besides their limits
+    size_t n_vars = idx.inputs_num * 2;
+
+    Dvector vars(n_vars);
+    for (size_t i = 0; i < n_vars; i++)
+    {
+        vars[i] = 0;
+    }
+
+    Dvector vars_lowerbound(n_vars);
+    Dvector vars_upperbound(n_vars);
+    SetVarsBounds(vars_lowerbound, vars_upperbound, idx.delta_start, idx.a_start, n_vars);
+
+    Dvector constraints_lowerbound(0);
+    Dvector constraints_upperbound(0);
+
+    FG_eval_single fg_eval(coeffs, state, idx, inputs);
+
+    auto result = RunSolver(fg_eval, vars, vars_lowerbound, vars_upperbound,
+                            constraints_lowerbound, constraints_upperbound, GetDeadline(), cancel);
 
     MPCSolution sl;
-    sl.acceleration = solution.x[idx.a_start];
-    sl.delta = solution.x[idx.delta_start];
-    // exclude last point because it is a car position, we don't need it
+    const Dvector *solution_x = SelectResult(result, sl);
+    if(solution_x == nullptr)
+    {
+        return sl;
+    }
+
+    FillActuations(*solution_x, inputs, idx.delta_start, idx.a_start, sl);
+
+    // roll out the trajectory with the found actuations the same way the cost does it
+    ModelState<double> s = {state[0], state[1], state[2], state[3], state[4], state[5]};
+    for(size_t i = 0; i < idx.N - 1; i++)
+    {
+        s = ModelStep(s, sl.delta_vals[i], sl.a_vals[i], coeffs, sl.dt_vals[i]);
+        sl.x_vals.push_back(s.x);
+        sl.y_vals.push_back(s.y);
+    }
+
+    return sl;
+}
+
+MPCSolution MPC::SolveFrenet(Eigen::VectorXd state, const vector<double> &curvature, int points_num)
+{
+    InputBasis inputs = InputBasis::FromConfig(Config::GetConfig(), points_num - 1);
+    FrenetIndices idx(points_num, inputs.ParamsNum());
+
+    // number of variables
+    size_t n_vars = (idx.N * 4) + (idx.inputs_num * 2);
+
+    // number of constraints
+    size_t n_constraints = idx.N * 4;
+
+    double n = state[0];
+    double mu = state[1];
+    double v = state[2];
+
+    // Progress is measured from the current position, so it always starts from 0
+    Dvector vars(n_vars);
+    for (size_t i = 0; i < n_vars; i++)
+    {
+        vars[i] = 0;
+    }
+
+    Dvector vars_lowerbound(n_vars);
+    Dvector vars_upperbound(n_vars);
+    SetVarsBounds(vars_lowerbound, vars_upperbound, idx.delta_start, idx.a_start, n_vars);
+
+    Dvector constraints_lowerbound(n_constraints);
+    Dvector constraints_upperbound(n_constraints);
+    for (size_t i = 0; i < n_constraints; i++)
+    {
+        constraints_lowerbound[i] = 0;
+        constraints_upperbound[i] = 0;
+    }
+
+    constraints_lowerbound[idx.n_start] = n;
+    constraints_lowerbound[idx.mu_start] = mu;
+    constraints_lowerbound[idx.v_start] = v;
+
+    constraints_upperbound[idx.n_start] = n;
+    constraints_upperbound[idx.mu_start] = mu;
+    constraints_upperbound[idx.v_start] = v;
+
+    FG_eval_frenet fg_eval(curvature, idx, inputs);
+
+    auto result = RunSolver(fg_eval, vars, vars_lowerbound, vars_upperbound,
+                            constraints_lowerbound, constraints_upperbound, GetDeadline(), cancel);
+
+    MPCSolution sl;
+    const Dvector *solution_x = SelectResult(result, sl);
+    if(solution_x == nullptr)
+    {
+        return sl;
+    }
+
+    FillActuations(*solution_x, inputs, idx.delta_start, idx.a_start, sl);
+    // exclude the first point because it is a car position
     for(size_t i = 0; i < idx.N - 1; i++)
     {
-        sl.x_vals.push_back(solution.x[idx.x_start + 1 + i]);
-        sl.y_vals.push_back(solution.x[idx.y_start + 1 + i]);
+        sl.s_vals.push_back((*solution_x)[idx.s_start + 1 + i]);
+        sl.n_vals.push_back((*solution_x)[idx.n_start + 1 + i]);
     }
 
     return sl;
@@ -1,19 +1,56 @@
 #ifndef MPC_H
 #define MPC_H
 
+#include <atomic>
+#include <chrono>
 #include <vector>
 #include "Eigen-3.3/Eigen/Core"
+#include "config.h"
+#include "solution_cache.h"
+#include "thread_pool.h"
 
 using namespace std;
 
+// Steering angle limits are -25 and 25 degrees (values in radians).
+const double K_MAX_DELTA = 0.436332;
+
+// The maximum acceleration that I observed on my pc was about 4 meters per second per second,
+// so acceleration will be +- 4 m/s**2
+const double K_MAX_ACCELERATION = 4.0;
 
 class MPCSolution
 {
     public:
-        double acceleration;
-        double delta;
+        // true if the optimizer reported success
+        bool ok = false;
+
+        // true if the actuations can be used: either the optimizer succeeded
+        // or it was stopped but found a feasible point
+        bool feasible = false;
+
+        double acceleration = 0;
+        double delta = 0;
+
+        // number of the optimizer iterations
+        int iterations = 0;
+
+        // true if the optimizer started from a previous or cached solution instead of zeros
+        bool warm_start = false;
+
+        // all the planned actuations, the first ones are equal to delta and acceleration
+        vector<double> delta_vals;
+        vector<double> a_vals;
+
+        // time during which every planned actuation is applied
+        vector<double> dt_vals;
+
         vector<double> x_vals;
         vector<double> y_vals;
+
+        // predicted trajectory in path coordinates (progress and lateral offset),
+        // filled only by the path coordinates formulation
+        vector<double> s_vals;
+        vector<double> n_vals;
 };
 
 // Represents model predictive controller as in the lab
@@ -25,8 +62,84 @@ class MPC
         virtual ~MPC();
 
         // Solve the model given an initial state, polynomial coefficients and number of points to fit.
-        // Return the first actuatotions and proposed trajectory points
+        // Return the first actuatotions and proposed trajectory points.
+        // Config::solver selects IPOPT or the linear time-varying QP,
+        // Config::shooting selects multiple or single shooting, Config::state_model selects the model for multiple one.
         MPCSolution Solve(Eigen::VectorXd state, Eigen::VectorXd coeffs, int points_num);
+
+        // Solve the model formulated in path coordinates given an initial state [n, mu, v]
+        // (lateral offset, heading error, velocity) and track curvature at every point of the horizon.
+        // Return the first actuations and proposed trajectory in path coordinates.
+        MPCSolution SolveFrenet(Eigen::VectorXd state, const vector<double> &curvature, int points_num);
+
+        // Returns true if IPOPT solves can run on several threads at once with the linear solver of the config:
+        // the solver is thread safe (HSL, or MUMPS since IPOPT 3.14) and a test problem is solved with it.
+        // The test runs once for every linear solver. Otherwise the IPOPT runs of all the threads are serialized,
+        // a run waits for the running one at most until its deadline.
+        static bool ConcurrentSolves(const Config &config);
+
+        // Sets wall clock time when the optimizer must be stopped.
+        // If it is not set, the optimizer is stopped after Config::solve_deadline seconds since the start of Solve.
+        void SetDeadline(chrono::steady_clock::time_point deadline)
+        {
+            this->deadline = deadline;
+            has_deadline = true;
+        }
+
+        // Sets the flag which stops the optimizer the same way as the deadline once it is set, nullptr disables it
+        void SetCancel(const atomic<bool> *cancel)
+        {
+            this->cancel = cancel;
+        }
+
+        // Sets the cache of the solutions used as initial points by the multiple shooting IPOPT problem
+        // (and filled with its solutions), nullptr disables it
+        void SetSolutionCache(SolutionCache *solution_cache)
+        {
+            this->solution_cache = solution_cache;
+        }
+
+        // Sets the pool solving the segments of the horizon with SolverType::ParallelLtv,
+        // nullptr solves them on the calling thread
+        void SetThreadPool(ThreadPool *thread_pool)
+        {
+            this->thread_pool = thread_pool;
+        }
+
+        // Sets the previous plan shifted to the current time, it is used as the nominal trajectory by the QP solver
+        void SetPreviousPlan(const vector<double> &delta_vals, const vector<double> &a_vals)
+        {
+            previous_delta = delta_vals;
+            previous_a = a_vals;
+        }
+
+    private:
+        chrono::steady_clock::time_point deadline;
+        bool has_deadline = false;
+
+        const atomic<bool> *cancel = nullptr;
+
+        vector<double> previous_delta;
+        vector<double> previous_a;
+
+        SolutionCache *solution_cache = nullptr;
+
+        ThreadPool *thread_pool = nullptr;
+
+        // Returns the deadline for the optimizer started now
+        chrono::steady_clock::time_point GetDeadline();
+
+        // Solves the polynomial formulation as a linear time-varying QP
+        MPCSolution SolveLtv(Eigen::VectorXd state, Eigen::VectorXd coeffs, int points_num);
+
+        // Solves the polynomial formulation as a linear time-varying QP split into segments of the horizon
+        MPCSolution SolveParallelLtv(Eigen::VectorXd state, Eigen::VectorXd coeffs, int points_num);
+
+        // Solves the polynomial formulation with the reduced state model
+        MPCSolution SolveReduced(Eigen::VectorXd state, Eigen::VectorXd coeffs, int points_num);
+
+        // Solves the polynomial formulation optimizing only actuations
+        MPCSolution SolveSingleShooting(Eigen::VectorXd state, Eigen::VectorXd coeffs, int points_num);
 };
 
 #endif /* MPC_H */
@@ -0,0 +1,97 @@
+#include "async_solver.h"
+
+#include "config.h"
+#include "metrics.h"
+
+AsyncSolver::~AsyncSolver()
+{
+    {
+        lock_guard<mutex> lock(queue_mutex);
+        stop = true;
+    }
+    queue_changed.notify_all();
+    if(solver_thread.joinable())
+    {
+        solver_thread.join();
+    }
+}
+
+void AsyncSolver::Submit(Problem problem, double plan_start_time, const PlanOrigin &origin)
+{
+    {
+        lock_guard<mutex> lock(queue_mutex);
+        if(has_pending)
+        {
+            Metrics::Instance.replaced_problems++;
+        }
+        pending = move(problem);
+        pending_start_time = plan_start_time;
+        pending_origin = origin;
+        has_pending = true;
+
+        if(!solver_thread.joinable())
+        {
+            cppad_thread.reset(new CppADThread());
+            solver_thread = thread(&AsyncSolver::Run, this);
+        }
+    }
+    queue_changed.notify_all();
+}
+
+void AsyncSolver::Drain()
+{
+    unique_lock<mutex> lock(queue_mutex);
+    has_pending = false;
+    queue_changed.wait(lock, [this] { return !busy; });
+}
+
+void AsyncSolver::Run()
+{
+    cppad_thread->Enter();
+    auto last_start = chrono::steady_clock::time_point();
+    unique_lock<mutex> lock(queue_mutex);
+    while(true)
+    {
+        queue_changed.wait(lock, [this] { return stop || has_pending; });
+        if(stop)
+        {
+            cppad_thread->Leave();
+            return;
+        }
+
+        // don't start the optimizer more often than the solve period,
+        // problems submitted in the meantime replace the pending one, so the freshest state is solved
+        auto period = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(solve_period));
+        if(queue_changed.wait_until(lock, last_start + period, [this] { return stop; }))
+        {
+            cppad_thread->Leave();
+            return;
+        }
+
+        // the problem could be dropped meanwhile
+        if(!has_pending)
+        {
+            continue;
+        }
+
+        Problem problem = move(pending);
+        double start_time = pending_start_time;
+        PlanOrigin origin = pending_origin;
+        has_pending = false;
+        busy = true;
+        lock.unlock();
+
+        last_start = chrono::steady_clock::now();
+        auto timeout = chrono::duration<double>(Config::GetConfig().solve_deadline);
+        auto deadline = last_start + chrono::duration_cast<chrono::steady_clock::duration>(timeout);
+        MPCSolution solution = problem(deadline);
+        if(solution.feasible)
+        {
+            plan_buffer.Publish(solution, start_time, origin);
+        }
+
+        lock.lock();
+        busy = false;
+        queue_changed.notify_all();
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef MPC_ASYNC_SOLVER_H
+#define MPC_ASYNC_SOLVER_H
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "MPC.h"
+#include "plan_buffer.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+// Runs the optimizer on a background thread, so telemetry messages are answered without waiting for it.
+// Only the latest submitted problem is kept: if the solver is busy, a newer problem replaces the pending one.
+// Feasible solutions are published to the plan buffer with the time the problem was stated for.
+class AsyncSolver
+{
+    public:
+        // Solves the problem, it is called on the solver thread with the deadline of the run
+        typedef function<MPCSolution(chrono::steady_clock::time_point deadline)> Problem;
+
+        explicit AsyncSolver(PlanBuffer &plan_buffer) : plan_buffer(plan_buffer) {}
+
+        ~AsyncSolver();
+
+        // Queues the problem, the plan found for it starts at plan_start_time from the car's pose origin.
+        // The solver thread is started on the first call with its own CppAD thread number (see CppADThread).
+        void Submit(Problem problem, double plan_start_time, const PlanOrigin &origin);
+
+        // Drops the pending problem and waits until the running solve is finished,
+        // so the caller can solve on its own thread without overlapping it
+        void Drain();
+
+        // Minimum time in seconds between starts of the optimizer, 0 solves every submitted problem
+        void SetSolvePeriod(double period)
+        {
+            lock_guard<mutex> lock(queue_mutex);
+            solve_period = period;
+        }
+
+        bool IsBusy() const
+        {
+            lock_guard<mutex> lock(queue_mutex);
+            return busy || has_pending;
+        }
+
+    private:
+        PlanBuffer &plan_buffer;
+
+        unique_ptr<CppADThread> cppad_thread;
+        thread solver_thread;
+        mutable mutex queue_mutex;
+        condition_variable queue_changed;
+
+        // the latest problem that is not started yet
+        Problem pending;
+        double pending_start_time = 0;
+        PlanOrigin pending_origin;
+        bool has_pending = false;
+
+        bool busy = false;
+        bool stop = false;
+
+        double solve_period = 0;
+
+        void Run();
+};
+
+#endif //MPC_ASYNC_SOLVER_H
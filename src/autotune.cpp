@@ -0,0 +1,347 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "config.h"
+#include "config_file.h"
+#include "geometric_controller.h"
+#include "metrics.h"
+#include "offline_solve.h"
+#include "processor.h"
+#include "track_map.h"
+#include "utils.h"
+
+// Tunes the weights, the time step and the horizon of a config by driving headless closed-loop laps.
+// A kinematic car drives one lap of the track map controlled by the optimizer: every cycle the command is found
+// for the state predicted after the latency and applied when the cycle ends, the cycle takes the actuator latency
+// plus the measured solve time, as with the simulator. Laps run in worker processes on all cores.
+//
+// The search is the cross-entropy method: candidates are sampled from a normal distribution over the normalized
+// parameters, its mean and deviation are moved to the best quarter of every generation. It needs far fewer laps
+// than a grid and doesn't need gradients of the noisy objective.
+// The objective is lap time + K_CTE_COST * RMS cte + K_LATENCY_COST * p99 solve time, so cheaper settings win
+// when they drive as well. The best config is written as a config file (see config_file.h).
+//
+// Usage: ./autotune track.csv output.cfg [base: 50|60|70|file.cfg] [laps number] [workers number]
+
+Config Config::Instance = Config60();
+
+Metrics Metrics::Instance;
+
+// Time between the command is found and applied, as the sleep in Processor::Process
+const double K_ACTUATION_LATENCY = 0.1;
+
+// Integration step of the simulated car
+const double K_SIMULATION_STEP = 0.01;
+
+// The lap fails if the car is farther than this from the track center or the lap takes longer
+const double K_MAX_CTE = 3;
+const double K_MAX_LAP_TIME = 300;
+
+// Seconds of the lap time one meter of RMS cte and one millisecond of p99 solve time cost
+const double K_CTE_COST = 20;
+const double K_LATENCY_COST = 0.2;
+
+// Cost of a failed lap, the distance left is added so laps failing later are better
+const double K_FAILED_LAP_COST = 1000;
+
+// Share of the generation the distribution is fitted to and how much of the old distribution is kept
+const double K_ELITE_SHARE = 0.25;
+const double K_SMOOTHING = 0.3;
+const double K_MIN_DEVIATION = 0.02;
+
+// Result of one lap written by a worker
+struct LapResult
+{
+    double lap_time;
+    double rms_cte;
+    double p99_solve_ms;
+    double distance;
+    uint8_t completed;
+};
+
+// Tuned field of the config, values are searched in [min, max], on the log scale for the weights
+struct TunedParameter
+{
+    string name;
+    double min;
+    double max;
+    bool log_scale;
+    bool integer;
+
+    // value in the base config
+    double initial;
+};
+
+// Maps the normalized value in [0, 1] to the parameter value
+static double ParameterValue(const TunedParameter &p, double u)
+{
+    double value = p.log_scale ? p.min * pow(p.max / p.min, u) : p.min + (p.max - p.min) * u;
+    return p.integer ? round(value) : value;
+}
+
+static double NormalizedValue(const TunedParameter &p, double value)
+{
+    double u = p.log_scale ? log(value / p.min) / log(p.max / p.min) : (value - p.min) / (p.max - p.min);
+    return min(max(u, 0.), 1.);
+}
+
+static Config MakeCandidate(const Config &base, const vector<TunedParameter> &parameters, const vector<double> &u)
+{
+    Config config = base;
+    for(size_t i = 0; i < parameters.size(); i++)
+    {
+        ostringstream value;
+        value.precision(12);
+        value << ParameterValue(parameters[i], u[i]);
+        SetConfigValue(config, parameters[i].name, value.str());
+    }
+    return config;
+}
+
+// Drives one lap from standstill at the start of the track
+static LapResult DriveLap(TrackMap &track, const Config &config)
+{
+    ScopedConfig scoped(config);
+    Processor processor;
+    processor.SetTrackMap(&track);
+    GeometricController geometric_controller;
+
+    TrackPoint start = track.GetPoint(0);
+    double px = start.x, py = start.y, psi = start.heading, v = 0;
+    double delta = 0, a = 0;
+    double time = 0, distance = 0, cte2_time = 0, s = 0;
+    double latency = K_ACTUATION_LATENCY;
+    vector<double> solve_ms;
+    vector<double> pts_x, pts_y;
+
+    LapResult result = {0, 0, 0, 0, 0};
+    while(distance < track.Length() && time < K_MAX_LAP_TIME)
+    {
+        // 1. Solve for the state after the latency, in car's coordinates then
+        auto solve_start = chrono::steady_clock::now();
+        processor.GetTrackWaypoints(px, py, pts_x, pts_y);
+        double lx = px + v * cos(psi) * latency;
+        double ly = py + v * sin(psi) * latency;
+        double lpsi = psi + v * delta / Lf * latency;
+        double lv = v + a * latency;
+        Eigen::VectorXd xs(pts_x.size()), ys(pts_y.size());
+        for(size_t i = 0; i < pts_x.size(); i++)
+        {
+            double dx = pts_x[i] - lx, dy = pts_y[i] - ly;
+            xs[i] = dx * cos(lpsi) + dy * sin(lpsi);
+            ys[i] = -dx * sin(lpsi) + dy * cos(lpsi);
+        }
+        int points_num = processor.CalcPointsNum(pts_x, pts_y, lv, config.GetStageDt(config.max_points_num),
+                                                 config.max_points_num);
+        auto timeout = chrono::duration<double>(config.solve_deadline);
+        MPCSolution solution = processor.SolvePolynomial(
+            xs, ys, lv, points_num,
+            solve_start + chrono::duration_cast<chrono::steady_clock::duration>(timeout));
+        if(!solution.feasible)
+        {
+            solution = geometric_controller.Control(polyfit(xs, ys, 3), lv, time);
+        }
+        double solve_time = chrono::duration<double>(chrono::steady_clock::now() - solve_start).count();
+        solve_ms.push_back(solve_time * 1000);
+
+        // 2. The car moves with the previous command until this one is applied
+        double cycle = K_ACTUATION_LATENCY + solve_time;
+        latency = latency * 0.9 + cycle * 0.1;
+        for(double t = 0; t < cycle; t += K_SIMULATION_STEP)
+        {
+            double step = min(K_SIMULATION_STEP, cycle - t);
+            px += v * cos(psi) * step;
+            py += v * sin(psi) * step;
+            psi += v * delta / Lf * step;
+            v = max(0., v + a * step);
+
+            double new_s = track.FindNearest(px, py);
+            double ds = new_s - s;
+            ds -= track.Length() * round(ds / track.Length());
+            distance += ds;
+            s = new_s;
+
+            TrackPoint p = track.GetPoint(s);
+            double cte = -(px - p.x) * sin(p.heading) + (py - p.y) * cos(p.heading);
+            cte2_time += cte * cte * step;
+            time += step;
+            if(fabs(cte) > K_MAX_CTE)
+            {
+                result.distance = distance;
+                return result;
+            }
+        }
+
+        // 3. Apply the command within the actuator limits
+        delta = max(min(solution.delta, deg2rad(25)), -deg2rad(25));
+        a = max(min(solution.acceleration * 0.25, 1.), -1.) * 4;
+    }
+
+    sort(solve_ms.begin(), solve_ms.end());
+    result.lap_time = time;
+    result.rms_cte = sqrt(cte2_time / max(time, 1e-9));
+    result.p99_solve_ms = solve_ms.empty() ? 0 : solve_ms[min(solve_ms.size() - 1, solve_ms.size() * 99 / 100)];
+    result.distance = distance;
+    result.completed = distance >= track.Length() ? 1 : 0;
+    return result;
+}
+
+static double Objective(const LapResult &lap, double track_length)
+{
+    if(!lap.completed)
+    {
+        return K_FAILED_LAP_COST + max(0., track_length - lap.distance);
+    }
+    return lap.lap_time + K_CTE_COST * lap.rms_cte + K_LATENCY_COST * lap.p99_solve_ms;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 3)
+    {
+        cout << "Usage: ./autotune track.csv output.cfg [base: 50|60|70|file.cfg] [laps number] [workers number]"
+             << endl;
+        return 1;
+    }
+    string base_name = argc > 3 ? argv[3] : "60";
+    int laps_num = argc > 4 ? atoi(argv[4]) : 256;
+    int workers = argc > 5 ? atoi(argv[5]) : max(1, (int)thread::hardware_concurrency());
+
+    TrackMap track;
+    if(!track.LoadCsv(argv[1]))
+    {
+        cerr << "Can't load track " << argv[1] << endl;
+        return 1;
+    }
+
+    Config base;
+    string error;
+    if(base_name == "50")
+    {
+        base = Config50();
+    }
+    else if(base_name == "60")
+    {
+        base = Config60();
+    }
+    else if(base_name == "70")
+    {
+        base = Config70();
+    }
+    else if(!LoadConfigFile(base_name, base, error))
+    {
+        cerr << error << endl;
+        return 1;
+    }
+
+    // the weights are searched within a factor of 10 of the base ones
+    vector<TunedParameter> parameters = {
+        {"cte_w", base.cte_w / 10, base.cte_w * 10, true, false, base.cte_w},
+        {"epsi_w", base.epsi_w / 10, base.epsi_w * 10, true, false, base.epsi_w},
+        {"velocity_diff_w", base.velocity_diff_w / 10, base.velocity_diff_w * 10, true, false, base.velocity_diff_w},
+        {"delta_diff_w", base.delta_diff_w / 10, base.delta_diff_w * 10, true, false, base.delta_diff_w},
+        {"a_diff_w", base.a_diff_w / 10, base.a_diff_w * 10, true, false, base.a_diff_w},
+        {"dt", 0.03, 0.25, false, false, base.dt},
+        {"max_points_num", 5, 40, false, true, (double)base.max_points_num}};
+    size_t dims = parameters.size();
+
+    // 1. The distribution starts at the base config, which is the first candidate, so the result is never worse
+    vector<double> mean(dims), deviation(dims, 0.25);
+    for(size_t i = 0; i < dims; i++)
+    {
+        mean[i] = NormalizedValue(parameters[i], parameters[i].initial);
+    }
+
+    int generation_size = max(8, workers);
+    int generations = max(1, laps_num / generation_size);
+    size_t elites_num = max((size_t)2, (size_t)(generation_size * K_ELITE_SHARE));
+    mt19937 generator(1);
+    normal_distribution<double> normal(0, 1);
+
+    Config best_config = base;
+    LapResult best_lap = {0, 0, 0, 0, 0};
+    double best_objective = numeric_limits<double>::max();
+    for(int g = 0; g < generations; g++)
+    {
+        // 2. Sample the generation and drive its laps in parallel
+        vector<vector<double>> candidates(generation_size, vector<double>(dims));
+        vector<Config> configs;
+        for(int c = 0; c < generation_size; c++)
+        {
+            for(size_t i = 0; i < dims; i++)
+            {
+                double u = g == 0 && c == 0 ? mean[i] : mean[i] + deviation[i] * normal(generator);
+                candidates[c][i] = min(max(u, 0.), 1.);
+            }
+            configs.push_back(MakeCandidate(base, parameters, candidates[c]));
+        }
+        if(g == 0)
+        {
+            configs[0] = base;
+        }
+
+        auto start = chrono::steady_clock::now();
+        vector<LapResult> laps = RunWorkerProcesses<LapResult>(configs.size(), workers,
+                                                               [&track, &configs](size_t c, LapResult &lap) {
+            lap = DriveLap(track, configs[c]);
+        });
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        // 3. Move the distribution to the best candidates
+        vector<size_t> order(configs.size());
+        vector<double> objectives(configs.size());
+        for(size_t c = 0; c < configs.size(); c++)
+        {
+            order[c] = c;
+            objectives[c] = Objective(laps[c], track.Length());
+        }
+        sort(order.begin(), order.end(), [&objectives](size_t l, size_t r) { return objectives[l] < objectives[r]; });
+
+        if(objectives[order[0]] < best_objective)
+        {
+            best_objective = objectives[order[0]];
+            best_config = configs[order[0]];
+            best_lap = laps[order[0]];
+        }
+
+        for(size_t i = 0; i < dims; i++)
+        {
+            double elite_mean = 0, elite_variance = 0;
+            for(size_t e = 0; e < elites_num; e++)
+            {
+                elite_mean += candidates[order[e]][i] / elites_num;
+            }
+            for(size_t e = 0; e < elites_num; e++)
+            {
+                double d = candidates[order[e]][i] - elite_mean;
+                elite_variance += d * d / elites_num;
+            }
+            mean[i] = K_SMOOTHING * mean[i] + (1 - K_SMOOTHING) * elite_mean;
+            deviation[i] = max(K_MIN_DEVIATION, K_SMOOTHING * deviation[i] + (1 - K_SMOOTHING) * sqrt(elite_variance));
+        }
+
+        cout << "generation " << g + 1 << "/" << generations << ": " << configs.size() << " laps in " << seconds << " s"
+             << ", best objective " << objectives[order[0]] << ", overall " << best_objective << endl;
+    }
+
+    // 4. Write the best config
+    ostringstream comment;
+    comment << "tuned by autotune on " << argv[1] << " from " << base_name << "\n"
+            << "lap time " << best_lap.lap_time << " s, RMS cte " << best_lap.rms_cte << " m, p99 solve time "
+            << best_lap.p99_solve_ms << " ms, objective " << best_objective;
+    if(!WriteConfigFile(argv[2], best_config, comment.str()))
+    {
+        cerr << "Can't write " << argv[2] << endl;
+        return 1;
+    }
+    cout << comment.str() << endl;
+    cout << "written to " << argv[2] << endl;
+    return 0;
+}
@@ -0,0 +1,430 @@
+#include "batch_solver.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+#include "config.h"
+#include "utils.h"
+
+// ADMM penalty of every variable relative to its diagonal element of the QP Hessian
+const double K_ADMM_SCALE = 0.05;
+
+// The solution is reported as converged if the last ADMM iteration changed the actuations by less than this
+const double K_ADMM_TOLERANCE = 1e-3;
+
+// Values of one quantity for all the lanes
+struct Lanes
+{
+    double v[K_BATCH_LANES];
+};
+
+typedef vector<Lanes> LaneArray;
+
+// Model step of LtvStep for all the lanes. s is the state, A (6 x 6) and B (6 x 2) are filled row by row.
+static void StepLanes(const Lanes s[6], const Lanes &delta, const Lanes &a, const Lanes coeffs[4], double dt,
+                      Lanes next[6], Lanes A[36], Lanes B[12])
+{
+    for(int i = 0; i < 36; i++)
+    {
+        for(int l = 0; l < K_BATCH_LANES; l++)
+        {
+            A[i].v[l] = 0;
+        }
+    }
+    for(int i = 0; i < 12; i++)
+    {
+        for(int l = 0; l < K_BATCH_LANES; l++)
+        {
+            B[i].v[l] = 0;
+        }
+    }
+
+    for(int l = 0; l < K_BATCH_LANES; l++)
+    {
+        double x = s[0].v[l];
+        double y = s[1].v[l];
+        double psi = s[2].v[l];
+        double v = s[3].v[l];
+        double epsi = s[5].v[l];
+        double c0 = coeffs[0].v[l], c1 = coeffs[1].v[l], c2 = coeffs[2].v[l], c3 = coeffs[3].v[l];
+
+        double f = c0 + c1 * x + c2 * x * x + c3 * x * x * x;
+        double df = c1 + 2 * c2 * x + 3 * c3 * x * x;
+        double ddf = 2 * c2 + 6 * c3 * x;
+        double cos_psi = cos(psi);
+        double sin_psi = sin(psi);
+        double turn = v * delta.v[l] / Lf * dt;
+
+        next[0].v[l] = x + v * cos_psi * dt;
+        next[1].v[l] = y + v * sin_psi * dt;
+        next[2].v[l] = psi + turn;
+        next[3].v[l] = v + a.v[l] * dt;
+        next[4].v[l] = (f - y) + v * sin(epsi) * dt;
+        next[5].v[l] = (psi - atan(df)) + turn;
+
+        A[0 * 6 + 0].v[l] = 1;
+        A[0 * 6 + 2].v[l] = -v * sin_psi * dt;
+        A[0 * 6 + 3].v[l] = cos_psi * dt;
+        A[1 * 6 + 1].v[l] = 1;
+        A[1 * 6 + 2].v[l] = v * cos_psi * dt;
+        A[1 * 6 + 3].v[l] = sin_psi * dt;
+        A[2 * 6 + 2].v[l] = 1;
+        A[2 * 6 + 3].v[l] = delta.v[l] / Lf * dt;
+        A[3 * 6 + 3].v[l] = 1;
+        A[4 * 6 + 0].v[l] = df;
+        A[4 * 6 + 1].v[l] = -1;
+        A[4 * 6 + 3].v[l] = sin(epsi) * dt;
+        A[4 * 6 + 5].v[l] = v * cos(epsi) * dt;
+        A[5 * 6 + 0].v[l] = -ddf / (1 + df * df);
+        A[5 * 6 + 2].v[l] = 1;
+        A[5 * 6 + 3].v[l] = delta.v[l] / Lf * dt;
+
+        B[2 * 2 + 0].v[l] = v / Lf * dt;
+        B[3 * 2 + 1].v[l] = dt;
+        B[5 * 2 + 0].v[l] = v / Lf * dt;
+    }
+}
+
+// Adds weight * (u_i + x_i - u_j - x_j)**2 of the deviations x from the nominal actuations u to the QP
+static void AddDiffCost(LaneArray &H, LaneArray &g, const LaneArray &u, int n, int i, int j, double weight)
+{
+    for(int l = 0; l < K_BATCH_LANES; l++)
+    {
+        double diff = u[i].v[l] - u[j].v[l];
+        H[i * n + i].v[l] += 2 * weight;
+        H[j * n + j].v[l] += 2 * weight;
+        H[i * n + j].v[l] -= 2 * weight;
+        H[j * n + i].v[l] -= 2 * weight;
+        g[i].v[l] += 2 * weight * diff;
+        g[j].v[l] -= 2 * weight * diff;
+    }
+}
+
+vector<MPCSolution> BatchSolver::Solve(const vector<BatchProblem> &problems)
+{
+    vector<MPCSolution> solutions(problems.size());
+
+    // the lanes of a group share the horizon, so the problems are grouped by the number of points
+    map<int, vector<size_t>> by_points;
+    for(size_t i = 0; i < problems.size(); i++)
+    {
+        if(problems[i].points_num >= 2)
+        {
+            by_points[problems[i].points_num].push_back(i);
+        }
+    }
+
+    for(auto &same_points : by_points)
+    {
+        const vector<size_t> &indices = same_points.second;
+        for(size_t first = 0; first < indices.size(); first += K_BATCH_LANES)
+        {
+            size_t last = min(indices.size(), first + K_BATCH_LANES);
+            vector<size_t> group(indices.begin() + first, indices.begin() + last);
+            SolveGroup(problems, group, same_points.first, solutions);
+        }
+    }
+    return solutions;
+}
+
+void BatchSolver::SolveGroup(const vector<BatchProblem> &problems, const vector<size_t> &group, int points_num,
+                             vector<MPCSolution> &solutions)
+{
+    // actuations are [delta0, ..., delta(M-1), a0, ..., a(M-1)] as in LtvMpc
+    int M = points_num - 1;
+    int n = 2 * M;
+    Config config = Config::GetConfig();
+    vector<double> stage_dt = config.GetStageDt(M);
+
+    // 1. Transpose the problems into the lanes, the unused lanes repeat the first problem
+    Lanes state[6];
+    Lanes coeffs[4];
+    for(int l = 0; l < K_BATCH_LANES; l++)
+    {
+        const BatchProblem &problem = problems[group[l < (int)group.size() ? l : 0]];
+        for(int i = 0; i < 6; i++)
+        {
+            state[i].v[l] = problem.state[i];
+        }
+        for(int i = 0; i < 4; i++)
+        {
+            coeffs[i].v[l] = i < problem.coeffs.size() ? problem.coeffs[i] : 0;
+        }
+    }
+
+    LaneArray u(n, Lanes());
+    LaneArray H(n * n);
+    LaneArray g(n);
+    LaneArray lower(n);
+    LaneArray upper(n);
+    LaneArray penalty(n);
+    LaneArray x(n);
+    LaneArray z(n);
+    LaneArray dual(n);
+    LaneArray S(6 * n);
+    LaneArray states(6 * (M + 1));
+    Lanes A[36];
+    Lanes B[12];
+
+    // largest change of the projected actuations in the last ADMM iteration
+    Lanes change = Lanes();
+
+    // weights and references of the state costs: cte, epsi and velocity
+    const int cost_rows[3] = {4, 5, 3};
+    const double cost_weights[3] = {config.cte_w, config.epsi_w, config.velocity_diff_w};
+    const double cost_refs[3] = {0, 0, config.target_v};
+
+    vector<int> active;
+    for(int k = 0; k < linearizations; k++)
+    {
+        fill(H.begin(), H.end(), Lanes());
+        fill(g.begin(), g.end(), Lanes());
+        fill(S.begin(), S.end(), Lanes());
+
+        // 2. Roll out the nominal trajectory and condense the linearized model as LtvMpc does.
+        // Only the columns of the actuations applied so far are not zero, the Hessian is accumulated above the diagonal.
+        copy(state, state + 6, states.begin());
+        active.clear();
+        for(int t = 0; t < M; t++)
+        {
+            StepLanes(&states[6 * t], u[t], u[M + t], coeffs, stage_dt[t], &states[6 * (t + 1)], A, B);
+            active.push_back(t);
+            active.push_back(M + t);
+
+            // sensitivities S = A S + [B], A has the sparsity of the model so the rows are updated in place
+            for(int c : active)
+            {
+                Lanes &s0 = S[0 * n + c], &s1 = S[1 * n + c], &s2 = S[2 * n + c];
+                Lanes &s3 = S[3 * n + c], &s4 = S[4 * n + c], &s5 = S[5 * n + c];
+                for(int l = 0; l < K_BATCH_LANES; l++)
+                {
+                    double x0 = s0.v[l], x1 = s1.v[l], x2 = s2.v[l], x3 = s3.v[l], x5 = s5.v[l];
+                    s0.v[l] = x0 + A[0 * 6 + 2].v[l] * x2 + A[0 * 6 + 3].v[l] * x3;
+                    s1.v[l] = x1 + A[1 * 6 + 2].v[l] * x2 + A[1 * 6 + 3].v[l] * x3;
+                    s2.v[l] = x2 + A[2 * 6 + 3].v[l] * x3;
+                    s4.v[l] = A[4 * 6 + 0].v[l] * x0 - x1 + A[4 * 6 + 3].v[l] * x3 + A[4 * 6 + 5].v[l] * x5;
+                    s5.v[l] = A[5 * 6 + 0].v[l] * x0 + x2 + A[5 * 6 + 3].v[l] * x3;
+                }
+            }
+            for(int r = 0; r < 6; r++)
+            {
+                for(int l = 0; l < K_BATCH_LANES; l++)
+                {
+                    S[r * n + t].v[l] += B[r * 2].v[l];
+                    S[r * n + M + t].v[l] += B[r * 2 + 1].v[l];
+                }
+            }
+
+            // the three state costs are added in one pass over the Hessian
+            Lanes residual[3];
+            for(int cost = 0; cost < 3; cost++)
+            {
+                for(int l = 0; l < K_BATCH_LANES; l++)
+                {
+                    residual[cost].v[l] = states[6 * (t + 1) + cost_rows[cost]].v[l] - cost_refs[cost];
+                }
+            }
+            const Lanes *cte_row = &S[4 * n];
+            const Lanes *epsi_row = &S[5 * n];
+            const Lanes *v_row = &S[3 * n];
+            double w_cte = 2 * cost_weights[0], w_epsi = 2 * cost_weights[1], w_v = 2 * cost_weights[2];
+            for(int i : active)
+            {
+                Lanes weighted[3];
+                for(int l = 0; l < K_BATCH_LANES; l++)
+                {
+                    weighted[0].v[l] = w_cte * cte_row[i].v[l];
+                    weighted[1].v[l] = w_epsi * epsi_row[i].v[l];
+                    weighted[2].v[l] = w_v * v_row[i].v[l];
+                    g[i].v[l] += weighted[0].v[l] * residual[0].v[l] + weighted[1].v[l] * residual[1].v[l] +
+                                 weighted[2].v[l] * residual[2].v[l];
+                }
+                for(int j : active)
+                {
+                    if(j < i)
+                    {
+                        continue;
+                    }
+                    Lanes &h = H[i * n + j];
+                    for(int l = 0; l < K_BATCH_LANES; l++)
+                    {
+                        h.v[l] += weighted[0].v[l] * cte_row[j].v[l] + weighted[1].v[l] * epsi_row[j].v[l] +
+                                  weighted[2].v[l] * v_row[j].v[l];
+                    }
+                }
+            }
+        }
+        for(int i = 0; i < n; i++)
+        {
+            for(int j = 0; j < i; j++)
+            {
+                H[i * n + j] = H[j * n + i];
+            }
+        }
+
+        // 3. Actuator magnitude and smoothness costs, limits relative to the nominal actuations
+        for(int i = 0; i < M; i++)
+        {
+            for(int l = 0; l < K_BATCH_LANES; l++)
+            {
+                H[i * n + i].v[l] += 2 * config.delta_w;
+                g[i].v[l] += 2 * config.delta_w * u[i].v[l];
+                H[(M + i) * n + M + i].v[l] += 2 * config.a_w;
+                g[M + i].v[l] += 2 * config.a_w * u[M + i].v[l];
+
+                lower[i].v[l] = -K_MAX_DELTA - u[i].v[l];
+                upper[i].v[l] = K_MAX_DELTA - u[i].v[l];
+                lower[M + i].v[l] = -K_MAX_ACCELERATION - u[M + i].v[l];
+                upper[M + i].v[l] = K_MAX_ACCELERATION - u[M + i].v[l];
+            }
+        }
+        for(int i = 0; i + 1 < M; i++)
+        {
+            AddDiffCost(H, g, u, n, i, i + 1, config.delta_diff_w);
+            AddDiffCost(H, g, u, n, M + i, M + i + 1, config.a_diff_w);
+        }
+
+        // 4. Cholesky factorization of H + diag(penalty) in place, the lower triangle keeps the factor
+        for(int i = 0; i < n; i++)
+        {
+            for(int l = 0; l < K_BATCH_LANES; l++)
+            {
+                penalty[i].v[l] = K_ADMM_SCALE * H[i * n + i].v[l];
+                H[i * n + i].v[l] += penalty[i].v[l];
+            }
+        }
+        for(int j = 0; j < n; j++)
+        {
+            Lanes &diagonal = H[j * n + j];
+            for(int q = 0; q < j; q++)
+            {
+                const Lanes &h_jq = H[j * n + q];
+                for(int l = 0; l < K_BATCH_LANES; l++)
+                {
+                    diagonal.v[l] -= h_jq.v[l] * h_jq.v[l];
+                }
+            }
+            for(int l = 0; l < K_BATCH_LANES; l++)
+            {
+                diagonal.v[l] = sqrt(diagonal.v[l]);
+            }
+            for(int i = j + 1; i < n; i++)
+            {
+                Lanes &h_ij = H[i * n + j];
+                for(int q = 0; q < j; q++)
+                {
+                    const Lanes &h_iq = H[i * n + q];
+                    const Lanes &h_jq = H[j * n + q];
+                    for(int l = 0; l < K_BATCH_LANES; l++)
+                    {
+                        h_ij.v[l] -= h_iq.v[l] * h_jq.v[l];
+                    }
+                }
+                for(int l = 0; l < K_BATCH_LANES; l++)
+                {
+                    h_ij.v[l] /= diagonal.v[l];
+                }
+            }
+        }
+
+        // 5. ADMM for the box constraints: x minimizes the QP with the penalty towards z - dual,
+        // z is x + dual projected onto the limits, so it always satisfies them
+        for(int i = 0; i < n; i++)
+        {
+            for(int l = 0; l < K_BATCH_LANES; l++)
+            {
+                z[i].v[l] = max(lower[i].v[l], min(0., upper[i].v[l]));
+                dual[i].v[l] = 0;
+            }
+        }
+        for(int iteration = 0; iteration < qp_iterations; iteration++)
+        {
+            change = Lanes();
+
+            // forward substitution
+            for(int i = 0; i < n; i++)
+            {
+                Lanes value;
+                for(int l = 0; l < K_BATCH_LANES; l++)
+                {
+                    value.v[l] = penalty[i].v[l] * (z[i].v[l] - dual[i].v[l]) - g[i].v[l];
+                }
+                for(int q = 0; q < i; q++)
+                {
+                    const Lanes &h_iq = H[i * n + q];
+                    for(int l = 0; l < K_BATCH_LANES; l++)
+                    {
+                        value.v[l] -= h_iq.v[l] * x[q].v[l];
+                    }
+                }
+                for(int l = 0; l < K_BATCH_LANES; l++)
+                {
+                    x[i].v[l] = value.v[l] / H[i * n + i].v[l];
+                }
+            }
+
+            // back substitution
+            for(int i = n - 1; i >= 0; i--)
+            {
+                Lanes value = x[i];
+                for(int q = i + 1; q < n; q++)
+                {
+                    const Lanes &h_qi = H[q * n + i];
+                    for(int l = 0; l < K_BATCH_LANES; l++)
+                    {
+                        value.v[l] -= h_qi.v[l] * x[q].v[l];
+                    }
+                }
+                for(int l = 0; l < K_BATCH_LANES; l++)
+                {
+                    x[i].v[l] = value.v[l] / H[i * n + i].v[l];
+                }
+            }
+
+            for(int i = 0; i < n; i++)
+            {
+                for(int l = 0; l < K_BATCH_LANES; l++)
+                {
+                    double projected = max(lower[i].v[l], min(x[i].v[l] + dual[i].v[l], upper[i].v[l]));
+                    change.v[l] = max(change.v[l], fabs(projected - z[i].v[l]));
+                    z[i].v[l] = projected;
+                    dual[i].v[l] += x[i].v[l] - z[i].v[l];
+                }
+            }
+        }
+
+        // the projected actuations are the next nominal ones
+        for(int i = 0; i < n; i++)
+        {
+            for(int l = 0; l < K_BATCH_LANES; l++)
+            {
+                u[i].v[l] += z[i].v[l];
+            }
+        }
+    }
+
+    // 6. Roll out the trajectories with the found actuations and transpose the lanes back into the solutions
+    copy(state, state + 6, states.begin());
+    for(int t = 0; t < M; t++)
+    {
+        StepLanes(&states[6 * t], u[t], u[M + t], coeffs, stage_dt[t], &states[6 * (t + 1)], A, B);
+    }
+    for(size_t l = 0; l < group.size(); l++)
+    {
+        MPCSolution &sl = solutions[group[l]];
+        sl.ok = change.v[l] < K_ADMM_TOLERANCE;
+        sl.feasible = true;
+        sl.iterations = linearizations * qp_iterations;
+        sl.dt_vals = stage_dt;
+        for(int t = 0; t < M; t++)
+        {
+            sl.delta_vals.push_back(u[t].v[l]);
+            sl.a_vals.push_back(u[M + t].v[l]);
+            sl.x_vals.push_back(states[6 * (t + 1)].v[l]);
+            sl.y_vals.push_back(states[6 * (t + 1) + 1].v[l]);
+        }
+        sl.delta = sl.delta_vals[0];
+        sl.acceleration = sl.a_vals[0];
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef MPC_BATCH_SOLVER_H
+#define MPC_BATCH_SOLVER_H
+
+#include <vector>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+
+using namespace std;
+
+// Number of the problems solved together, one per SIMD lane
+const int K_BATCH_LANES = 8;
+
+// Problem of the polynomial formulation: the state [x, y, psi, v, cte, epsi], the coefficients of the fitted cubic
+// polynomial and the number of points of the horizon
+class BatchProblem
+{
+    public:
+        Eigen::VectorXd state;
+        Eigen::VectorXd coeffs;
+        int points_num = 0;
+};
+
+// Solves many independent problems of the polynomial formulation together (offline evaluation, tables, studies).
+// It is the linear time-varying QP of LtvMpc with a fixed amount of work per problem. Problems with the same number
+// of points are grouped by K_BATCH_LANES and every kernel runs over the group in the structure-of-arrays layout:
+// the model step with its Jacobians, condensing, the Cholesky factorization and the QP iterations keep the problems
+// in the innermost loops, so the compiler vectorizes them. Nothing branches on the data: the actuator limits are
+// handled by a fixed number of ADMM iterations instead of the active set search of BoxQP.
+class BatchSolver
+{
+    public:
+        // Solves the problems with the current config, the solutions are in the order of the problems.
+        // Problems with less than 2 points get empty solutions.
+        vector<MPCSolution> Solve(const vector<BatchProblem> &problems);
+
+        // number of linearizations and ADMM iterations of every QP
+        int linearizations = 2;
+        int qp_iterations = 25;
+
+    private:
+        // Solves up to K_BATCH_LANES problems with the same number of points, the unused lanes repeat the first one
+        void SolveGroup(const vector<BatchProblem> &problems, const vector<size_t> &group, int points_num,
+                        vector<MPCSolution> &solutions);
+};
+
+#endif //MPC_BATCH_SOLVER_H
@@ -0,0 +1,403 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "batch_solver.h"
+#include "config.h"
+#include "metrics.h"
+#include "processor.h"
+#include "track_map.h"
+#include "utils.h"
+
+// Compares solve time of the problem formulations on the same set of car states.
+// Car states are sampled along the track map with random offsets, heading errors and speeds.
+//
+// Usage: ./mpc_benchmark [track csv] [preset: 50|60|70] [samples number] [scaling]
+// With "scaling" only the parallel-in-time solver is run: wall time by the horizon length and the number of threads.
+
+Config Config::Instance = Config60();
+
+Metrics Metrics::Instance;
+
+// Car's state in global coordinates
+struct Sample
+{
+    double px;
+    double py;
+    double psi;
+    double v;
+};
+
+// Solve time statistics of one formulation
+struct Stats
+{
+    vector<double> times_ms;
+    int failed = 0;
+    double abs_delta_sum = 0;
+    double iterations_sum = 0;
+
+    // optimizer runs stopped at the deadline and how many of them used the final point or the best iterate
+    uint64_t deadline_stops = 0;
+    uint64_t final_points = 0;
+    uint64_t best_iterates = 0;
+
+    // first actuations of every sample, NaN if there is no feasible solution
+    vector<double> deltas;
+    vector<double> accelerations;
+
+    double MeanMs() const
+    {
+        double sum = 0;
+        for(double t : times_ms)
+        {
+            sum += t;
+        }
+        return times_ms.empty() ? 0 : sum / times_ms.size();
+    }
+
+    double MeanIterations() const
+    {
+        return times_ms.empty() ? 0 : iterations_sum / times_ms.size();
+    }
+
+    // Ratios of the mean solve time and iterations to the ones of the reference formulation
+    // and the mean difference of the first actuations from its ones on the samples both of them solved
+    void PrintDifference(const Stats &reference) const
+    {
+        double delta_sum = 0;
+        double a_sum = 0;
+        int count = 0;
+        for(size_t i = 0; i < deltas.size() && i < reference.deltas.size(); i++)
+        {
+            if(!std::isnan(deltas[i]) && !std::isnan(reference.deltas[i]))
+            {
+                delta_sum += fabs(deltas[i] - reference.deltas[i]);
+                a_sum += fabs(accelerations[i] - reference.accelerations[i]);
+                count++;
+            }
+        }
+        cout << " vs polynomial: time x" << (reference.MeanMs() > 0 ? MeanMs() / reference.MeanMs() : 0)
+             << " iterations x"
+             << (reference.MeanIterations() > 0 ? MeanIterations() / reference.MeanIterations() : 0)
+             << " mean |delta diff| " << (count > 0 ? delta_sum / count : 0)
+             << " mean |a diff| " << (count > 0 ? a_sum / count : 0);
+    }
+
+    void Print(const string &name, const Stats *reference)
+    {
+        sort(times_ms.begin(), times_ms.end());
+        size_t n = times_ms.size();
+        cout << name
+             << " mean " << MeanMs() << " ms"
+             << " p50 " << times_ms[n / 2] << " ms"
+             << " p99 " << times_ms[min(n - 1, n * 99 / 100)] << " ms"
+             << " failed " << failed << "/" << n
+             << " iterations " << MeanIterations()
+             << " mean |delta| " << abs_delta_sum / n
+             << " deadline stops " << deadline_stops << " (final point " << final_points
+             << ", best iterate " << best_iterates << ")";
+        if(reference != nullptr)
+        {
+            PrintDifference(*reference);
+        }
+        cout << endl;
+    }
+};
+
+// Maximum lateral offset, m, and heading error, rad, of the sampled states and of the hard ones
+const double K_OFFSET = 1;
+const double K_HEADING_ERROR = 0.1;
+const double K_HARD_OFFSET = 2.5;
+const double K_HARD_HEADING_ERROR = 0.4;
+
+// Solve deadline of the "deadline" row, most of the solves are stopped before they converge
+const double K_SHORT_DEADLINE = 0.002;
+
+// Samples car states along the track with random offsets, heading errors and speeds
+static vector<Sample> SampleStates(const TrackMap &track_map, int samples_num, double max_offset,
+                                   double max_heading_error, mt19937 &generator)
+{
+    uniform_real_distribution<double> s_dist(0, track_map.Length());
+    uniform_real_distribution<double> offset_dist(-max_offset, max_offset);
+    uniform_real_distribution<double> heading_dist(-max_heading_error, max_heading_error);
+    uniform_real_distribution<double> speed_dist(0.5, 1.0);
+
+    Config config = Config::GetConfig();
+    vector<Sample> samples;
+    for(int i = 0; i < samples_num; i++)
+    {
+        TrackPoint p = track_map.GetPoint(s_dist(generator));
+        double offset = offset_dist(generator);
+        Sample sample;
+        sample.px = p.x - offset * sin(p.heading);
+        sample.py = p.y + offset * cos(p.heading);
+        sample.psi = p.heading + heading_dist(generator);
+        sample.v = config.target_v * speed_dist(generator);
+        samples.push_back(sample);
+    }
+    return samples;
+}
+
+// Deadline for the optimizer started now
+static chrono::steady_clock::time_point GetDeadline()
+{
+    auto timeout = chrono::duration<double>(Config::GetConfig().solve_deadline);
+    return chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(timeout);
+}
+
+typedef MPCSolution (*SolveFunction)(Processor &processor, const Sample &sample);
+
+// Fills the waypoints of the track map ahead of the sample in car's coordinates
+static void GetCarWaypoints(Processor &processor, const Sample &sample, vector<double> &pts_x, vector<double> &pts_y,
+                            Eigen::VectorXd &xs, Eigen::VectorXd &ys)
+{
+    processor.GetTrackWaypoints(sample.px, sample.py, pts_x, pts_y);
+    xs.resize(pts_x.size());
+    ys.resize(pts_y.size());
+    for(size_t i = 0; i < pts_x.size(); i++)
+    {
+        double new_x = pts_x[i] - sample.px;
+        double new_y = pts_y[i] - sample.py;
+        xs[i] = new_x * cos(sample.psi) + new_y * sin(sample.psi);
+        ys[i] = -new_x * sin(sample.psi) + new_y * cos(sample.psi);
+    }
+}
+
+// Solves the polynomial formulation the same way Processor::Process does it
+static MPCSolution SolvePolynomial(Processor &processor, const Sample &sample)
+{
+    Config config = Config::GetConfig();
+    vector<double> pts_x, pts_y;
+    Eigen::VectorXd xs, ys;
+    GetCarWaypoints(processor, sample, pts_x, pts_y, xs, ys);
+
+    int points_num = processor.CalcPointsNum(pts_x, pts_y, sample.v, config.GetStageDt(config.max_points_num),
+                                             config.max_points_num);
+    return processor.SolvePolynomial(xs, ys, sample.v, points_num, GetDeadline());
+}
+
+// Solves the candidates of the polynomial formulation the same way Processor::Process does it with multi-start
+static MPCSolution SolveMultiStart(Processor &processor, const Sample &sample)
+{
+    Config config = Config::GetConfig();
+    vector<double> pts_x, pts_y;
+    Eigen::VectorXd xs, ys;
+    GetCarWaypoints(processor, sample, pts_x, pts_y, xs, ys);
+
+    int points_num = processor.CalcPointsNum(pts_x, pts_y, sample.v, config.GetStageDt(config.max_points_num),
+                                             config.max_points_num);
+    return processor.SolveMultiStart(xs, ys, sample.v, points_num, GetDeadline(), vector<double>(),
+                                     vector<double>());
+}
+
+static MPCSolution SolveFrenet(Processor &processor, const Sample &sample)
+{
+    FrenetProblem problem = processor.StateFrenet(sample.px, sample.py, sample.psi, sample.v,
+                                                  Config::GetConfig().max_points_num);
+    return processor.SolveFrenet(problem, GetDeadline());
+}
+
+// Solves the samples and prints the statistics, compared with the reference ones if it is set
+static Stats Run(const string &name, Processor &processor, const vector<Sample> &samples, SolveFunction solve,
+                 const Stats *reference = nullptr)
+{
+    Stats stats;
+    uint64_t deadline_stops = Metrics::Instance.deadline_stops;
+    uint64_t final_points = Metrics::Instance.fallback_final_point;
+    uint64_t best_iterates = Metrics::Instance.fallback_best_iterate;
+    for(const Sample &sample : samples)
+    {
+        auto start = chrono::steady_clock::now();
+        MPCSolution solution = solve(processor, sample);
+        auto end = chrono::steady_clock::now();
+
+        stats.times_ms.push_back(chrono::duration<double, milli>(end - start).count());
+        stats.failed += solution.ok ? 0 : 1;
+        stats.abs_delta_sum += fabs(solution.delta);
+        stats.iterations_sum += solution.iterations;
+        stats.deltas.push_back(solution.feasible ? solution.delta : NAN);
+        stats.accelerations.push_back(solution.feasible ? solution.acceleration : NAN);
+    }
+    stats.deadline_stops = Metrics::Instance.deadline_stops - deadline_stops;
+    stats.final_points = Metrics::Instance.fallback_final_point - final_points;
+    stats.best_iterates = Metrics::Instance.fallback_best_iterate - best_iterates;
+    stats.Print(name, reference);
+    return stats;
+}
+
+// Solves the samples with the parallel-in-time solver for long horizons on 1, 2, 4 and 8 threads.
+// One thread solves the segments on the calling thread, so it is the same algorithm without any synchronization.
+static void RunScaling(Processor &processor, const vector<Sample> &samples)
+{
+    const int horizons[] = {100, 200, 300, 500};
+    const int threads[] = {1, 2, 4, 8};
+    Config::Instance.solver = SolverType::ParallelLtv;
+
+    vector<unique_ptr<ThreadPool>> pools;
+    for(int threads_num : threads)
+    {
+        pools.emplace_back(threads_num > 1 ? new ThreadPool(threads_num, false) : nullptr);
+    }
+
+    cout << "parallel ltv: mean wall time, ms" << endl << "N    ";
+    for(int threads_num : threads)
+    {
+        cout << "\t" << threads_num << " thr.";
+    }
+    cout << "\tNewton iterations" << endl;
+
+    for(int points_num : horizons)
+    {
+        cout << points_num;
+        double iterations = 0;
+        for(size_t p = 0; p < pools.size(); p++)
+        {
+            double total_ms = 0;
+            for(const Sample &sample : samples)
+            {
+                vector<double> pts_x, pts_y;
+                Eigen::VectorXd xs, ys;
+                GetCarWaypoints(processor, sample, pts_x, pts_y, xs, ys);
+                Eigen::VectorXd coeffs = polyfit(xs, ys, 3);
+                Eigen::VectorXd state(6);
+                state << 0., 0., 0., sample.v, coeffs[0], atan(-coeffs[1]);
+
+                MPC mpc;
+                mpc.SetThreadPool(pools[p].get());
+                auto start = chrono::steady_clock::now();
+                MPCSolution solution = mpc.Solve(state, coeffs, points_num);
+                total_ms += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+                iterations += solution.iterations;
+            }
+            cout << "\t" << total_ms / samples.size();
+        }
+        cout << "\t" << iterations / (samples.size() * pools.size()) << endl;
+    }
+    Config::Instance.solver = SolverType::Nlp;
+}
+
+// Solves all the samples as one batch and compares its throughput with solving the same problems one by one
+static void RunBatch(Processor &processor, const vector<Sample> &samples)
+{
+    Config config = Config::GetConfig();
+    vector<BatchProblem> problems;
+    for(const Sample &sample : samples)
+    {
+        vector<double> pts_x, pts_y;
+        Eigen::VectorXd xs, ys;
+        GetCarWaypoints(processor, sample, pts_x, pts_y, xs, ys);
+
+        BatchProblem problem;
+        problem.coeffs = polyfit(xs, ys, 3);
+        problem.state = Eigen::VectorXd(6);
+        problem.state << 0., 0., 0., sample.v, problem.coeffs[0], atan(-problem.coeffs[1]);
+        problem.points_num = processor.CalcPointsNum(pts_x, pts_y, sample.v,
+                                                     config.GetStageDt(config.max_points_num), config.max_points_num);
+        problems.push_back(problem);
+    }
+
+    auto start = chrono::steady_clock::now();
+    for(const BatchProblem &problem : problems)
+    {
+        MPC mpc;
+        mpc.Solve(problem.state, problem.coeffs, problem.points_num);
+    }
+    double loop_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    start = chrono::steady_clock::now();
+    vector<MPCSolution> solutions = BatchSolver().Solve(problems);
+    double batch_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    int failed = 0;
+    for(const MPCSolution &solution : solutions)
+    {
+        failed += solution.ok ? 0 : 1;
+    }
+    cout << "batch      " << problems.size() * 1000. / batch_ms << " problems/s, one by one "
+         << problems.size() * 1000. / loop_ms << " problems/s, failed " << failed << "/" << problems.size() << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    string track_path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+    string preset = argc > 2 ? argv[2] : "60";
+    int samples_num = argc > 3 ? atoi(argv[3]) : 200;
+    bool scaling = argc > 4 && string(argv[4]) == "scaling";
+
+    if(preset == "50")
+    {
+        Config::Instance = Config50();
+    }
+    else if(preset == "70")
+    {
+        Config::Instance = Config70();
+    }
+
+    TrackMap track_map;
+    if(!track_map.LoadCsv(track_path))
+    {
+        cerr << "Failed to load track " << track_path << endl;
+        return -1;
+    }
+
+    Processor processor;
+    processor.SetTrackMap(&track_map);
+
+    // sample car states near the track, the hard ones are farther from the track and turned more,
+    // the single shooting problem is less robust to them, its states are rolled out from the initial one
+    mt19937 generator(42);
+    vector<Sample> samples = SampleStates(track_map, samples_num, K_OFFSET, K_HEADING_ERROR, generator);
+    vector<Sample> hard_samples = SampleStates(track_map, samples_num, K_HARD_OFFSET, K_HARD_HEADING_ERROR,
+                                               generator);
+    Config config = Config::GetConfig();
+
+    cout << "Preset " << preset << ", " << samples_num << " samples" << endl;
+    if(scaling)
+    {
+        RunScaling(processor, samples);
+        return 0;
+    }
+    // the other formulations are compared with the polynomial one solved with the exact Hessian
+    Stats polynomial = Run("polynomial", processor, samples, SolvePolynomial);
+    Config::Instance.shooting = Shooting::Single;
+    Run("single    ", processor, samples, SolvePolynomial, &polynomial);
+    Config::Instance.shooting = Shooting::Multiple;
+    Stats hard_polynomial = Run("hard poly.", processor, hard_samples, SolvePolynomial);
+    Config::Instance.shooting = Shooting::Single;
+    Run("hard sing.", processor, hard_samples, SolvePolynomial, &hard_polynomial);
+    Config::Instance.shooting = Shooting::Multiple;
+    Config::Instance.state_model = StateModel::Reduced;
+    Run("reduced   ", processor, samples, SolvePolynomial, &polynomial);
+    Config::Instance.state_model = StateModel::Full;
+    Config::Instance.input_parameterization = InputParameterization::MoveBlocking;
+    Run("blocking  ", processor, samples, SolvePolynomial, &polynomial);
+    Config::Instance.input_parameterization = InputParameterization::BSpline;
+    Run("bspline   ", processor, samples, SolvePolynomial, &polynomial);
+    Config::Instance.input_parameterization = InputParameterization::Free;
+    Config::Instance.hessian = HessianType::GaussNewton;
+    Run("gauss-n.  ", processor, samples, SolvePolynomial, &polynomial);
+    Config::Instance.hessian = HessianType::Exact;
+    Config::Instance.solver = SolverType::LtvQp;
+    Run("ltv qp    ", processor, samples, SolvePolynomial, &polynomial);
+    Config::Instance.solver = SolverType::Nlp;
+    Config::Instance.solution_cache_size = 1024;
+    Run("cache     ", processor, samples, SolvePolynomial, &polynomial);
+    Config::Instance.solution_cache_size = 0;
+    // there are at most 5 candidates
+    Config::Instance.multi_start_threads = max(1, min((int)thread::hardware_concurrency(), 5));
+    Run("multi-st. ", processor, samples, SolveMultiStart, &polynomial);
+    Config::Instance.multi_start_threads = 0;
+    Run("frenet    ", processor, samples, SolveFrenet, &polynomial);
+    Config::Instance.solve_deadline = K_SHORT_DEADLINE;
+    Run("deadline  ", processor, samples, SolvePolynomial, &polynomial);
+    Config::Instance.solve_deadline = config.solve_deadline;
+    RunBatch(processor, samples);
+    Metrics::Instance.Print(cout);
+
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include "box_qp.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Eigen-3.3/Eigen/Cholesky"
+
+static double Objective(const QpMatrix &H, const QpVector &g, const QpVector &x)
+{
+    return 0.5 * x.dot(H * x) + g.dot(x);
+}
+
+bool BoxQP::Solve(const QpMatrix &H, const QpVector &g, const QpVector &lower, const QpVector &upper, QpVector &x)
+{
+    int n = (int)g.size();
+    x = x.cwiseMax(lower).cwiseMin(upper);
+
+    int free_vars[K_QP_MAX_VARS];
+    QpMatrix H_free;
+    QpVector gradient;
+    QpVector step_free;
+    QpVector step;
+    QpVector next_x;
+    Eigen::LDLT<QpMatrix> ldlt(K_QP_MAX_VARS);
+
+    for(iterations = 0; iterations < max_iterations; iterations++)
+    {
+        gradient = H * x + g;
+
+        // the variable is fixed if it is at the bound and the gradient pushes it outside
+        int free_num = 0;
+        double projected_gradient = 0;
+        for(int i = 0; i < n; i++)
+        {
+            bool at_lower = x[i] <= lower[i] + 1e-12 && gradient[i] > 0;
+            bool at_upper = x[i] >= upper[i] - 1e-12 && gradient[i] < 0;
+            if(!at_lower && !at_upper)
+            {
+                free_vars[free_num++] = i;
+                projected_gradient = std::max(projected_gradient, std::fabs(gradient[i]));
+            }
+        }
+        if(projected_gradient <= tolerance)
+        {
+            return true;
+        }
+
+        // Newton step for the free variables
+        H_free.resize(free_num, free_num);
+        step_free.resize(free_num);
+        for(int i = 0; i < free_num; i++)
+        {
+            for(int j = 0; j < free_num; j++)
+            {
+                H_free(i, j) = H(free_vars[i], free_vars[j]);
+            }
+            step_free[i] = -gradient[free_vars[i]];
+        }
+        ldlt.compute(H_free);
+        step_free = ldlt.solve(step_free);
+
+        step.setZero(n);
+        for(int i = 0; i < free_num; i++)
+        {
+            step[free_vars[i]] = step_free[i];
+        }
+
+        // backtrack along the projection of the step onto the box until the objective decreases enough
+        double objective = Objective(H, g, x);
+        double alpha = 1;
+        bool accepted = false;
+        for(int k = 0; k < 20 && !accepted; k++)
+        {
+            next_x = (x + alpha * step).cwiseMax(lower).cwiseMin(upper);
+            accepted = Objective(H, g, next_x) <= objective + 1e-4 * gradient.dot(next_x - x);
+            alpha *= 0.5;
+        }
+
+        // The projected Newton step isn't always a descent direction when the wrong variables are fixed,
+        // then a projected gradient step is taken. Its length is 1 / L with L >= the largest eigenvalue of H
+        // (the largest absolute row sum), so it decreases the objective enough without a line search.
+        if(!accepted)
+        {
+            double L = H.cwiseAbs().rowwise().sum().maxCoeff();
+            next_x = (x - gradient / L).cwiseMax(lower).cwiseMin(upper);
+        }
+
+        if((next_x - x).lpNorm<Eigen::Infinity>() < 1e-14)
+        {
+            return true;
+        }
+        x = next_x;
+    }
+
+    return false;
+}
@@ -0,0 +1,33 @@
+#ifndef MPC_BOX_QP_H
+#define MPC_BOX_QP_H
+
+#include "Eigen-3.3/Eigen/Core"
+
+// Maximum number of variables of the quadratic program. Matrices are stored in place for this size,
+// so solving doesn't allocate memory.
+const int K_QP_MAX_VARS = 64;
+
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, 0, K_QP_MAX_VARS, K_QP_MAX_VARS> QpMatrix;
+typedef Eigen::Matrix<double, Eigen::Dynamic, 1, 0, K_QP_MAX_VARS, 1> QpVector;
+
+// Solves a dense convex quadratic program with box constraints:
+// minimize 0.5 * x' * H * x + g' * x subject to lower <= x <= upper.
+// It is a projected Newton method: variables at the bounds that the gradient pushes outward are fixed,
+// the Newton step is taken for the rest of them and projected onto the box with a backtracking line search.
+// If no step along it decreases the objective enough, a projected gradient step is taken instead.
+// H must be positive definite.
+class BoxQP
+{
+    public:
+        // x is the initial guess, it is replaced with the solution.
+        // Returns true if the projected gradient is below the tolerance.
+        bool Solve(const QpMatrix &H, const QpVector &g, const QpVector &lower, const QpVector &upper, QpVector &x);
+
+        int max_iterations = 30;
+        double tolerance = 1e-8;
+
+        // iterations of the last Solve
+        int iterations = 0;
+};
+
+#endif //MPC_BOX_QP_H
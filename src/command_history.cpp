@@ -0,0 +1,50 @@
+#include "command_history.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "utils.h"
+
+// Longest integration step of the prediction, seconds
+const double K_PREDICTION_STEP = 0.005;
+
+void CommandHistory::Add(double time, double delta, double a)
+{
+    records[next] = {time, delta, a};
+    next = (next + 1) % K_COMMAND_HISTORY_SIZE;
+    count = min(count + 1, K_COMMAND_HISTORY_SIZE);
+}
+
+bool CommandHistory::Get(double time, double &delta, double &a) const
+{
+    // from the newest to the oldest
+    for(size_t k = 1; k <= count; k++)
+    {
+        const CommandRecord &record = records[(next + K_COMMAND_HISTORY_SIZE - k) % K_COMMAND_HISTORY_SIZE];
+        if(record.time <= time)
+        {
+            delta = record.delta;
+            a = record.a;
+            return true;
+        }
+    }
+    return false;
+}
+
+void CommandHistory::Predict(double from, double to, double delta, double a,
+                             double &px, double &py, double &psi, double &v) const
+{
+    double time = from;
+    while(time < to)
+    {
+        double step = min(K_PREDICTION_STEP, to - time);
+        double step_delta = delta, step_a = a;
+        Get(time, step_delta, step_a);
+
+        px += v * cos(psi) * step;
+        py += v * sin(psi) * step;
+        psi += v * step_delta / Lf * step;
+        v += step_a * step;
+        time += step;
+    }
+}
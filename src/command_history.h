@@ -0,0 +1,45 @@
+#ifndef MPC_COMMAND_HISTORY_H
+#define MPC_COMMAND_HISTORY_H
+
+#include <cstddef>
+
+using namespace std;
+
+// Number of the last commands kept, at 10 commands per second it is more than any delay
+const size_t K_COMMAND_HISTORY_SIZE = 64;
+
+// Command sent to the simulator: steering angle (rad, model sign) and acceleration (m/s^2)
+// applied from the time it was sent (seconds, see Processor::GetTimeS) until the next one
+struct CommandRecord
+{
+    double time;
+    double delta;
+    double a;
+};
+
+// Ring buffer of the last commands sent to the simulator.
+// The state given by the telemetry is predicted to the time the next command is applied by integrating
+// the model with the commands that are really applied in between, instead of assuming they don't change.
+class CommandHistory
+{
+    public:
+        // Adds the command sent at the given time, times must not decrease
+        void Add(double time, double delta, double a);
+
+        // Command applied at the given time. Returns false if it was sent before the oldest kept one.
+        bool Get(double time, double &delta, double &a) const;
+
+        // Integrates the kinematic model from time "from" to time "to" with the commands applied in between,
+        // delta and a are applied before the oldest kept command (the actuations reported by the telemetry).
+        void Predict(double from, double to, double delta, double a,
+                     double &px, double &py, double &psi, double &v) const;
+
+    private:
+        CommandRecord records[K_COMMAND_HISTORY_SIZE];
+
+        // number of the kept commands and the index of the next one
+        size_t count = 0;
+        size_t next = 0;
+};
+
+#endif //MPC_COMMAND_HISTORY_H
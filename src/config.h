@@ -1,8 +1,112 @@
 #ifndef MPC_CONFIG_H
 #define MPC_CONFIG_H
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #include "utils.h"
 
+// Formulation of the optimization problem
+enum class Formulation
+{
+    // cross track error is calculated against the polynomial fitted to the waypoints in car's coordinates
+    Polynomial,
+
+    // state is tracked in path coordinates along the precomputed track map (needs the track map)
+    Frenet
+};
+
+// How the dynamics are passed to the optimizer in the polynomial formulation
+enum class Shooting
+{
+    // states are optimized together with actuations and tied by the model equations as equality constraints
+    Multiple,
+
+    // only actuations are optimized, states are rolled out inside the cost
+    Single
+};
+
+// State of the model in the polynomial formulation solved with multiple shooting
+enum class StateModel
+{
+    // x, y, psi, v and the tracking errors cte and epsi with their own dynamics
+    Full,
+
+    // x, y, psi, v only, tracking errors are calculated from them in the cost
+    Reduced
+};
+
+// Method used to solve the polynomial formulation
+enum class SolverType
+{
+    // nonlinear problem solved by IPOPT
+    Nlp,
+
+    // model linearized along the previous plan and condensed into a dense QP over the actuations (see ltv_mpc.h),
+    // up to K_LTV_MAX_POINTS (33) points, longer horizons are solved as ParallelLtv
+    LtvQp,
+
+    // the same QP for long horizons: split into segments condensed on separate threads and coupled
+    // exactly through their boundaries (see parallel_ltv.h)
+    ParallelLtv,
+
+    // first actuations interpolated from the table computed offline (see explicit_table.h),
+    // IPOPT is used for the problems outside of its validated region
+    ExplicitTable
+};
+
+// Hessian of the Lagrangian used by IPOPT
+enum class HessianType
+{
+    // exact second derivatives of the cost and the constraints computed by CppAD
+    Exact,
+
+    // Gauss-Newton approximation from the Jacobian of the cost residuals (see gauss_newton.h).
+    // Experimental: its iterations and solve time have not been compared with Exact yet.
+    GaussNewton
+};
+
+// Linear solver used by IPOPT. Several IPOPT solves run at once (multi-start, background solves) only if it is
+// thread safe, otherwise they are serialized (see MPC::ConcurrentSolves).
+enum class LinearSolver
+{
+    // MUMPS built by install_ipopt.sh, its calls are serialized by IPOPT only since 3.14
+    Mumps,
+
+    // HSL solvers, thread safe, they need IPOPT built with the HSL sources (see README)
+    Ma27,
+    Ma57
+};
+
+// How the actuator sequence is passed to the optimizer (see input_basis.h)
+enum class InputParameterization
+{
+    // every actuation of the horizon is a separate variable
+    Free,
+
+    // actuations are held constant over blocks of steps (Config::move_blocks)
+    MoveBlocking,
+
+    // actuations follow a cubic B-spline with a few control points (Config::spline_control_points)
+    BSpline
+};
+
+enum class ControllerMode
+{
+    // the optimizer selected by Config::solver, with the fallbacks when it doesn't find a solution in time
+    Optimizer,
+
+    // pure pursuit on the fitted polynomial with PI speed control (see geometric_controller.h), no optimizer at all
+    Geometric
+};
+
+// Number of the config parameters the optimal actuations depend on (see Config::GetKey)
+const int K_CONFIG_KEY_SIZE = 11;
+
 //Contains presents for different maximum speeds.
 //Maximum is speed is reflected in class name e.g. Config60 (max 60 mph)
 
@@ -41,16 +145,260 @@ public:
     // Weight of sequentioal acceleration actions being different (not smooth)
     double a_diff_w;
 
+    // The time step grows along the horizon: step i is dt * dt_growth^i but not longer than max_dt,
+    // so the steps are fine near the car and coarse far from it. dt_growth = 1 keeps all the steps equal to dt.
+    double dt_growth = 1;
+    double max_dt = 1;
+
     // Maximum cpu time for optimizer. Not sure what it means or works at all.
     double max_cpu_time;
 
+    // Wall clock time in seconds after which the optimizer is stopped.
+    // If it doesn't find a solution in time, a fallback command is used.
+    double solve_deadline;
+
     // Maximum number of points in the predicted trajectory.
     int max_points_num;
 
+    // Length of the reference line in meters taken from the track map (if it is loaded)
+    double track_lookahead;
+
+    // Formulation of the optimization problem
+    Formulation formulation = Formulation::Polynomial;
+
+    // Method used to solve the polynomial formulation
+    SolverType solver = SolverType::Nlp;
+
+    // Hessian used by IPOPT
+    HessianType hessian = HessianType::Exact;
+
+    // Linear solver used by IPOPT
+    LinearSolver linear_solver = LinearSolver::Mumps;
+
+    // How the dynamics of the polynomial formulation are passed to the optimizer
+    Shooting shooting = Shooting::Multiple;
+
+    // State of the model used with multiple shooting
+    StateModel state_model = StateModel::Full;
+
+    // Parameterization of the actuator sequence
+    InputParameterization input_parameterization = InputParameterization::Free;
+
+    // Sizes of the move blocks in steps, the last one is extended to the end of the horizon
+    std::vector<int> move_blocks;
+
+    // Number of the B-spline control points
+    int spline_control_points = 6;
+
+    // Number of solutions kept as initial points for the optimizer (see solution_cache.h), 0 disables the cache
+    int solution_cache_size = 0;
+
+    // Maximum distance to a cached problem in the scaled features for its solution to be used
+    double solution_cache_distance = 1;
+
+    // If true the distilled policy (see mlp_policy.h) is the primary controller. Every policy_check_period seconds
+    // the optimizer solves the same problem, if their first actuations differ by more than the tolerances,
+    // the optimizer takes over for policy_takeover_time seconds and solves every message.
+    bool policy_primary = false;
+    double policy_check_period = 0.5;
+    double policy_delta_tolerance = 0.05;
+    double policy_a_tolerance = 1;
+    double policy_takeover_time = 2;
+
+    // Number of threads solving candidate problems concurrently: horizons a few points shorter and longer than
+    // the one found by Processor::CalcPointsNum and the neighbouring speed presets. The best feasible plan
+    // by the cost with this config's weights (see plan_cost.h) is used. 0 solves only one problem.
+    // It needs IPOPT solves to run concurrently (see linear_solver), otherwise only one problem is solved.
+    int multi_start_threads = 0;
+
+    // If true the optimizer runs on a background thread and telemetry is answered immediately
+    // with commands interpolated from the last plan, so the solve rate doesn't limit the command rate.
+    bool async_solve = false;
+
+    // Minimum time in seconds between optimizer starts when solving asynchronously, 0 solves every message
+    double solve_period = 0;
+
+    // If true the commands taken from the last plan are corrected by a tracking law (see tracking_controller.h):
+    // pure pursuit of the planned position tracking_lookahead_time seconds ahead and the planned velocity with
+    // tracking_velocity_gain (m/s^2 per m/s), on top of the planned actuations. With async_solve and a solve_period
+    // of a few messages the optimizer runs at a lower rate while every message still gets a feedback command.
+    bool tracking_law = false;
+    double tracking_lookahead_time = 0.5;
+    double tracking_velocity_gain = 0.5;
+
+    // If true the problem of the next telemetry message is solved before it arrives (see speculative_solver.h):
+    // after the command is sent the state at the time the next command is applied is predicted with it.
+    // The solution is used if the real state is within the tolerances (m, rad, m/s) of the predicted one.
+    // Applies to the polynomial formulation solved synchronously.
+    bool speculative_solve = false;
+    double speculative_position_tolerance = 0.3;
+    double speculative_heading_tolerance = 0.02;
+    double speculative_speed_tolerance = 0.5;
+
+    // If true the number of points of the polynomial formulation is limited by the solve time model
+    // (see solve_time_model.h): the largest one whose predicted p99 solve time fits into the time left until
+    // the deadline of the cycle is used, but not less than governor_min_points. The Frenet formulation is solved
+    // with the full max_points_num, its solves are not in the model.
+    bool solve_time_governor = false;
+    int governor_min_points = 5;
+
+    // Parallel-in-time solver (SolverType::ParallelLtv): steps per segment of the horizon (at most 28),
+    // threads condensing the segments and the limit of the Newton iterations of the QP per linearization.
+    // The threads don't use CppAD, so they don't count in its limit of threads.
+    int parallel_segment_steps = 25;
+    int parallel_threads = 4;
+    int parallel_iterations = 30;
+
+    // Controller of the session. The geometric one drives without any solves when the host can't afford them.
+    ControllerMode controller = ControllerMode::Optimizer;
+
+    // If true the geometric controller takes over by itself when the host is overloaded (see overload_governor.h):
+    // after overload_cycles consecutive synchronous solves which ran into the deadline. The optimizer is tried again
+    // every overload_probe_period seconds and gets the control back when its solve finishes in time.
+    bool overload_governor = false;
+    int overload_cycles = 3;
+    double overload_probe_period = 2;
+
+    // If true the tuning of this config is replaced every cycle by the speed preset (or a blend of two neighbouring ones)
+    // chosen by the measured speed and the curvature ahead (see preset_schedule.h).
+    // The car can step up to the next preset when it is within schedule_speed_margin (m/s) of its target,
+    // the curvature limits the speed by the lateral acceleration schedule_lateral_acceleration (m/s^2).
+    // Presets are blended within schedule_blend_width (m/s) around the middle between their target speeds,
+    // changes of the scheduling speed smaller than schedule_hysteresis (m/s) are ignored.
+    bool preset_schedule = false;
+    double schedule_speed_margin = 5;
+    double schedule_lateral_acceleration = 8;
+    double schedule_blend_width = 2;
+    double schedule_hysteresis = 0.5;
+
+    // Returns time steps of the horizon with the given number of steps
+    std::vector<double> GetStageDt(size_t steps_num) const
+    {
+        std::vector<double> stage_dt(steps_num);
+        double step = dt;
+        for(size_t i = 0; i < steps_num; i++)
+        {
+            stage_dt[i] = std::min(step, std::max(max_dt, dt));
+            step *= dt_growth;
+        }
+        return stage_dt;
+    }
+
+    // Fills the parameters the optimal actuations depend on,
+    // solutions computed offline are used only with the config they were computed for
+    void GetKey(double key[K_CONFIG_KEY_SIZE]) const
+    {
+        double parameters[K_CONFIG_KEY_SIZE] = {
+            dt, dt_growth, max_dt, target_v, cte_w, epsi_w, velocity_diff_w, delta_w, a_w, delta_diff_w, a_diff_w};
+        std::copy(parameters, parameters + K_CONFIG_KEY_SIZE, key);
+    }
+
+    // Returns true if the key was filled by GetKey of the same config
+    bool MatchesKey(const double key[K_CONFIG_KEY_SIZE]) const
+    {
+        double parameters[K_CONFIG_KEY_SIZE];
+        GetKey(parameters);
+        for(int i = 0; i < K_CONFIG_KEY_SIZE; i++)
+        {
+            if(std::fabs(parameters[i] - key[i]) > 1e-9 * std::max(1., std::fabs(parameters[i])))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Copies the settings of the solver method, not the tuning, so a preset can be solved the same way as this config
+    void CopySolverSettings(const Config &other)
+    {
+        formulation = other.formulation;
+        solver = other.solver;
+        hessian = other.hessian;
+        linear_solver = other.linear_solver;
+        shooting = other.shooting;
+        state_model = other.state_model;
+        input_parameterization = other.input_parameterization;
+        solution_cache_size = other.solution_cache_size;
+        solution_cache_distance = other.solution_cache_distance;
+        parallel_segment_steps = other.parallel_segment_steps;
+        parallel_threads = other.parallel_threads;
+        parallel_iterations = other.parallel_iterations;
+    }
+
+    // Copies the tuning set by the speed presets: the time grid, the horizon, the target and the weights
+    void CopyTuning(const Config &other)
+    {
+        dt = other.dt;
+        dt_growth = other.dt_growth;
+        max_dt = other.max_dt;
+        target_v = other.target_v;
+        cte_w = other.cte_w;
+        epsi_w = other.epsi_w;
+        velocity_diff_w = other.velocity_diff_w;
+        delta_w = other.delta_w;
+        a_w = other.a_w;
+        delta_diff_w = other.delta_diff_w;
+        a_diff_w = other.a_diff_w;
+        max_cpu_time = other.max_cpu_time;
+        solve_deadline = other.solve_deadline;
+        max_points_num = other.max_points_num;
+        track_lookahead = other.track_lookahead;
+        move_blocks = other.move_blocks;
+        spline_control_points = other.spline_control_points;
+    }
+
+    // Config of the current thread if it is set by ScopedConfig, nullptr otherwise
+    static const Config *&ThreadConfig()
+    {
+        static thread_local const Config *thread_config = nullptr;
+        return thread_config;
+    }
+
+    // The config returned by GetConfig, it is Instance until another config is published
+    static std::atomic<const Config *> &Published()
+    {
+        static std::atomic<const Config *> published{&Config::Instance};
+        return published;
+    }
+
+    // Replaces the config returned by GetConfig on all the threads without stopping them (read-copy-update):
+    // readers load the pointer and copy the config, the writer publishes a new copy with one atomic store.
+    // Readers can still be copying the old config, so published configs are never freed.
+    // Configs are reloaded rarely and are small, so it costs nothing.
+    static void Publish(const Config &config)
+    {
+        static std::mutex publish_mutex;
+        static std::vector<std::unique_ptr<Config>> published_configs;
+
+        std::lock_guard<std::mutex> lock(publish_mutex);
+        published_configs.emplace_back(new Config(config));
+        Published().store(published_configs.back().get());
+    }
+
     static Config GetConfig()
     {
-        return Config::Instance;
+        const Config *thread_config = ThreadConfig();
+        return thread_config != nullptr ? *thread_config : *Published().load();
+    }
+};
+
+// Makes Config::GetConfig return the given config on the current thread while the object exists,
+// so problems with different presets can be solved concurrently
+class ScopedConfig
+{
+public:
+    explicit ScopedConfig(const Config &config) : previous(Config::ThreadConfig())
+    {
+        Config::ThreadConfig() = &config;
+    }
+
+    ~ScopedConfig()
+    {
+        Config::ThreadConfig() = previous;
     }
+
+private:
+    const Config *previous;
 };
 
 class Config50 : public Config
@@ -68,7 +416,11 @@ public:
         delta_diff_w = 5000;
         a_diff_w = 5000;
         max_cpu_time = 0.05;
+        solve_deadline = 0.05;
         max_points_num = 30;
+        track_lookahead = 60;
+        move_blocks = {1, 1, 2, 2, 4, 4, 8};
+        spline_control_points = 8;
     }
 };
 
@@ -88,7 +440,11 @@ public:
         delta_diff_w = 7000;
         a_diff_w = 7000;
         max_cpu_time = 0.05;
+        solve_deadline = 0.05;
         max_points_num = 30;
+        track_lookahead = 60;
+        move_blocks = {1, 1, 2, 2, 4, 4, 8};
+        spline_control_points = 8;
     }
 };
 
@@ -107,9 +463,18 @@ public:
         delta_diff_w = 20000;
         a_diff_w = 7000;
         max_cpu_time = 0.5;
+        solve_deadline = 0.15;
         max_points_num = 9;
+        track_lookahead = 80;
+        move_blocks = {1, 1, 2, 4};
+        spline_control_points = 5;
     }
 };
 
+// All the speed presets ordered by the target velocity
+inline std::vector<Config> SpeedPresets()
+{
+    return {Config50(), Config60(), Config70()};
+}
 
 #endif //MPC_CONFIG_H
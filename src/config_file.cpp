@@ -0,0 +1,496 @@
+#include "config_file.h"
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <tuple>
+#include <utility>
+
+#include <sys/stat.h>
+
+#include "thread_pool.h"
+
+// CppAD threads of the controller besides its pools: the background solver, the speculative solver
+// and the solution cache rebuild (see Processor)
+const int K_CONTROLLER_CPPAD_THREADS = 3;
+
+static string Trim(const string &s)
+{
+    size_t first = s.find_first_not_of(" \t\r");
+    if(first == string::npos)
+    {
+        return "";
+    }
+    size_t last = s.find_last_not_of(" \t\r");
+    return s.substr(first, last - first + 1);
+}
+
+static bool ParseDouble(const string &value, double &result)
+{
+    istringstream stream(value);
+    stream >> result;
+    return !stream.fail() && stream.eof();
+}
+
+static bool ParseInt(const string &value, int &result)
+{
+    istringstream stream(value);
+    stream >> result;
+    return !stream.fail() && stream.eof();
+}
+
+static bool ParseBool(const string &value, bool &result)
+{
+    if(value == "true" || value == "1")
+    {
+        result = true;
+        return true;
+    }
+    if(value == "false" || value == "0")
+    {
+        result = false;
+        return true;
+    }
+    return false;
+}
+
+static bool ParseInts(const string &value, vector<int> &result)
+{
+    result.clear();
+    istringstream stream(value);
+    string item;
+    while(getline(stream, item, ','))
+    {
+        int number;
+        if(!ParseInt(Trim(item), number))
+        {
+            return false;
+        }
+        result.push_back(number);
+    }
+    return !result.empty();
+}
+
+// Parses the name of the enum value
+template <class Enum>
+static bool ParseEnum(const string &value, const map<string, Enum> &names, Enum &result)
+{
+    auto name = names.find(value);
+    if(name == names.end())
+    {
+        return false;
+    }
+    result = name->second;
+    return true;
+}
+
+// Returns the name of the enum value
+template <class Enum>
+static string EnumName(const map<string, Enum> &names, Enum value)
+{
+    for(auto &name : names)
+    {
+        if(name.second == value)
+        {
+            return name.first;
+        }
+    }
+    return "";
+}
+
+static const map<string, Formulation> K_FORMULATIONS = {
+    {"Polynomial", Formulation::Polynomial}, {"Frenet", Formulation::Frenet}};
+static const map<string, SolverType> K_SOLVERS = {
+    {"Nlp", SolverType::Nlp}, {"LtvQp", SolverType::LtvQp}, {"ParallelLtv", SolverType::ParallelLtv},
+    {"ExplicitTable", SolverType::ExplicitTable}};
+static const map<string, HessianType> K_HESSIANS = {
+    {"Exact", HessianType::Exact}, {"GaussNewton", HessianType::GaussNewton}};
+static const map<string, LinearSolver> K_LINEAR_SOLVERS = {
+    {"Mumps", LinearSolver::Mumps}, {"Ma27", LinearSolver::Ma27}, {"Ma57", LinearSolver::Ma57}};
+static const map<string, Shooting> K_SHOOTINGS = {
+    {"Multiple", Shooting::Multiple}, {"Single", Shooting::Single}};
+static const map<string, StateModel> K_STATE_MODELS = {
+    {"Full", StateModel::Full}, {"Reduced", StateModel::Reduced}};
+static const map<string, InputParameterization> K_INPUT_PARAMETERIZATIONS = {
+    {"Free", InputParameterization::Free}, {"MoveBlocking", InputParameterization::MoveBlocking},
+    {"BSpline", InputParameterization::BSpline}};
+static const map<string, ControllerMode> K_CONTROLLERS = {
+    {"Optimizer", ControllerMode::Optimizer}, {"Geometric", ControllerMode::Geometric}};
+
+// Fields of the config by their names
+static map<string, double *> DoubleFields(Config &config)
+{
+    return {
+        {"dt", &config.dt}, {"target_v", &config.target_v},
+        {"cte_w", &config.cte_w}, {"epsi_w", &config.epsi_w}, {"velocity_diff_w", &config.velocity_diff_w},
+        {"delta_w", &config.delta_w}, {"a_w", &config.a_w},
+        {"delta_diff_w", &config.delta_diff_w}, {"a_diff_w", &config.a_diff_w},
+        {"dt_growth", &config.dt_growth}, {"max_dt", &config.max_dt},
+        {"max_cpu_time", &config.max_cpu_time}, {"solve_deadline", &config.solve_deadline},
+        {"track_lookahead", &config.track_lookahead},
+        {"solution_cache_distance", &config.solution_cache_distance},
+        {"policy_check_period", &config.policy_check_period},
+        {"policy_delta_tolerance", &config.policy_delta_tolerance},
+        {"policy_a_tolerance", &config.policy_a_tolerance},
+        {"policy_takeover_time", &config.policy_takeover_time},
+        {"solve_period", &config.solve_period},
+        {"schedule_speed_margin", &config.schedule_speed_margin},
+        {"schedule_lateral_acceleration", &config.schedule_lateral_acceleration},
+        {"schedule_blend_width", &config.schedule_blend_width},
+        {"schedule_hysteresis", &config.schedule_hysteresis},
+        {"overload_probe_period", &config.overload_probe_period},
+        {"tracking_lookahead_time", &config.tracking_lookahead_time},
+        {"tracking_velocity_gain", &config.tracking_velocity_gain},
+        {"speculative_position_tolerance", &config.speculative_position_tolerance},
+        {"speculative_heading_tolerance", &config.speculative_heading_tolerance},
+        {"speculative_speed_tolerance", &config.speculative_speed_tolerance}};
+}
+
+static map<string, int *> IntFields(Config &config)
+{
+    return {
+        {"max_points_num", &config.max_points_num}, {"spline_control_points", &config.spline_control_points},
+        {"solution_cache_size", &config.solution_cache_size}, {"multi_start_threads", &config.multi_start_threads},
+        {"governor_min_points", &config.governor_min_points}, {"overload_cycles", &config.overload_cycles},
+        {"parallel_segment_steps", &config.parallel_segment_steps}, {"parallel_threads", &config.parallel_threads},
+        {"parallel_iterations", &config.parallel_iterations}};
+}
+
+static map<string, bool *> BoolFields(Config &config)
+{
+    return {
+        {"policy_primary", &config.policy_primary}, {"async_solve", &config.async_solve},
+        {"preset_schedule", &config.preset_schedule}, {"solve_time_governor", &config.solve_time_governor},
+        {"overload_governor", &config.overload_governor}, {"tracking_law", &config.tracking_law}, {"speculative_solve", &config.speculative_solve}};
+}
+
+// Checks the ranges of the fields. Returns false and the first field out of its range, NaN is out of every range.
+static bool CheckRanges(const Config &config, string &error)
+{
+    const pair<const char *, double> positive[] = {
+        {"dt", config.dt}, {"dt_growth", config.dt_growth}, {"max_dt", config.max_dt},
+        {"max_cpu_time", config.max_cpu_time}, {"solve_deadline", config.solve_deadline},
+        {"track_lookahead", config.track_lookahead}, {"tracking_lookahead_time", config.tracking_lookahead_time},
+        {"overload_probe_period", config.overload_probe_period},
+        {"schedule_lateral_acceleration", config.schedule_lateral_acceleration}};
+    const pair<const char *, double> non_negative[] = {
+        {"target_v", config.target_v}, {"cte_w", config.cte_w}, {"epsi_w", config.epsi_w},
+        {"velocity_diff_w", config.velocity_diff_w}, {"delta_w", config.delta_w}, {"a_w", config.a_w},
+        {"delta_diff_w", config.delta_diff_w}, {"a_diff_w", config.a_diff_w},
+        {"solution_cache_distance", config.solution_cache_distance},
+        {"policy_check_period", config.policy_check_period},
+        {"policy_delta_tolerance", config.policy_delta_tolerance},
+        {"policy_a_tolerance", config.policy_a_tolerance}, {"policy_takeover_time", config.policy_takeover_time},
+        {"solve_period", config.solve_period}, {"tracking_velocity_gain", config.tracking_velocity_gain},
+        {"speculative_position_tolerance", config.speculative_position_tolerance},
+        {"speculative_heading_tolerance", config.speculative_heading_tolerance},
+        {"speculative_speed_tolerance", config.speculative_speed_tolerance},
+        {"schedule_speed_margin", config.schedule_speed_margin},
+        {"schedule_blend_width", config.schedule_blend_width}, {"schedule_hysteresis", config.schedule_hysteresis}};
+    const tuple<const char *, int, int> minimums[] = {
+        make_tuple("max_points_num", config.max_points_num, 3),
+        make_tuple("spline_control_points", config.spline_control_points, 1),
+        make_tuple("solution_cache_size", config.solution_cache_size, 0),
+        make_tuple("multi_start_threads", config.multi_start_threads, 0),
+        make_tuple("governor_min_points", config.governor_min_points, 1),
+        make_tuple("overload_cycles", config.overload_cycles, 1),
+        make_tuple("parallel_segment_steps", config.parallel_segment_steps, 1),
+        make_tuple("parallel_threads", config.parallel_threads, 0),
+        make_tuple("parallel_iterations", config.parallel_iterations, 1)};
+
+    for(auto &field : positive)
+    {
+        if(!(field.second > 0))
+        {
+            error = string(field.first) + " must be positive";
+            return false;
+        }
+    }
+    for(auto &field : non_negative)
+    {
+        if(!(field.second >= 0))
+        {
+            error = string(field.first) + " must not be negative";
+            return false;
+        }
+    }
+    for(auto &field : minimums)
+    {
+        if(get<1>(field) < get<2>(field))
+        {
+            error = string(get<0>(field)) + " must be at least " + to_string(get<2>(field));
+            return false;
+        }
+    }
+    for(int block : config.move_blocks)
+    {
+        if(block < 1)
+        {
+            error = "move_blocks must be at least 1";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SetConfigValue(Config &config, const string &name, const string &value)
+{
+    map<string, double *> doubles = DoubleFields(config);
+    map<string, int *> ints = IntFields(config);
+    map<string, bool *> bools = BoolFields(config);
+
+    if(doubles.count(name))
+    {
+        return ParseDouble(value, *doubles[name]);
+    }
+    if(ints.count(name))
+    {
+        return ParseInt(value, *ints[name]);
+    }
+    if(bools.count(name))
+    {
+        return ParseBool(value, *bools[name]);
+    }
+    if(name == "move_blocks")
+    {
+        return ParseInts(value, config.move_blocks);
+    }
+    if(name == "formulation")
+    {
+        return ParseEnum(value, K_FORMULATIONS, config.formulation);
+    }
+    if(name == "solver")
+    {
+        return ParseEnum(value, K_SOLVERS, config.solver);
+    }
+    if(name == "hessian")
+    {
+        return ParseEnum(value, K_HESSIANS, config.hessian);
+    }
+    if(name == "linear_solver")
+    {
+        return ParseEnum(value, K_LINEAR_SOLVERS, config.linear_solver);
+    }
+    if(name == "shooting")
+    {
+        return ParseEnum(value, K_SHOOTINGS, config.shooting);
+    }
+    if(name == "state_model")
+    {
+        return ParseEnum(value, K_STATE_MODELS, config.state_model);
+    }
+    if(name == "input_parameterization")
+    {
+        return ParseEnum(value, K_INPUT_PARAMETERIZATIONS, config.input_parameterization);
+    }
+    if(name == "controller")
+    {
+        return ParseEnum(value, K_CONTROLLERS, config.controller);
+    }
+    return false;
+}
+
+bool WriteConfigFile(const string &path, const Config &config, const string &comment)
+{
+    ofstream file(path);
+    if(!file.is_open())
+    {
+        return false;
+    }
+
+    if(!comment.empty())
+    {
+        istringstream lines(comment);
+        string line;
+        while(getline(lines, line))
+        {
+            file << "# " << line << "\n";
+        }
+    }
+
+    // every field is written, so the preset the file is applied to doesn't matter
+    Config copy = config;
+    file.precision(12);
+    for(auto &field : DoubleFields(copy))
+    {
+        file << field.first << " = " << *field.second << "\n";
+    }
+    for(auto &field : IntFields(copy))
+    {
+        file << field.first << " = " << *field.second << "\n";
+    }
+    for(auto &field : BoolFields(copy))
+    {
+        file << field.first << " = " << (*field.second ? "true" : "false") << "\n";
+    }
+    file << "move_blocks = ";
+    for(size_t i = 0; i < config.move_blocks.size(); i++)
+    {
+        file << (i > 0 ? ", " : "") << config.move_blocks[i];
+    }
+    file << "\n";
+    file << "formulation = " << EnumName(K_FORMULATIONS, config.formulation) << "\n";
+    file << "solver = " << EnumName(K_SOLVERS, config.solver) << "\n";
+    file << "hessian = " << EnumName(K_HESSIANS, config.hessian) << "\n";
+    file << "linear_solver = " << EnumName(K_LINEAR_SOLVERS, config.linear_solver) << "\n";
+    file << "shooting = " << EnumName(K_SHOOTINGS, config.shooting) << "\n";
+    file << "state_model = " << EnumName(K_STATE_MODELS, config.state_model) << "\n";
+    file << "input_parameterization = " << EnumName(K_INPUT_PARAMETERIZATIONS, config.input_parameterization) << "\n";
+    file << "controller = " << EnumName(K_CONTROLLERS, config.controller) << "\n";
+    return file.good();
+}
+
+bool LoadConfigFile(const string &path, Config &config, string &error)
+{
+    ifstream file(path);
+    if(!file.is_open())
+    {
+        error = "can't open " + path;
+        return false;
+    }
+
+    // 1. Read name and value pairs
+    vector<pair<string, string>> values;
+    vector<int> line_numbers;
+    string preset = "60";
+    string line;
+    for(int line_number = 1; getline(file, line); line_number++)
+    {
+        line = Trim(line.substr(0, line.find('#')));
+        if(line.empty())
+        {
+            continue;
+        }
+
+        size_t separator = line.find('=');
+        if(separator == string::npos)
+        {
+            error = path + ":" + to_string(line_number) + ": expected name = value";
+            return false;
+        }
+        string name = Trim(line.substr(0, separator));
+        string value = Trim(line.substr(separator + 1));
+        if(name == "preset")
+        {
+            preset = value;
+            continue;
+        }
+        values.push_back(make_pair(name, value));
+        line_numbers.push_back(line_number);
+    }
+
+    // 2. Apply them to the preset
+    Config loaded;
+    if(preset == "50")
+    {
+        loaded = Config50();
+    }
+    else if(preset == "60")
+    {
+        loaded = Config60();
+    }
+    else if(preset == "70")
+    {
+        loaded = Config70();
+    }
+    else
+    {
+        error = path + ": unknown preset " + preset;
+        return false;
+    }
+
+    for(size_t i = 0; i < values.size(); i++)
+    {
+        if(!SetConfigValue(loaded, values[i].first, values[i].second))
+        {
+            error = path + ":" + to_string(line_numbers[i]) + ": wrong " + values[i].first + " = " + values[i].second;
+            return false;
+        }
+    }
+
+    // 3. Check the values, the config is not changed if any of them is wrong
+    string range_error;
+    if(!CheckRanges(loaded, range_error))
+    {
+        error = path + ": " + range_error;
+        return false;
+    }
+
+    // every thread solving concurrently needs its own CppAD thread number (see CppADThread),
+    // the ParallelLtv segments don't use CppAD
+    int threads = K_CONTROLLER_CPPAD_THREADS + max(loaded.multi_start_threads, 0);
+    if(threads > (int)K_MAX_CPPAD_THREADS)
+    {
+        error = path + ": multi_start_threads need " + to_string(threads)
+                + " CppAD threads, at most " + to_string(K_MAX_CPPAD_THREADS) + " are available";
+        return false;
+    }
+
+    config = loaded;
+    return true;
+}
+
+// Modification time of the file in seconds, 0 if it doesn't exist
+static double ModificationTime(const string &path)
+{
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0)
+    {
+        return 0;
+    }
+    return st.st_mtim.tv_sec + st.st_mtim.tv_nsec * 1e-9;
+}
+
+ConfigWatcher::ConfigWatcher(const string &path, function<void()> on_change)
+    : path(path), on_change(on_change), modified(ModificationTime(path))
+{
+    watcher_thread = thread(&ConfigWatcher::Run, this);
+}
+
+ConfigWatcher::~ConfigWatcher()
+{
+    {
+        lock_guard<mutex> lock(stop_mutex);
+        stop = true;
+    }
+    stop_changed.notify_all();
+    watcher_thread.join();
+}
+
+void ConfigWatcher::Run()
+{
+    unique_lock<mutex> lock(stop_mutex);
+    while(!stop)
+    {
+        auto period = chrono::duration<double>(poll_period);
+        if(stop_changed.wait_for(lock, period, [this]() { return stop; }))
+        {
+            return;
+        }
+
+        double time = ModificationTime(path);
+        if(time == 0 || time == modified)
+        {
+            continue;
+        }
+        modified = time;
+
+        Config config;
+        string error;
+        if(!LoadConfigFile(path, config, error))
+        {
+            cerr << "Config is not reloaded: " << error << endl;
+            continue;
+        }
+
+        Config::Publish(config);
+        cout << "Reloaded config " << path << endl;
+        lock.unlock();
+        if(on_change)
+        {
+            on_change();
+        }
+        lock.lock();
+    }
+}
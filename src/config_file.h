@@ -0,0 +1,62 @@
+#ifndef MPC_CONFIG_FILE_H
+#define MPC_CONFIG_FILE_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "config.h"
+
+using namespace std;
+
+// Config file format: one "name = value" per line, names are the names of the Config fields,
+// '#' starts a comment. "preset = 50|60|70" selects the preset the other values are applied to (60 by default).
+// Enums are written by their value names (e.g. "solver = LtvQp"), move_blocks as a comma separated list.
+//
+//   preset = 70
+//   epsi_w = 300
+//   solver = LtvQp
+//
+// Loads the config from the file. Returns false and the description of the first error
+// if the file can't be read or has an unknown name, a wrong value or a value out of its range (e.g. dt <= 0,
+// a negative weight, max_points_num < 3). The config is changed only if the whole file is valid.
+bool LoadConfigFile(const string &path, Config &config, string &error);
+
+// Sets the field with the given name from its text value, returns false if there is no such field or the value is wrong
+bool SetConfigValue(Config &config, const string &name, const string &value);
+
+// Writes every field of the config, so loading the file gives the same config whatever the preset is.
+// Every line of comment is written as a comment at the top. Returns false if the file can't be written.
+bool WriteConfigFile(const string &path, const Config &config, const string &comment = "");
+
+// Watches the config file and publishes the config (see Config::Publish) every time the file is changed.
+// After publishing on_change is called on the watcher thread, so caches depending on the config can be rebuilt
+// without blocking the controller. Files with errors are reported and ignored.
+class ConfigWatcher
+{
+    public:
+        ConfigWatcher(const string &path, function<void()> on_change);
+
+        ~ConfigWatcher();
+
+        // How often the modification time of the file is checked, seconds
+        double poll_period = 1;
+
+    private:
+        string path;
+        function<void()> on_change;
+
+        // modification time of the last loaded version, seconds
+        double modified = 0;
+
+        thread watcher_thread;
+        mutex stop_mutex;
+        condition_variable stop_changed;
+        bool stop = false;
+
+        void Run();
+};
+
+#endif //MPC_CONFIG_FILE_H
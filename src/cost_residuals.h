@@ -0,0 +1,48 @@
+#ifndef MPC_COST_RESIDUALS_H
+#define MPC_COST_RESIDUALS_H
+
+#include <cmath>
+
+#include "config.h"
+
+// The cost of every formulation is the sum of squared weighted residuals: [r0, r1, ...], cost = r0**2 + r1**2 + ...
+// The residuals of one stage depend only on the variables of this stage (besides single shooting),
+// so their Jacobian gives a cheap positive semidefinite Gauss-Newton approximation of the Hessian (see gauss_newton.h).
+
+// Number of the residuals for N states and N - 1 actuations
+inline size_t CostResidualsNum(size_t N)
+{
+    return 3 * N + 2 * (N - 1) + (N > 2 ? 2 * (N - 2) : 0);
+}
+
+// Sets residuals of the state at time t: the tracking errors and the velocity difference from the target.
+template <class ADvector, class T>
+void SetStateResiduals(ADvector &r, size_t t, const T &cte, const T &epsi, const T &v, const Config &config)
+{
+    r[3 * t] = sqrt(config.cte_w) * cte;
+    r[3 * t + 1] = sqrt(config.epsi_w) * epsi;
+    r[3 * t + 2] = sqrt(config.velocity_diff_w) * (v - config.target_v);
+}
+
+// Sets residuals of the actuations, they follow the residuals of N states
+template <class ADvector>
+void SetActuatorResiduals(ADvector &r, size_t N, const ADvector &delta, const ADvector &a, const Config &config)
+{
+    size_t k = 3 * N;
+
+    // Minimize the use of actuators.
+    for (size_t t = 0; t + 1 < N; t++)
+    {
+        r[k++] = sqrt(config.delta_w) * delta[t];
+        r[k++] = sqrt(config.a_w) * a[t];
+    }
+
+    // Minimize the value gap between sequential actuations.
+    for (size_t t = 0; t + 2 < N; t++)
+    {
+        r[k++] = sqrt(config.delta_diff_w) * (delta[t + 1] - delta[t]);
+        r[k++] = sqrt(config.a_diff_w) * (a[t + 1] - a[t]);
+    }
+}
+
+#endif //MPC_COST_RESIDUALS_H
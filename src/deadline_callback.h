@@ -0,0 +1,140 @@
+#ifndef MPC_DEADLINE_CALLBACK_H
+#define MPC_DEADLINE_CALLBACK_H
+
+#include <atomic>
+#include <chrono>
+#include <limits>
+
+#include <cppad/cppad.hpp>
+#include <cppad/ipopt/solve.hpp>
+#include <coin/IpIpoptData.hpp>
+#include <coin/IpIpoptCalculatedQuantities.hpp>
+#include <coin/IpOrigIpoptNLP.hpp>
+#include <coin/IpTNLPAdapter.hpp>
+
+#include "gauss_newton.h"
+
+// Maximum constraints violation of an iterate which is considered feasible
+const double K_FEASIBILITY_TOL = 1e-3;
+
+// CppAD problem interface for IPOPT that stops the optimizer at the wall clock deadline or when it is cancelled.
+// IPOPT's max_cpu_time limits CPU time, not the time the controller waits for the result.
+// The best feasible iterate is memorized on every iteration, so it can be used if the optimizer is stopped.
+template <class Dvector, class ADvector, class FG_eval>
+class DeadlineCallback : public CppAD::ipopt::solve_callback<Dvector, ADvector, FG_eval>
+{
+        typedef CppAD::ipopt::solve_callback<Dvector, ADvector, FG_eval> Base;
+
+    public:
+        DeadlineCallback(size_t nf, size_t nx, size_t ng,
+                         const Dvector &xi, const Dvector &xl, const Dvector &xu,
+                         const Dvector &gl, const Dvector &gu,
+                         FG_eval &fg_eval, bool retape, bool sparse_forward, bool sparse_reverse,
+                         CppAD::ipopt::solve_result<Dvector> &solution,
+                         std::chrono::steady_clock::time_point deadline)
+            : CppAD::ipopt::solve_callback<Dvector, ADvector, FG_eval>(nf, nx, ng, xi, xl, xu, gl, gu, fg_eval,
+                                                                        retape, sparse_forward, sparse_reverse,
+                                                                        solution),
+              deadline(deadline), best_x(nx), nx(nx)
+        {
+        }
+
+        virtual bool get_nlp_info(Ipopt::Index &n, Ipopt::Index &m, Ipopt::Index &nnz_jac_g, Ipopt::Index &nnz_h_lag,
+                                  Ipopt::TNLP::IndexStyleEnum &index_style)
+        {
+            bool ok = Base::get_nlp_info(n, m, nnz_jac_g, nnz_h_lag, index_style);
+            if(gauss_newton != nullptr)
+            {
+                nnz_h_lag = (Ipopt::Index)gauss_newton->Nnz();
+            }
+            return ok;
+        }
+
+        virtual bool eval_h(Ipopt::Index n, const Ipopt::Number *x, bool new_x, Ipopt::Number obj_factor,
+                            Ipopt::Index m, const Ipopt::Number *lambda, bool new_lambda, Ipopt::Index nele_hess,
+                            Ipopt::Index *iRow, Ipopt::Index *jCol, Ipopt::Number *values)
+        {
+            if(gauss_newton == nullptr)
+            {
+                return Base::eval_h(n, x, new_x, obj_factor, m, lambda, new_lambda, nele_hess, iRow, jCol, values);
+            }
+
+            if(values == nullptr)
+            {
+                gauss_newton->Structure(iRow, jCol);
+            }
+            else
+            {
+                gauss_newton->Values(x, obj_factor, values);
+            }
+            return true;
+        }
+
+        virtual bool intermediate_callback(Ipopt::AlgorithmMode mode, Ipopt::Index iter, Ipopt::Number obj_value,
+                                           Ipopt::Number inf_pr, Ipopt::Number inf_du, Ipopt::Number mu,
+                                           Ipopt::Number d_norm, Ipopt::Number regularization_size,
+                                           Ipopt::Number alpha_du, Ipopt::Number alpha_pr, Ipopt::Index ls_trials,
+                                           const Ipopt::IpoptData *ip_data,
+                                           Ipopt::IpoptCalculatedQuantities *ip_cq)
+        {
+            iterations = iter;
+
+            // memorize the best feasible iterate, the violation is the one of our constraints, not the scaled ones
+            if(mode == Ipopt::RegularMode && obj_value < best_obj && ip_data != nullptr && ip_cq != nullptr &&
+               ip_cq->unscaled_curr_nlp_constraint_violation(Ipopt::NORM_MAX) <= K_FEASIBILITY_TOL &&
+               GetIterate(ip_data, ip_cq))
+            {
+                best_obj = obj_value;
+                has_best_x = true;
+            }
+
+            if(std::chrono::steady_clock::now() >= deadline || (cancel != nullptr && *cancel))
+            {
+                stopped_by_deadline = true;
+                return false;
+            }
+            return true;
+        }
+
+        std::chrono::steady_clock::time_point deadline;
+
+        // the optimizer is stopped the same way as at the deadline once it is set, if it is not nullptr
+        const std::atomic<bool> *cancel = nullptr;
+
+        // Gauss-Newton approximation used instead of the exact Hessian if it is set
+        GaussNewtonHessian<FG_eval> *gauss_newton = nullptr;
+
+        bool stopped_by_deadline = false;
+        int iterations = 0;
+
+        // the best feasible iterate
+        Dvector best_x;
+        double best_obj = std::numeric_limits<double>::max();
+        bool has_best_x = false;
+
+    private:
+        // Copies the current iterate to best_x. IPOPT keeps it scaled and without the fixed variables,
+        // the adapter of this problem converts it back to our variables.
+        bool GetIterate(const Ipopt::IpoptData *ip_data, Ipopt::IpoptCalculatedQuantities *ip_cq)
+        {
+            Ipopt::OrigIpoptNLP *orig_nlp = dynamic_cast<Ipopt::OrigIpoptNLP *>(Ipopt::GetRawPtr(ip_cq->GetIpoptNLP()));
+            if(orig_nlp == nullptr || nx == 0)
+            {
+                return false;
+            }
+            Ipopt::TNLPAdapter *adapter = dynamic_cast<Ipopt::TNLPAdapter *>(Ipopt::GetRawPtr(orig_nlp->nlp()));
+            if(adapter == nullptr)
+            {
+                return false;
+            }
+
+            Ipopt::SmartPtr<const Ipopt::Vector> x =
+                orig_nlp->NLP_scaling()->unapply_vector_scaling_x(ip_data->curr()->x());
+            adapter->ResortX(*x, &best_x[0]);
+            return true;
+        }
+
+        size_t nx;
+};
+
+#endif //MPC_DEADLINE_CALLBACK_H
@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "explicit_table.h"
+
+bool WriteExplicitTable(const string &path, const ExplicitTableHeader &header,
+                        const vector<float> &values, const vector<uint8_t> &valid)
+{
+    if(values.size() != header.points_num * 2 || valid.size() != header.cells_num)
+    {
+        return false;
+    }
+
+    ExplicitTableHeader file_header = header;
+    memcpy(file_header.magic, K_EXPLICIT_TABLE_MAGIC, sizeof(file_header.magic));
+    file_header.version = K_EXPLICIT_TABLE_VERSION;
+    file_header.values_offset = sizeof(ExplicitTableHeader);
+    file_header.valid_offset = file_header.values_offset + values.size() * sizeof(float);
+    file_header.file_size = file_header.valid_offset + valid.size();
+
+    ofstream file(path, ios::binary | ios::trunc);
+    if(!file.is_open())
+    {
+        return false;
+    }
+
+    file.write((const char *)&file_header, sizeof(file_header));
+    file.write((const char *)values.data(), values.size() * sizeof(float));
+    file.write((const char *)valid.data(), valid.size());
+    return file.good();
+}
+
+ExplicitTable::~ExplicitTable()
+{
+    Close();
+}
+
+bool ExplicitTable::Open(const string &path)
+{
+    Close();
+
+    fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ExplicitTableHeader))
+    {
+        Close();
+        return false;
+    }
+
+    size = (size_t)st.st_size;
+    void *mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if(mapped == MAP_FAILED)
+    {
+        Close();
+        return false;
+    }
+    data = (uint8_t *)mapped;
+    header = (const ExplicitTableHeader *)data;
+
+    // the table is small and every lookup touches a few neighbouring points, so keep it resident
+    madvise(data, size, MADV_WILLNEED);
+
+    uint64_t points_num = 1;
+    uint64_t cells_num = 1;
+    bool valid_sizes = true;
+    for(int axis = 0; axis < K_TABLE_AXES; axis++)
+    {
+        valid_sizes = valid_sizes && header->sizes[axis] >= 2 && header->max[axis] > header->min[axis];
+        points_num *= header->sizes[axis];
+        cells_num *= header->sizes[axis] - 1;
+    }
+
+    bool valid_header = memcmp(header->magic, K_EXPLICIT_TABLE_MAGIC, sizeof(header->magic)) == 0
+                        && header->version == K_EXPLICIT_TABLE_VERSION
+                        && header->file_size == size
+                        && valid_sizes
+                        && header->points_num == points_num
+                        && header->cells_num == cells_num
+                        && header->values_offset + points_num * 2 * sizeof(float) <= size
+                        && header->valid_offset + cells_num <= size;
+    if(!valid_header)
+    {
+        Close();
+        return false;
+    }
+
+    values = (const float *)(data + header->values_offset);
+    valid = data + header->valid_offset;
+
+    uint64_t point_stride = 1;
+    uint64_t cell_stride = 1;
+    for(int axis = K_TABLE_AXES - 1; axis >= 0; axis--)
+    {
+        point_strides[axis] = point_stride;
+        cell_strides[axis] = cell_stride;
+        point_stride *= header->sizes[axis];
+        cell_stride *= header->sizes[axis] - 1;
+        scales[axis] = (header->sizes[axis] - 1) / (header->max[axis] - header->min[axis]);
+    }
+
+    return true;
+}
+
+void ExplicitTable::Close()
+{
+    if(data != nullptr)
+    {
+        munmap(data, size);
+        data = nullptr;
+    }
+    if(fd >= 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    header = nullptr;
+    values = nullptr;
+    valid = nullptr;
+}
+
+bool ExplicitTable::Matches(const Config &config, int points_num) const
+{
+    return IsLoaded() && points_num == (int)header->horizon_points && config.MatchesKey(header->config);
+}
+
+bool ExplicitTable::Lookup(double v, const Eigen::VectorXd &coeffs, double &delta, double &a) const
+{
+    double query[K_TABLE_AXES] = {v, coeffs[0], atan(-coeffs[1]), coeffs[2], coeffs[3]};
+    return Interpolate(query, delta, a);
+}
+
+bool ExplicitTable::Interpolate(const double query[K_TABLE_AXES], double &delta, double &a) const
+{
+    if(data == nullptr)
+    {
+        return false;
+    }
+
+    // 1. Find the cell containing the query and the position inside it
+    uint64_t base = 0;
+    uint64_t cell = 0;
+    double fractions[K_TABLE_AXES];
+    for(int axis = 0; axis < K_TABLE_AXES; axis++)
+    {
+        double position = (query[axis] - header->min[axis]) * scales[axis];
+        uint32_t last = header->sizes[axis] - 1;
+
+        // written this way NaN is also outside
+        if(!(position >= 0 && position <= last))
+        {
+            return false;
+        }
+
+        uint32_t index = min((uint32_t)position, last - 1);
+        fractions[axis] = position - index;
+        base += index * point_strides[axis];
+        cell += index * cell_strides[axis];
+    }
+
+    if(!valid[cell])
+    {
+        return false;
+    }
+
+    // 2. Multilinear interpolation between the corners of the cell
+    double delta_sum = 0;
+    double a_sum = 0;
+    for(int corner = 0; corner < (1 << K_TABLE_AXES); corner++)
+    {
+        double weight = 1;
+        uint64_t point = base;
+        for(int axis = 0; axis < K_TABLE_AXES; axis++)
+        {
+            if(corner & (1 << axis))
+            {
+                weight *= fractions[axis];
+                point += point_strides[axis];
+            }
+            else
+            {
+                weight *= 1 - fractions[axis];
+            }
+        }
+        delta_sum += weight * values[2 * point];
+        a_sum += weight * values[2 * point + 1];
+    }
+
+    delta = delta_sum;
+    a = a_sum;
+    return true;
+}
@@ -0,0 +1,107 @@
+#ifndef MPC_EXPLICIT_TABLE_H
+#define MPC_EXPLICIT_TABLE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "config.h"
+
+using namespace std;
+
+// Explicit MPC table format.
+// The first actuations of the polynomial formulation are precomputed offline (see table_build.cpp)
+// on a regular grid over the problem parameters and interpolated at runtime.
+// The file is memory mapped and used as is, so all the structures have fixed size and layout.
+//
+// [ExplicitTableHeader][float delta, float a x points_num][uint8_t valid x cells_num]
+//
+// Grid points are stored in row-major order, the last axis changes fastest. A cell is the box between
+// 2^K_TABLE_AXES neighbouring grid points, it is valid if the optimizer converged at all its corners and
+// the interpolation matched the optimizer at its center, only valid cells are used.
+const char K_EXPLICIT_TABLE_MAGIC[8] = {'M', 'P', 'C', 'T', 'A', 'B', 'L', 'E'};
+const uint32_t K_EXPLICIT_TABLE_VERSION = 1;
+
+// Axes of the table: velocity, cross track error, heading error, and the quadratic and cubic polynomial coefficients.
+// The state of the polynomial formulation is [0, 0, 0, v, coeffs[0], atan(-coeffs[1])],
+// so these values define the whole problem for the given config and horizon.
+const int K_TABLE_AXES = 5;
+
+struct ExplicitTableHeader
+{
+    char magic[8];
+    uint32_t version;
+
+    // number of points of the horizon the table was built for
+    uint32_t horizon_points;
+
+    // grid of every axis: size values evenly spaced from min to max
+    uint32_t sizes[K_TABLE_AXES];
+    uint32_t reserved;
+    double min[K_TABLE_AXES];
+    double max[K_TABLE_AXES];
+
+    // the table is used only with the config it was built for, see Config::GetKey
+    double config[K_CONFIG_KEY_SIZE];
+
+    uint64_t points_num;
+    uint64_t cells_num;
+
+    // offsets of the sections from the beginning of the file
+    uint64_t values_offset;
+    uint64_t valid_offset;
+
+    // full size of the file
+    uint64_t file_size;
+};
+
+// Writes the table, values are [delta, a] of every grid point, valid has a flag for every cell.
+// Returns false if the file can't be written.
+bool WriteExplicitTable(const string &path, const ExplicitTableHeader &header,
+                        const vector<float> &values, const vector<uint8_t> &valid);
+
+// Read-only memory mapped explicit MPC table
+class ExplicitTable
+{
+    public:
+        virtual ~ExplicitTable();
+
+        // Maps the file and validates its header. Returns false if the file can't be mapped or has a wrong format.
+        bool Open(const string &path);
+
+        void Close();
+
+        bool IsLoaded() const { return data != nullptr; }
+
+        // Returns true if the table was built for the config and the number of points of the horizon
+        bool Matches(const Config &config, int points_num) const;
+
+        // Interpolates the first actuations for velocity v and the polynomial in car's coordinates.
+        // Returns false if the query is outside the grid or in a cell that is not valid,
+        // then the problem has to be solved online. It doesn't allocate and takes well under a microsecond.
+        bool Lookup(double v, const Eigen::VectorXd &coeffs, double &delta, double &a) const;
+
+        // Interpolates at the point of the table axes, see Lookup
+        bool Interpolate(const double query[K_TABLE_AXES], double &delta, double &a) const;
+
+        const ExplicitTableHeader &Header() const { return *header; }
+
+    private:
+        int fd = -1;
+        uint8_t *data = nullptr;
+        size_t size = 0;
+
+        const ExplicitTableHeader *header = nullptr;
+        const float *values = nullptr;
+        const uint8_t *valid = nullptr;
+
+        // distance between neighbouring grid points and cells along every axis
+        uint64_t point_strides[K_TABLE_AXES];
+        uint64_t cell_strides[K_TABLE_AXES];
+
+        // number of grid steps per unit of every axis
+        double scales[K_TABLE_AXES];
+};
+
+#endif //MPC_EXPLICIT_TABLE_H
@@ -0,0 +1,134 @@
+#ifndef MPC_GAUSS_NEWTON_H
+#define MPC_GAUSS_NEWTON_H
+
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include <cppad/cppad.hpp>
+#include <coin/IpTNLP.hpp>
+
+// Gauss-Newton approximation of the Hessian of the Lagrangian: 2 * J' * J, where J is the Jacobian
+// of the cost residuals of FG (see cost_residuals.h). The second derivatives of the residuals and the constraints
+// are dropped, so the approximation is positive semidefinite and needs only first order sweeps.
+// With multiple shooting every residual depends on the variables of one or two neighbouring stages,
+// so the approximation is a sum of small per-stage blocks.
+template <class FG>
+class GaussNewtonHessian
+{
+    public:
+        GaussNewtonHessian(FG &fg_eval, size_t nx)
+        {
+            typedef typename FG::ADvector ADvector;
+
+            // the residuals don't have branches, so the tape doesn't depend on the point it is recorded at
+            ADvector ax(nx);
+            for(size_t i = 0; i < nx; i++)
+            {
+                ax[i] = 0;
+            }
+            CppAD::Independent(ax);
+            ADvector ar(fg_eval.ResidualsNum());
+            fg_eval.Residuals(ar, ax);
+            residuals.Dependent(ax, ar);
+            residuals.optimize();
+
+            // sparsity pattern of the Jacobian of the residuals
+            std::vector<std::set<size_t>> identity(nx);
+            for(size_t i = 0; i < nx; i++)
+            {
+                identity[i].insert(i);
+            }
+            pattern = residuals.ForSparseJac(nx, identity);
+
+            // every pair of variables of the same residual gives an entry of the lower triangle of the Hessian
+            std::map<std::pair<size_t, size_t>, size_t> entries;
+            for(size_t k = 0; k < pattern.size(); k++)
+            {
+                size_t row_start = jac_row.size();
+                for(size_t col : pattern[k])
+                {
+                    jac_row.push_back(k);
+                    jac_col.push_back(col);
+                }
+
+                for(size_t p = row_start; p < jac_row.size(); p++)
+                {
+                    for(size_t q = row_start; q <= p; q++)
+                    {
+                        // columns of the row are sorted, so jac_col[p] >= jac_col[q]
+                        auto key = std::make_pair(jac_col[p], jac_col[q]);
+                        auto entry = entries.find(key);
+                        if(entry == entries.end())
+                        {
+                            entry = entries.insert(std::make_pair(key, hess_row.size())).first;
+                            hess_row.push_back(key.first);
+                            hess_col.push_back(key.second);
+                        }
+                        terms.push_back({p, q, entry->second});
+                    }
+                }
+            }
+
+            x.resize(nx);
+            jac.resize(jac_row.size());
+        }
+
+        size_t Nnz() const
+        {
+            return hess_row.size();
+        }
+
+        void Structure(Ipopt::Index *iRow, Ipopt::Index *jCol) const
+        {
+            for(size_t i = 0; i < hess_row.size(); i++)
+            {
+                iRow[i] = (Ipopt::Index)hess_row[i];
+                jCol[i] = (Ipopt::Index)hess_col[i];
+            }
+        }
+
+        // Fills the lower triangle of obj_factor * 2 * J' * J at the point x
+        void Values(const Ipopt::Number *point, Ipopt::Number obj_factor, Ipopt::Number *values)
+        {
+            for(size_t i = 0; i < x.size(); i++)
+            {
+                x[i] = point[i];
+            }
+            residuals.SparseJacobianForward(x, pattern, jac_row, jac_col, jac, work);
+
+            for(size_t i = 0; i < hess_row.size(); i++)
+            {
+                values[i] = 0;
+            }
+            for(const Term &term : terms)
+            {
+                values[term.entry] += 2 * obj_factor * jac[term.p] * jac[term.q];
+            }
+        }
+
+    private:
+        // contribution of the product of two Jacobian entries of the same residual to the Hessian entry
+        struct Term
+        {
+            size_t p;
+            size_t q;
+            size_t entry;
+        };
+
+        CppAD::ADFun<double> residuals;
+        std::vector<std::set<size_t>> pattern;
+        CppAD::sparse_jacobian_work work;
+
+        std::vector<size_t> jac_row;
+        std::vector<size_t> jac_col;
+        std::vector<double> x;
+        std::vector<double> jac;
+
+        std::vector<size_t> hess_row;
+        std::vector<size_t> hess_col;
+        std::vector<Term> terms;
+};
+
+#endif //MPC_GAUSS_NEWTON_H
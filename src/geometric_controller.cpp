@@ -0,0 +1,65 @@
+#include <algorithm>
+
+#include "geometric_controller.h"
+#include "config.h"
+#include "utils.h"
+
+// Lookahead distance is the distance the car passes in this time, but not less than the minimum
+const double K_LOOKAHEAD_TIME = 0.8;
+const double K_MIN_LOOKAHEAD = 6;
+
+// Acceleration per m/s of velocity error and per m of its integral
+const double K_VELOCITY_GAIN = 0.5;
+const double K_VELOCITY_INTEGRAL_GAIN = 0.1;
+
+// Limit of the acceleration from the integral, so it doesn't wind up while the acceleration is saturated
+const double K_MAX_INTEGRAL_ACCELERATION = 1;
+
+// The integral is restarted after a longer pause between the calls (the controller was not in use)
+const double K_MAX_INTEGRATION_STEP = 0.5;
+
+// Number of the trajectory points for display
+const int K_TRAJECTORY_POINTS = 10;
+
+MPCSolution GeometricController::Control(const Eigen::VectorXd &coeffs, double v, double time)
+{
+    Config config = Config::GetConfig();
+    double lookahead = max(K_MIN_LOOKAHEAD, v * K_LOOKAHEAD_TIME);
+
+    // Pure pursuit: circle going through the car and the target point has curvature 2 * y / l**2.
+    // In the model curvature of the trajectory is delta / Lf.
+    double target_y = polyeval(coeffs, lookahead);
+    double target_x = lookahead;
+    double l2 = target_x * target_x + target_y * target_y;
+    double curvature = 2 * target_y / l2;
+
+    // PI speed control
+    double error = config.target_v - v;
+    double step = time - last_time;
+    if(last_time < 0 || step < 0 || step > K_MAX_INTEGRATION_STEP)
+    {
+        velocity_error_integral = 0;
+        step = 0;
+    }
+    last_time = time;
+    double max_integral = K_MAX_INTEGRAL_ACCELERATION / K_VELOCITY_INTEGRAL_GAIN;
+    velocity_error_integral = max(-max_integral, min(max_integral, velocity_error_integral + error * step));
+    double acceleration = K_VELOCITY_GAIN * error + K_VELOCITY_INTEGRAL_GAIN * velocity_error_integral;
+
+    MPCSolution sl;
+    sl.ok = false;
+    sl.feasible = true;
+    sl.delta = max(-K_MAX_DELTA, min(K_MAX_DELTA, curvature * Lf));
+    sl.acceleration = max(-K_MAX_ACCELERATION, min(K_MAX_ACCELERATION, acceleration));
+    sl.delta_vals.push_back(sl.delta);
+    sl.a_vals.push_back(sl.acceleration);
+
+    for(int i = 1; i <= K_TRAJECTORY_POINTS; i++)
+    {
+        double x = lookahead * i / K_TRAJECTORY_POINTS;
+        sl.x_vals.push_back(x);
+        sl.y_vals.push_back(polyeval(coeffs, x));
+    }
+
+    return sl;
+}
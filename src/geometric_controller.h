@@ -0,0 +1,25 @@
+#ifndef MPC_GEOMETRIC_CONTROLLER_H
+#define MPC_GEOMETRIC_CONTROLLER_H
+
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+
+// Cheap controller that doesn't need the optimizer.
+// Steering is calculated by pure pursuit of the point of the fitted polynomial located at the lookahead distance,
+// acceleration is a PI control of the velocity error.
+// It is used as the last fallback when the optimizer can't find a solution in time
+// and as the whole controller in the geometric mode (see Config::controller).
+class GeometricController
+{
+    public:
+        // Returns actuations for the polynomial in car's coordinates and current velocity at the given time (seconds).
+        // Trajectory points are taken from the polynomial, so they can be displayed as the MPC ones.
+        MPCSolution Control(const Eigen::VectorXd &coeffs, double v, double time);
+
+    private:
+        // integral of the velocity error and the time of the last call
+        double velocity_error_integral = 0;
+        double last_time = -1;
+};
+
+#endif //MPC_GEOMETRIC_CONTROLLER_H
@@ -8,9 +8,13 @@
 struct Indices
 {
     public:
-        Indices(size_t N)
+        Indices(size_t N) : Indices(N, N - 1) {}
+
+        // inputs_num is the number of parameters of every actuator sequence (see input_basis.h)
+        Indices(size_t N, size_t inputs_num)
         {
             this->N = N;
+            this->inputs_num = inputs_num;
             this->x_start = 0;
             this->y_start = x_start + N;
             this->psi_start = y_start + N;
@@ -18,10 +22,11 @@ struct Indices
             this->cte_start = v_start + N;
             this->epsi_start = cte_start + N;
             this->delta_start = epsi_start + N;
-            this->a_start = delta_start + N - 1;
+            this->a_start = delta_start + inputs_num;
         };
 
         size_t N;
+        size_t inputs_num;
         size_t x_start;
         size_t y_start;
         size_t psi_start;
@@ -32,4 +37,82 @@ struct Indices
         size_t a_start;
 };
 
+// Indices for the path coordinates formulation (see FG_eval_frenet.h).
+// State consists of progress along the track s, lateral offset n, heading error mu and velocity v.
+struct FrenetIndices
+{
+    public:
+        FrenetIndices(size_t N) : FrenetIndices(N, N - 1) {}
+
+        FrenetIndices(size_t N, size_t inputs_num)
+        {
+            this->N = N;
+            this->inputs_num = inputs_num;
+            this->s_start = 0;
+            this->n_start = s_start + N;
+            this->mu_start = n_start + N;
+            this->v_start = mu_start + N;
+            this->delta_start = v_start + N;
+            this->a_start = delta_start + inputs_num;
+        };
+
+        size_t N;
+        size_t inputs_num;
+        size_t s_start;
+        size_t n_start;
+        size_t mu_start;
+        size_t v_start;
+        size_t delta_start;
+        size_t a_start;
+};
+
+// Indices for the reduced model (see FG_eval_reduced.h), the same as Indices without cte and epsi.
+struct ReducedIndices
+{
+    public:
+        ReducedIndices(size_t N) : ReducedIndices(N, N - 1) {}
+
+        ReducedIndices(size_t N, size_t inputs_num)
+        {
+            this->N = N;
+            this->inputs_num = inputs_num;
+            this->x_start = 0;
+            this->y_start = x_start + N;
+            this->psi_start = y_start + N;
+            this->v_start = psi_start + N;
+            this->delta_start = v_start + N;
+            this->a_start = delta_start + inputs_num;
+        };
+
+        size_t N;
+        size_t inputs_num;
+        size_t x_start;
+        size_t y_start;
+        size_t psi_start;
+        size_t v_start;
+        size_t delta_start;
+        size_t a_start;
+};
+
+// Indices for the single shooting formulation (see FG_eval_single.h).
+// Only actuations are passed to the optimizer: [delta0, delta1, ..., a0, a1, ...]
+struct ShootingIndices
+{
+    public:
+        ShootingIndices(size_t N) : ShootingIndices(N, N - 1) {}
+
+        ShootingIndices(size_t N, size_t inputs_num)
+        {
+            this->N = N;
+            this->inputs_num = inputs_num;
+            this->delta_start = 0;
+            this->a_start = delta_start + inputs_num;
+        };
+
+        size_t N;
+        size_t inputs_num;
+        size_t delta_start;
+        size_t a_start;
+};
+
 #endif //MPC_INDICES_H
@@ -0,0 +1,114 @@
+#include "input_basis.h"
+
+#include <algorithm>
+
+InputBasis::InputBasis(size_t steps_num)
+{
+    for(size_t step = 0; step < steps_num; step++)
+    {
+        rows.push_back({{step, 1.}});
+    }
+    params_num = steps_num;
+}
+
+InputBasis InputBasis::FromConfig(const Config &config, size_t steps_num)
+{
+    switch(config.input_parameterization)
+    {
+        case InputParameterization::MoveBlocking:
+            return MoveBlocking(config.move_blocks, steps_num);
+        case InputParameterization::BSpline:
+            return BSpline(config.spline_control_points, steps_num);
+        default:
+            return InputBasis(steps_num);
+    }
+}
+
+InputBasis InputBasis::MoveBlocking(const vector<int> &blocks, size_t steps_num)
+{
+    InputBasis basis;
+    size_t block = 0;
+    size_t block_end = blocks.empty() ? steps_num : max(blocks[0], 1);
+    for(size_t step = 0; step < steps_num; step++)
+    {
+        if(step >= block_end && block + 1 < blocks.size())
+        {
+            block++;
+            block_end += max(blocks[block], 1);
+        }
+        basis.rows.push_back({{block, 1.}});
+    }
+    basis.params_num = steps_num > 0 ? block + 1 : 0;
+    return basis;
+}
+
+InputBasis InputBasis::BSpline(size_t control_points_num, size_t steps_num)
+{
+    // there is no point in having more control points than steps
+    control_points_num = min(max(control_points_num, (size_t)1), steps_num);
+    if(control_points_num == steps_num)
+    {
+        return InputBasis(steps_num);
+    }
+
+    // clamped knot vector: the spline starts at the first control point and ends at the last one
+    size_t degree = min((size_t)3, control_points_num - 1);
+    size_t knots_num = control_points_num + degree + 1;
+    vector<double> knots(knots_num);
+    size_t inner_num = control_points_num - degree;
+    for(size_t i = 0; i < knots_num; i++)
+    {
+        if(i <= degree)
+        {
+            knots[i] = 0;
+        }
+        else if(i >= control_points_num)
+        {
+            knots[i] = 1;
+        }
+        else
+        {
+            knots[i] = (double)(i - degree) / inner_num;
+        }
+    }
+
+    InputBasis basis;
+    basis.params_num = control_points_num;
+    for(size_t step = 0; step < steps_num; step++)
+    {
+        double u = steps_num > 1 ? (double)step / (steps_num - 1) : 0;
+
+        // Cox-de Boor recursion starting from the span containing u
+        size_t span = degree;
+        while(span + 1 < control_points_num && u >= knots[span + 1])
+        {
+            span++;
+        }
+        vector<double> n(degree + 1, 0.);
+        n[0] = 1;
+        for(size_t d = 1; d <= degree; d++)
+        {
+            double saved = 0;
+            for(size_t r = 0; r < d; r++)
+            {
+                double left = u - knots[span + 1 - d + r];
+                double right = knots[span + 1 + r] - u;
+                double temp = n[r] / (right + left);
+                n[r] = saved + right * temp;
+                saved = left * temp;
+            }
+            n[d] = saved;
+        }
+
+        vector<pair<size_t, double>> row;
+        for(size_t r = 0; r <= degree; r++)
+        {
+            if(n[r] > 1e-12)
+            {
+                row.push_back({span - degree + r, n[r]});
+            }
+        }
+        basis.rows.push_back(row);
+    }
+    return basis;
+}
@@ -0,0 +1,71 @@
+#ifndef MPC_INPUT_BASIS_H
+#define MPC_INPUT_BASIS_H
+
+#include <utility>
+#include <vector>
+
+#include "config.h"
+
+using namespace std;
+
+// Maps a small number of optimized parameters to the actuator sequence of every step of the horizon.
+// Every actuation is a weighted sum of the parameters: with move blocking it equals the parameter of its block,
+// with a B-spline it is a combination of the nearest control points.
+// The weights are non-negative and sum up to 1, so the actuator limits can be applied to the parameters.
+class InputBasis
+{
+    public:
+        // One parameter per step, the actuations are optimized directly
+        explicit InputBasis(size_t steps_num);
+
+        // Selects the parameterization from the config
+        static InputBasis FromConfig(const Config &config, size_t steps_num);
+
+        // The actuation is held constant over every block, block sizes are in steps.
+        // The last block is extended to the end of the horizon, blocks beyond it are dropped.
+        static InputBasis MoveBlocking(const vector<int> &blocks, size_t steps_num);
+
+        // Clamped uniform cubic B-spline with the given number of control points
+        static InputBasis BSpline(size_t control_points_num, size_t steps_num);
+
+        size_t ParamsNum() const { return params_num; }
+
+        size_t StepsNum() const { return rows.size(); }
+
+        // Actuation at the step, the parameters are vars[start], ..., vars[start + ParamsNum() - 1]
+        template <class T, class V>
+        T Expand(const V &vars, size_t start, size_t step) const
+        {
+            const vector<pair<size_t, double>> &row = rows[step];
+            if(row.size() == 1 && row[0].second == 1)
+            {
+                return vars[start + row[0].first];
+            }
+
+            T value = 0;
+            for(const auto &weight : row)
+            {
+                value += weight.second * vars[start + weight.first];
+            }
+            return value;
+        }
+
+        // Actuations of all the steps
+        template <class T, class V, class O>
+        void ExpandAll(const V &vars, size_t start, O &out) const
+        {
+            for(size_t step = 0; step < rows.size(); step++)
+            {
+                out[step] = Expand<T>(vars, start, step);
+            }
+        }
+
+    private:
+        // non-zero weights of the parameters for every step
+        vector<vector<pair<size_t, double>>> rows;
+        size_t params_num = 0;
+
+        InputBasis() {}
+};
+
+#endif //MPC_INPUT_BASIS_H
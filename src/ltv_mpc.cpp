@@ -0,0 +1,187 @@
+#include "ltv_mpc.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "config.h"
+#include "utils.h"
+
+typedef LtvState State;
+typedef LtvStateJacobian StateJacobian;
+typedef LtvInputJacobian InputJacobian;
+
+// States of the horizon and their sensitivities to all the actuations
+typedef Eigen::Matrix<double, 6, Eigen::Dynamic, 0, 6, K_LTV_MAX_POINTS> Trajectory;
+typedef Eigen::Matrix<double, 6, Eigen::Dynamic, 0, 6, K_QP_MAX_VARS> Sensitivity;
+
+State LtvStep(const State &s, double delta, double a, const Eigen::VectorXd &coeffs, double dt,
+              StateJacobian &A, InputJacobian &B)
+{
+    double x = s[0];
+    double y = s[1];
+    double psi = s[2];
+    double v = s[3];
+    double epsi = s[5];
+
+    double f = coeffs[0] + coeffs[1] * x + coeffs[2] * x * x + coeffs[3] * x * x * x;
+    double df = coeffs[1] + 2 * coeffs[2] * x + 3 * coeffs[3] * x * x;
+    double ddf = 2 * coeffs[2] + 6 * coeffs[3] * x;
+
+    State next;
+    next[0] = x + v * cos(psi) * dt;
+    next[1] = y + v * sin(psi) * dt;
+    next[2] = psi + v * delta / Lf * dt;
+    next[3] = v + a * dt;
+    next[4] = (f - y) + v * sin(epsi) * dt;
+    next[5] = (psi - atan(df)) + v * delta / Lf * dt;
+
+    A.setZero();
+    A(0, 0) = 1;
+    A(0, 2) = -v * sin(psi) * dt;
+    A(0, 3) = cos(psi) * dt;
+    A(1, 1) = 1;
+    A(1, 2) = v * cos(psi) * dt;
+    A(1, 3) = sin(psi) * dt;
+    A(2, 2) = 1;
+    A(2, 3) = delta / Lf * dt;
+    A(3, 3) = 1;
+    A(4, 0) = df;
+    A(4, 1) = -1;
+    A(4, 3) = sin(epsi) * dt;
+    A(4, 5) = v * cos(epsi) * dt;
+    A(5, 0) = -ddf / (1 + df * df);
+    A(5, 2) = 1;
+    A(5, 3) = delta / Lf * dt;
+
+    B.setZero();
+    B(2, 0) = v / Lf * dt;
+    B(3, 1) = dt;
+    B(5, 0) = v / Lf * dt;
+
+    return next;
+}
+
+// Adds weight * (u[i] - u[j])**2 of the actuations u + du to the QP
+static void AddDiffCost(QpMatrix &H, QpVector &g, const QpVector &u, int i, int j, double weight)
+{
+    H(i, i) += 2 * weight;
+    H(j, j) += 2 * weight;
+    H(i, j) -= 2 * weight;
+    H(j, i) -= 2 * weight;
+    g[i] += 2 * weight * (u[i] - u[j]);
+    g[j] += 2 * weight * (u[j] - u[i]);
+}
+
+MPCSolution LtvMpc::Solve(const Eigen::VectorXd &state, const Eigen::VectorXd &coeffs, int points_num,
+                          const vector<double> &delta_guess, const vector<double> &a_guess)
+{
+    MPCSolution sl;
+    int N = points_num;
+    if(N < 2 || N > K_LTV_MAX_POINTS)
+    {
+        return sl;
+    }
+
+    // actuations are [delta0, ..., delta(M-1), a0, ..., a(M-1)]
+    int M = N - 1;
+    Config config = Config::GetConfig();
+    vector<double> stage_dt = config.GetStageDt(M);
+
+    // The nominal actuations are the previous plan shifted to now, its last actuation is held
+    QpVector u(2 * M);
+    for(int i = 0; i < M; i++)
+    {
+        u[i] = delta_guess.empty() ? 0 : delta_guess[min((size_t)i, delta_guess.size() - 1)];
+        u[M + i] = a_guess.empty() ? 0 : a_guess[min((size_t)i, a_guess.size() - 1)];
+        u[i] = max(-K_MAX_DELTA, min(u[i], K_MAX_DELTA));
+        u[M + i] = max(-K_MAX_ACCELERATION, min(u[M + i], K_MAX_ACCELERATION));
+    }
+
+    Trajectory states(6, N);
+    Sensitivity S(6, 2 * M);
+    QpMatrix H(2 * M, 2 * M);
+    QpVector g(2 * M);
+    QpVector lower(2 * M);
+    QpVector upper(2 * M);
+    QpVector du(2 * M);
+    StateJacobian A;
+    InputJacobian B;
+
+    // weights and references of the state costs: cte, epsi and velocity
+    const int cost_rows[3] = {4, 5, 3};
+    const double cost_weights[3] = {config.cte_w, config.epsi_w, config.velocity_diff_w};
+    const double cost_refs[3] = {0, 0, config.target_v};
+
+    bool converged = false;
+    sl.iterations = 0;
+    for(int k = 0; k < linearizations; k++)
+    {
+        H.setZero();
+        g.setZero();
+        S.setZero();
+
+        // 1. Roll out the nominal trajectory and condense the linearized model:
+        // the deviation of the state t + 1 is S * du
+        states.col(0) = state.head<6>();
+        for(int t = 0; t < M; t++)
+        {
+            states.col(t + 1) = LtvStep(states.col(t), u[t], u[M + t], coeffs, stage_dt[t], A, B);
+            S = A * S;
+            S.col(t) += B.col(0);
+            S.col(M + t) += B.col(1);
+
+            for(int c = 0; c < 3; c++)
+            {
+                double residual = states(cost_rows[c], t + 1) - cost_refs[c];
+                H.noalias() += (2 * cost_weights[c]) * S.row(cost_rows[c]).transpose() * S.row(cost_rows[c]);
+                g.noalias() += (2 * cost_weights[c] * residual) * S.row(cost_rows[c]).transpose();
+            }
+        }
+
+        // 2. Actuator magnitude and smoothness costs
+        for(int i = 0; i < M; i++)
+        {
+            H(i, i) += 2 * config.delta_w;
+            g[i] += 2 * config.delta_w * u[i];
+            H(M + i, M + i) += 2 * config.a_w;
+            g[M + i] += 2 * config.a_w * u[M + i];
+        }
+        for(int i = 0; i + 1 < M; i++)
+        {
+            AddDiffCost(H, g, u, i, i + 1, config.delta_diff_w);
+            AddDiffCost(H, g, u, M + i, M + i + 1, config.a_diff_w);
+        }
+
+        // 3. Actuator limits relative to the nominal actuations
+        for(int i = 0; i < M; i++)
+        {
+            lower[i] = -K_MAX_DELTA - u[i];
+            upper[i] = K_MAX_DELTA - u[i];
+            lower[M + i] = -K_MAX_ACCELERATION - u[M + i];
+            upper[M + i] = K_MAX_ACCELERATION - u[M + i];
+        }
+
+        du.setZero();
+        converged = qp.Solve(H, g, lower, upper, du);
+        sl.iterations += qp.iterations;
+        u += du;
+    }
+
+    // The actuations are always within the limits, so the solution can be used even if the QP didn't converge
+    sl.ok = converged;
+    sl.feasible = true;
+    sl.dt_vals = stage_dt;
+    State s = state.head<6>();
+    for(int t = 0; t < M; t++)
+    {
+        sl.delta_vals.push_back(u[t]);
+        sl.a_vals.push_back(u[M + t]);
+        s = LtvStep(s, u[t], u[M + t], coeffs, stage_dt[t], A, B);
+        sl.x_vals.push_back(s[0]);
+        sl.y_vals.push_back(s[1]);
+    }
+    sl.delta = sl.delta_vals[0];
+    sl.acceleration = sl.a_vals[0];
+
+    return sl;
+}
@@ -0,0 +1,45 @@
+#ifndef MPC_LTV_MPC_H
+#define MPC_LTV_MPC_H
+
+#include <vector>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+#include "box_qp.h"
+
+using namespace std;
+
+// Maximum number of points of the linear time-varying controller, longer horizons are rejected
+const int K_LTV_MAX_POINTS = K_QP_MAX_VARS / 2 + 1;
+
+typedef Eigen::Matrix<double, 6, 1> LtvState;
+typedef Eigen::Matrix<double, 6, 6> LtvStateJacobian;
+typedef Eigen::Matrix<double, 6, 2> LtvInputJacobian;
+
+// Model equations of FG_eval for one time step of the state [x, y, psi, v, cte, epsi].
+// A and B are filled with the Jacobians with respect to the state and the actuations [delta, a].
+LtvState LtvStep(const LtvState &s, double delta, double a, const Eigen::VectorXd &coeffs, double dt,
+                 LtvStateJacobian &A, LtvInputJacobian &B);
+
+// Linear time-varying MPC of the polynomial formulation.
+// The model of FG_eval is linearized along the nominal trajectory rolled out from the current state
+// with the previous plan shifted to the current time. States are eliminated (condensed), so the problem
+// becomes a dense QP over the actuations with only their limits as constraints, which is solved by BoxQP.
+// The solution is used as the next nominal trajectory, the problem is relinearized a few times.
+class LtvMpc
+{
+    public:
+        // state is [x, y, psi, v, cte, epsi], delta_guess and a_guess are the previous plan shifted to now,
+        // they can be empty or shorter than the horizon.
+        // Returns an infeasible solution if points_num is more than K_LTV_MAX_POINTS.
+        MPCSolution Solve(const Eigen::VectorXd &state, const Eigen::VectorXd &coeffs, int points_num,
+                          const vector<double> &delta_guess, const vector<double> &a_guess);
+
+        // number of linearizations
+        int linearizations = 2;
+
+    private:
+        BoxQP qp;
+};
+
+#endif //MPC_LTV_MPC_H
@@ -1,4 +1,5 @@
 #include <uWS/uWS.h>
+#include <chrono>
 #include <thread>
 #include "Eigen-3.3/Eigen/Core"
 #include "MPC.h"
@@ -7,6 +8,12 @@
 #include "config.h"
 #include "utils.h"
 #include "processor.h"
+#include "metrics.h"
+#include "track_map.h"
+#include "track_db.h"
+#include "explicit_table.h"
+#include "mlp_policy.h"
+#include "config_file.h"
 
 // for convenience
 using json = nlohmann::json;
@@ -14,15 +21,114 @@ using json = nlohmann::json;
 //settings for 60mp/h speed max
 Config Config::Instance = Config60();
 
+//controller events counters
+Metrics Metrics::Instance;
+
 //telemetry data processor
 Processor processor;
 
+//preprocessed track, it is loaded once at startup
+//either from csv waypoints or from the memory mapped track database (.trk, see track_convert)
+TrackMap track_map;
+TrackDatabase track_db;
+
+//explicit MPC table (.mpct, see table_build), used if Config::solver is ExplicitTable
+ExplicitTable explicit_table;
+
+//distilled policy (.mlp, see policy_train), used as the primary controller if Config::policy_primary is set
+MlpPolicy policy;
+
+//watches the config file (.cfg, see config_file.h) and publishes its changes while driving
+std::unique_ptr<ConfigWatcher> config_watcher;
+
+static bool EndsWith(const string &s, const string &suffix)
+{
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
 // 1. Extract telemetry data from the message
 // 2. Send it to Processor class
 // 3. Get processing result and send it back to simulator
 
-int main()
+int main(int argc, char *argv[])
 {
+    // track waypoints file or track database can be passed as the first argument
+    string track_path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+    bool is_db = EndsWith(track_path, ".trk");
+    Track *track = is_db ? (Track *)&track_db : (Track *)&track_map;
+    if (is_db ? track_db.Open(track_path) : track_map.LoadCsv(track_path))
+    {
+        std::cout << "Loaded track " << track_path << std::endl;
+        processor.SetTrackMap(track);
+    }
+    else
+    {
+        std::cout << "Track map " << track_path << " is not loaded, using telemetry waypoints" << std::endl;
+    }
+
+    // explicit MPC table (.mpct), distilled policy (.mlp) and config file (.cfg) can follow the track
+    for (int i = 2; i < argc; i++)
+    {
+        string path = argv[i];
+        if (EndsWith(path, ".mpct"))
+        {
+            if (explicit_table.Open(path))
+            {
+                std::cout << "Loaded explicit MPC table " << path << std::endl;
+                processor.SetExplicitTable(&explicit_table);
+            }
+            else
+            {
+                std::cout << "Explicit MPC table " << path << " is not loaded, solving online" << std::endl;
+            }
+        }
+        else if (EndsWith(path, ".mlp"))
+        {
+            if (policy.Load(path))
+            {
+                std::cout << "Loaded policy " << path << std::endl;
+                processor.SetPolicy(&policy);
+            }
+            else
+            {
+                std::cout << "Policy " << path << " is not loaded" << std::endl;
+            }
+        }
+        else if (EndsWith(path, ".cfg"))
+        {
+            Config config;
+            string error;
+            if (LoadConfigFile(path, config, error))
+            {
+                std::cout << "Loaded config " << path << std::endl;
+                Config::Publish(config);
+            }
+            else
+            {
+                std::cout << "Config is not loaded: " << error << std::endl;
+            }
+            config_watcher.reset(new ConfigWatcher(path, []() { processor.OnConfigChanged(); }));
+        }
+    }
+
+    // several IPOPT solves can run at once only with a thread safe linear solver, otherwise they take turns
+    if (MPC::ConcurrentSolves(Config::GetConfig()))
+    {
+        std::cout << "IPOPT solves can run concurrently" << std::endl;
+    }
+    else
+    {
+        std::cout << "IPOPT solves are serialized, multi-start is disabled: the linear solver is not thread safe"
+                  << std::endl;
+    }
+
+    // solve with every preset once, so switching between them costs nothing while driving
+    if (Config::GetConfig().preset_schedule)
+    {
+        processor.WarmUpPresets();
+        std::cout << "Warmed up the speed presets" << std::endl;
+    }
+
     uWS::Hub h;
 
     // MPC is initialized here!
@@ -31,6 +137,9 @@ int main()
     h.onMessage([&mpc](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length,
                      uWS::OpCode opCode)
     {
+        // the telemetry describes the car at this time, the delay until the command is sent is measured from it
+        auto received = std::chrono::steady_clock::now();
+
         // "42" at the start of the message means there's a websocket message event.
         // The 4 signifies a websocket message
         // The 2 signifies a websocket event
@@ -59,7 +168,7 @@ int main()
 
                     // 2. Send it to Processor class
                     Response response = processor.Process(ptsx, ptsy, px, py, psi, v,
-                                                          throttle, steering_angle);
+                                                          throttle, steering_angle, received);
 
 
                     // 3. Get processing result and send it back to simulator
@@ -84,6 +193,7 @@ int main()
 
                     auto msg = "42[\"steer\"," + msgJson.dump() + "]";
                     ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
+                    processor.CommandSent(response, received, std::chrono::steady_clock::now());
                 }
             }
             else
@@ -123,6 +233,7 @@ int main()
     {
         ws.close();
         std::cout << "Disconnected" << std::endl;
+        Metrics::Instance.Print(std::cout);
     });
 
     int port = 4567;
@@ -0,0 +1,118 @@
+#ifndef MPC_METRICS_H
+#define MPC_METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+// Counters of the controller events. They are updated from the solver code, so they are atomic.
+class Metrics
+{
+    public:
+        static Metrics Instance;
+
+        // Number of processed telemetry messages
+        std::atomic<uint64_t> cycles{0};
+
+        // Number of optimizer runs and how many of them reported success or stopped at an acceptable point
+        std::atomic<uint64_t> solves{0};
+        std::atomic<uint64_t> solve_success{0};
+        std::atomic<uint64_t> solve_acceptable{0};
+
+        // Number of optimizer runs stopped because of the wall clock deadline
+        std::atomic<uint64_t> deadline_stops{0};
+
+        // Fallbacks used when the optimizer didn't return a solution in time:
+        // the final point of the stopped optimizer if it is feasible and the best one,
+        // the best feasible iterate of the stopped optimizer,
+        // the previous plan shifted by the time passed since it was found,
+        // the geometric controller.
+        std::atomic<uint64_t> fallback_final_point{0};
+        std::atomic<uint64_t> fallback_best_iterate{0};
+        std::atomic<uint64_t> fallback_previous_plan{0};
+        std::atomic<uint64_t> fallback_geometric{0};
+
+        // Asynchronous solving: commands interpolated from the plan while the optimizer runs in the background
+        // and problems replaced by newer ones before the optimizer started them.
+        // Tracking commands are the plan ones corrected by the tracking law (see Config::tracking_law).
+        std::atomic<uint64_t> plan_commands{0};
+        std::atomic<uint64_t> tracking_commands{0};
+        std::atomic<uint64_t> replaced_problems{0};
+
+        // LtvQp problems longer than K_LTV_MAX_POINTS solved as ParallelLtv
+        std::atomic<uint64_t> ltv_long_horizons{0};
+
+        // Explicit MPC: problems answered from the table and problems outside of it solved online
+        std::atomic<uint64_t> table_hits{0};
+        std::atomic<uint64_t> table_misses{0};
+
+        // Solution cache: optimizer runs started from a cached solution and from zeros, and their iterations
+        std::atomic<uint64_t> cache_hits{0};
+        std::atomic<uint64_t> cache_misses{0};
+        std::atomic<uint64_t> cache_hit_iterations{0};
+        std::atomic<uint64_t> cache_miss_iterations{0};
+
+        // Distilled policy: its commands, optimizer solves checking it and how many of them disagreed
+        std::atomic<uint64_t> policy_commands{0};
+        std::atomic<uint64_t> policy_checks{0};
+        std::atomic<uint64_t> policy_disagreements{0};
+
+        // Multi-start: candidate problems solved concurrently and how many times the best plan was not
+        // the one of the heuristic horizon with the current preset
+        std::atomic<uint64_t> multi_start_candidates{0};
+        std::atomic<uint64_t> multi_start_switches{0};
+
+        // Preset schedule: cycles the scheduled target speed changed
+        std::atomic<uint64_t> preset_switches{0};
+
+        // Solve time governor: cycles the number of points was reduced to fit the predicted solve time
+        std::atomic<uint64_t> governor_shortened{0};
+
+        // Speculative solves: messages answered with the solution found before they arrived and the rest
+        std::atomic<uint64_t> speculative_hits{0};
+        std::atomic<uint64_t> speculative_misses{0};
+
+        // Commands of the geometric controller mode (see Config::controller) and switches to it by the overload governor
+        std::atomic<uint64_t> geometric_commands{0};
+        std::atomic<uint64_t> overload_switches{0};
+
+        // Config reloads, the cached solutions solved again with the new config and the rebuilds cancelled
+        // by a newer reload
+        std::atomic<uint64_t> config_reloads{0};
+        std::atomic<uint64_t> cache_rebuild_solves{0};
+        std::atomic<uint64_t> cancelled_rebuilds{0};
+
+        static double MeanIterations(uint64_t iterations, uint64_t runs)
+        {
+            return runs > 0 ? (double)iterations / runs : 0;
+        }
+
+        void Print(std::ostream &out) const
+        {
+            out << "cycles " << cycles
+                << ", solves " << solves << " (success " << solve_success << ", acceptable " << solve_acceptable
+                << ", deadline stops " << deadline_stops << ")"
+                << ", fallbacks: final point " << fallback_final_point << ", best iterate " << fallback_best_iterate
+                << ", previous plan " << fallback_previous_plan
+                << ", geometric " << fallback_geometric
+                << ", plan commands " << plan_commands << " (tracking " << tracking_commands << ")"
+                << ", replaced problems " << replaced_problems
+                << ", long ltv horizons " << ltv_long_horizons
+                << ", table hits " << table_hits << ", table misses " << table_misses
+                << ", cache hits " << cache_hits << " (" << MeanIterations(cache_hit_iterations, cache_hits) << " iterations)"
+                << ", cache misses " << cache_misses << " (" << MeanIterations(cache_miss_iterations, cache_misses)
+                << " iterations)"
+                << ", policy commands " << policy_commands << " (checks " << policy_checks
+                << ", disagreements " << policy_disagreements << ")"
+                << ", multi-start candidates " << multi_start_candidates << " (switches " << multi_start_switches << ")"
+                << ", preset switches " << preset_switches
+                << ", governor shortened " << governor_shortened
+                << ", speculative hits " << speculative_hits << ", misses " << speculative_misses
+                << ", geometric commands " << geometric_commands << " (overload switches " << overload_switches << ")"
+                << ", config reloads " << config_reloads << " (cache rebuild solves " << cache_rebuild_solves
+                << ", cancelled rebuilds " << cancelled_rebuilds << ")"
+                << std::endl;
+        }
+};
+
+#endif //MPC_METRICS_H
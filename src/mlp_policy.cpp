@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "mlp_policy.h"
+#include "MPC.h"
+
+void MlpWeights::Resize(uint32_t hidden)
+{
+    this->hidden = hidden;
+    w1.assign(K_PROBLEM_FEATURES * hidden, 0);
+    b1.assign(hidden, 0);
+    w2.assign(hidden * hidden, 0);
+    b2.assign(hidden, 0);
+    w3.assign(K_MLP_OUTPUTS * hidden, 0);
+    b3.assign(K_MLP_OUTPUTS, 0);
+}
+
+vector<vector<float> *> MlpWeights::Tensors()
+{
+    return {&w1, &b1, &w2, &b2, &w3, &b3};
+}
+
+bool WriteMlpPolicy(const string &path, const MlpPolicyHeader &header, MlpWeights &weights)
+{
+    MlpPolicyHeader file_header = header;
+    memcpy(file_header.magic, K_MLP_POLICY_MAGIC, sizeof(file_header.magic));
+    file_header.version = K_MLP_POLICY_VERSION;
+    file_header.hidden = weights.hidden;
+
+    ofstream file(path, ios::binary | ios::trunc);
+    if(!file.is_open())
+    {
+        return false;
+    }
+
+    file.write((const char *)&file_header, sizeof(file_header));
+    for(vector<float> *tensor : weights.Tensors())
+    {
+        file.write((const char *)tensor->data(), tensor->size() * sizeof(float));
+    }
+    return file.good();
+}
+
+bool MlpPolicy::Load(const string &path)
+{
+    weights = MlpWeights();
+
+    ifstream file(path, ios::binary);
+    if(!file.read((char *)&header, sizeof(header)))
+    {
+        return false;
+    }
+
+    bool valid = memcmp(header.magic, K_MLP_POLICY_MAGIC, sizeof(header.magic)) == 0
+                 && header.version == K_MLP_POLICY_VERSION
+                 && header.hidden > 0 && header.hidden <= K_MLP_MAX_HIDDEN && header.hidden % 4 == 0;
+    if(!valid)
+    {
+        return false;
+    }
+
+    MlpWeights loaded;
+    loaded.Resize(header.hidden);
+    for(vector<float> *tensor : loaded.Tensors())
+    {
+        if(!file.read((char *)tensor->data(), tensor->size() * sizeof(float)))
+        {
+            return false;
+        }
+    }
+
+    weights = loaded;
+    return true;
+}
+
+bool MlpPolicy::Matches(const Config &config) const
+{
+    return IsLoaded() && config.MatchesKey(header.config);
+}
+
+// Computes activations of a hidden layer: out = MlpActivation(w * in + b), w is stored by columns.
+// out_num is a multiple of 4.
+static void HiddenLayer(const float *w, const float *b, const float *in, int in_num, int out_num, float *out)
+{
+#ifdef __SSE2__
+    const __m128 limit = _mm_set1_ps(3);
+    const __m128 c27 = _mm_set1_ps(27);
+    const __m128 c9 = _mm_set1_ps(9);
+    for(int i = 0; i < out_num; i += 4)
+    {
+        __m128 sum = _mm_loadu_ps(b + i);
+        for(int j = 0; j < in_num; j++)
+        {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(w + j * out_num + i), _mm_set1_ps(in[j])));
+        }
+
+        // MlpActivation of 4 values
+        __m128 x = _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), limit), _mm_min_ps(sum, limit));
+        __m128 x2 = _mm_mul_ps(x, x);
+        __m128 numerator = _mm_mul_ps(x, _mm_add_ps(c27, x2));
+        __m128 denominator = _mm_add_ps(c27, _mm_mul_ps(c9, x2));
+        _mm_storeu_ps(out + i, _mm_div_ps(numerator, denominator));
+    }
+#else
+    for(int i = 0; i < out_num; i++)
+    {
+        float sum = b[i];
+        for(int j = 0; j < in_num; j++)
+        {
+            sum += w[j * out_num + i] * in[j];
+        }
+        out[i] = MlpActivation(sum);
+    }
+#endif
+}
+
+// Dot product of two arrays, size is a multiple of 4
+static float Dot(const float *a, const float *b, int size)
+{
+#ifdef __SSE2__
+    __m128 sum = _mm_setzero_ps();
+    for(int i = 0; i < size; i += 4)
+    {
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    float parts[4];
+    _mm_storeu_ps(parts, sum);
+    return (parts[0] + parts[1]) + (parts[2] + parts[3]);
+#else
+    float sum = 0;
+    for(int i = 0; i < size; i++)
+    {
+        sum += a[i] * b[i];
+    }
+    return sum;
+#endif
+}
+
+void MlpPolicy::Evaluate(double v, const Eigen::VectorXd &coeffs, double &delta, double &a) const
+{
+    double features[K_PROBLEM_FEATURES] = {v, coeffs[0], atan(-coeffs[1]), coeffs[2], coeffs[3]};
+    EvaluateFeatures(features, delta, a);
+}
+
+void MlpPolicy::EvaluateFeatures(const double features[K_PROBLEM_FEATURES], double &delta, double &a) const
+{
+    int hidden = (int)weights.hidden;
+    float input[K_PROBLEM_FEATURES];
+    for(int i = 0; i < K_PROBLEM_FEATURES; i++)
+    {
+        input[i] = (float)((features[i] - header.input_center[i]) * header.input_scale[i]);
+    }
+
+    float layer1[K_MLP_MAX_HIDDEN];
+    float layer2[K_MLP_MAX_HIDDEN];
+    HiddenLayer(weights.w1.data(), weights.b1.data(), input, K_PROBLEM_FEATURES, hidden, layer1);
+    HiddenLayer(weights.w2.data(), weights.b2.data(), layer1, hidden, hidden, layer2);
+
+    float outputs[K_MLP_OUTPUTS];
+    for(int o = 0; o < K_MLP_OUTPUTS; o++)
+    {
+        outputs[o] = weights.b3[o] + Dot(weights.w3.data() + o * hidden, layer2, hidden);
+        outputs[o] = max(-1.f, min(outputs[o], 1.f));
+    }
+
+    delta = outputs[0] * K_MAX_DELTA;
+    a = outputs[1] * K_MAX_ACCELERATION;
+}
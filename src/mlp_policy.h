@@ -0,0 +1,105 @@
+#ifndef MPC_MLP_POLICY_H
+#define MPC_MLP_POLICY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "config.h"
+#include "offline_solve.h"
+
+using namespace std;
+
+// Policy file format: [MlpPolicyHeader][float weights, see MlpWeights]
+const char K_MLP_POLICY_MAGIC[8] = {'M', 'P', 'C', 'P', 'O', 'L', 'C', 'Y'};
+const uint32_t K_MLP_POLICY_VERSION = 1;
+
+// Outputs are steering and acceleration divided by their limits
+const int K_MLP_OUTPUTS = 2;
+
+// Maximum number of neurons of a hidden layer, the number must be a multiple of 4 (see MlpPolicy::Evaluate)
+const int K_MLP_MAX_HIDDEN = 64;
+
+struct MlpPolicyHeader
+{
+    char magic[8];
+    uint32_t version;
+
+    // neurons of each of the two hidden layers
+    uint32_t hidden;
+
+    // the policy imitates the optimizer with this config, see Config::GetKey
+    double config[K_CONFIG_KEY_SIZE];
+
+    // inputs are (features - center) * scale
+    double input_center[K_PROBLEM_FEATURES];
+    double input_scale[K_PROBLEM_FEATURES];
+};
+
+// Weights of the network: features -> hidden -> hidden -> outputs.
+// Hidden layers are stored by columns (all the weights of one input are sequential),
+// so 4 neurons are computed at once. The output layer is stored by rows.
+struct MlpWeights
+{
+    uint32_t hidden = 0;
+    vector<float> w1, b1;
+    vector<float> w2, b2;
+    vector<float> w3, b3;
+
+    // allocates zero weights for the given number of hidden neurons
+    void Resize(uint32_t hidden);
+
+    // all the weights, so they can be written and trained as one list
+    vector<vector<float> *> Tensors();
+};
+
+// Activation of the hidden layers: Pade approximation of tanh, exact at 0 and saturated at +-3 with zero slope.
+// Unlike tanh it needs no exp, so it is vectorized with a few multiplications and one division.
+inline float MlpActivation(float x)
+{
+    x = std::max(-3.f, std::min(x, 3.f));
+    return x * (27 + x * x) / (27 + 9 * x * x);
+}
+
+// Derivative of MlpActivation, used for training
+inline float MlpActivationDerivative(float x)
+{
+    if(x <= -3 || x >= 3)
+    {
+        return 0;
+    }
+    float ratio = (9 - x * x) / (3 + x * x);
+    return ratio * ratio / 9;
+}
+
+// Writes the policy. Returns false if the file can't be written.
+bool WriteMlpPolicy(const string &path, const MlpPolicyHeader &header, MlpWeights &weights);
+
+// Small neural network distilled from the optimizer solutions (see policy_train.cpp).
+// Inputs are the problem features (velocity, cte, epsi, quadratic and cubic coefficients), outputs are the first actuations.
+class MlpPolicy
+{
+    public:
+        // Reads the policy. Returns false if the file can't be read or has a wrong format.
+        bool Load(const string &path);
+
+        bool IsLoaded() const { return weights.hidden > 0; }
+
+        // Returns true if the policy was trained with the config
+        bool Matches(const Config &config) const;
+
+        // Computes the first actuations for velocity v and the polynomial in car's coordinates.
+        // It doesn't allocate, the hidden layers are computed with SSE 4 neurons at a time.
+        void Evaluate(double v, const Eigen::VectorXd &coeffs, double &delta, double &a) const;
+
+        // Computes the outputs for the problem features, see Evaluate
+        void EvaluateFeatures(const double features[K_PROBLEM_FEATURES], double &delta, double &a) const;
+
+    private:
+        MlpPolicyHeader header;
+        MlpWeights weights;
+};
+
+#endif //MPC_MLP_POLICY_H
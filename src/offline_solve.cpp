@@ -0,0 +1,81 @@
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "offline_solve.h"
+#include "MPC.h"
+
+// Time given to the optimizer for one problem, offline there is no need to hurry
+const double K_SOLVE_TIMEOUT = 5;
+
+bool SolveFeatures(const double features[K_PROBLEM_FEATURES], int points_num, double &delta, double &a)
+{
+    Eigen::VectorXd coeffs(4);
+    coeffs << features[1], -tan(features[2]), features[3], features[4];
+    Eigen::VectorXd state(6);
+    state << 0., 0., 0., features[0], features[1], features[2];
+
+    auto timeout = chrono::duration<double>(K_SOLVE_TIMEOUT);
+    MPC mpc;
+    mpc.SetDeadline(chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(timeout));
+    MPCSolution solution = mpc.Solve(state, coeffs, points_num);
+    delta = solution.delta;
+    a = solution.acceleration;
+    return solution.ok;
+}
+
+vector<uint8_t> RunWorkerProcesses(size_t count, int workers, size_t result_size, function<void(size_t, void *)> task)
+{
+    vector<uint8_t> results(count * result_size);
+    size_t bytes = max((size_t)1, count * result_size);
+    void *mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(mapped == MAP_FAILED)
+    {
+        cerr << "Failed to map the results" << endl;
+        return results;
+    }
+    uint8_t *shared = (uint8_t *)mapped;
+    memset(shared, 0, bytes);
+
+    vector<pid_t> children;
+    for(int w = 0; w < workers; w++)
+    {
+        pid_t pid = fork();
+        if(pid == 0)
+        {
+            for(size_t i = w; i < count; i += workers)
+            {
+                task(i, shared + i * result_size);
+            }
+            _exit(0);
+        }
+        if(pid > 0)
+        {
+            children.push_back(pid);
+        }
+    }
+    for(pid_t pid : children)
+    {
+        waitpid(pid, nullptr, 0);
+    }
+
+    memcpy(results.data(), shared, count * result_size);
+    munmap(mapped, bytes);
+    return results;
+}
+
+vector<WorkerResult> RunWorkers(size_t count, int workers, function<bool(size_t, double &, double &)> solve)
+{
+    return RunWorkerProcesses<WorkerResult>(count, workers, [&solve](size_t i, WorkerResult &result) {
+        double delta = 0;
+        double a = 0;
+        result.ok = solve(i, delta, a) ? 1 : 0;
+        result.delta = (float)delta;
+        result.a = (float)a;
+    });
+}
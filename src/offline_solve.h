@@ -0,0 +1,58 @@
+#ifndef MPC_OFFLINE_SOLVE_H
+#define MPC_OFFLINE_SOLVE_H
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+using namespace std;
+
+// Helpers of the offline tools which solve the polynomial formulation for many problems
+// (table_build.cpp, policy_train.cpp) or run many closed-loop laps (autotune.cpp).
+//
+// A problem is given by its features: velocity (m/s), cte (m), epsi (rad), quadratic and cubic polynomial coefficients.
+// The state of the polynomial formulation is [0, 0, 0, v, coeffs[0], atan(-coeffs[1])],
+// so together with the config and the number of points they define the whole problem.
+const int K_PROBLEM_FEATURES = 5;
+
+// Region of the features covered by the offline solutions
+const double K_FEATURES_MIN[K_PROBLEM_FEATURES] = {4, -2, -0.3, -0.02, -0.0004};
+const double K_FEATURES_MAX[K_PROBLEM_FEATURES] = {36, 2, 0.3, 0.02, 0.0004};
+
+// Result of one problem solved by a worker
+struct WorkerResult
+{
+    float delta;
+    float a;
+    uint8_t ok;
+};
+
+// Solves the problem with MPC::Solve and the current config. Returns false if the optimizer didn't converge.
+bool SolveFeatures(const double features[K_PROBLEM_FEATURES], int points_num, double &delta, double &a);
+
+// Runs task(i, result) for i in [0, count) in worker processes, every task writes result_size bytes
+// to its slot of a shared mapping (zeroed before the start). Returns the slots one after another.
+// IPOPT with MUMPS and CppAD tapes are not meant to be used from several threads at once,
+// so every worker is a separate process.
+vector<uint8_t> RunWorkerProcesses(size_t count, int workers, size_t result_size, function<void(size_t, void *)> task);
+
+// RunWorkerProcesses with results of a trivially copyable type
+template <class Result>
+vector<Result> RunWorkerProcesses(size_t count, int workers, function<void(size_t, Result &)> task)
+{
+    vector<uint8_t> bytes = RunWorkerProcesses(count, workers, sizeof(Result), [&task](size_t i, void *result) {
+        task(i, *(Result *)result);
+    });
+    vector<Result> results(count);
+    if(count > 0)
+    {
+        memcpy(results.data(), bytes.data(), count * sizeof(Result));
+    }
+    return results;
+}
+
+// Solves problems [0, count) in worker processes, solve(i, delta, a) returns false if the problem failed.
+vector<WorkerResult> RunWorkers(size_t count, int workers, function<bool(size_t, double &, double &)> solve);
+
+#endif //MPC_OFFLINE_SOLVE_H
@@ -0,0 +1,29 @@
+#include "overload_governor.h"
+
+#include "metrics.h"
+
+bool OverloadGovernor::AllowSolve(double time) const
+{
+    return !shedding || time >= probe_time;
+}
+
+void OverloadGovernor::Record(const Config &config, double time, bool in_time)
+{
+    if(in_time)
+    {
+        late_solves = 0;
+        shedding = false;
+        return;
+    }
+
+    late_solves++;
+    if(!shedding && late_solves >= config.overload_cycles)
+    {
+        Metrics::Instance.overload_switches++;
+        shedding = true;
+    }
+    if(shedding)
+    {
+        probe_time = time + config.overload_probe_period;
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef MPC_OVERLOAD_GOVERNOR_H
+#define MPC_OVERLOAD_GOVERNOR_H
+
+#include "config.h"
+
+// Sheds the optimizer load when the host can't solve in time (see Config::overload_governor).
+// After Config::overload_cycles consecutive solves which ran into the deadline the geometric controller takes over,
+// so the commands are sent in time instead of after every stopped solve. While it is in control the optimizer is
+// tried once every Config::overload_probe_period seconds and the first solve which finishes in time ends the shedding.
+class OverloadGovernor
+{
+    public:
+        // Returns true if the optimizer may solve at the given time (seconds)
+        bool AllowSolve(double time) const;
+
+        // Records whether the solve started at the given time finished before its deadline
+        void Record(const Config &config, double time, bool in_time);
+
+        bool IsShedding() const
+        {
+            return shedding;
+        }
+
+    private:
+        int late_solves = 0;
+        bool shedding = false;
+
+        // time of the next probe solve while shedding
+        double probe_time = 0;
+};
+
+#endif //MPC_OVERLOAD_GOVERNOR_H
@@ -0,0 +1,397 @@
+#include "parallel_ltv.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "config.h"
+#include "utils.h"
+
+// The QP of the horizon is solved when the gradient of the free actuations is below this
+const double K_NEWTON_TOLERANCE = 1e-6;
+
+// Sufficient decrease of the line search and the number of its step halvings
+const double K_ARMIJO = 1e-4;
+const int K_LINE_SEARCH_STEPS = 20;
+
+// States of the nominal trajectory at every step
+typedef vector<LtvState, Eigen::aligned_allocator<LtvState>> NominalStates;
+
+// Deviations of the states of a segment as a linear function of its variables
+typedef Eigen::Matrix<double, 6, Eigen::Dynamic, 0, 6, K_QP_MAX_VARS> SegmentSensitivity;
+
+// Adds weight * (u_i + x[i] - u_j - x[j])**2 to the QP over the deviations x from the nominal actuations u_i and u_j
+static void AddDiffCost(QpMatrix &H, QpVector &g, int i, int j, double u_i, double u_j, double weight)
+{
+    H(i, i) += 2 * weight;
+    H(j, j) += 2 * weight;
+    H(i, j) -= 2 * weight;
+    H(j, i) -= 2 * weight;
+    g[i] += 2 * weight * (u_i - u_j);
+    g[j] += 2 * weight * (u_j - u_i);
+}
+
+void ParallelLtvMpc::ForEachSegment(const function<void(Segment &segment, size_t index)> &work)
+{
+    size_t workers = pool == nullptr ? 1 : max((size_t)1, pool->Size());
+    size_t chunks = min(workers, segments.size());
+    vector<function<void()>> tasks;
+    for(size_t c = 0; c < chunks; c++)
+    {
+        size_t first = segments.size() * c / chunks;
+        size_t last = segments.size() * (c + 1) / chunks;
+        tasks.push_back([this, &work, first, last]() {
+            for(size_t k = first; k < last; k++)
+            {
+                work(segments[k], k);
+            }
+        });
+    }
+
+    if(pool == nullptr)
+    {
+        for(const function<void()> &task : tasks)
+        {
+            task();
+        }
+        return;
+    }
+    pool->Run(tasks);
+}
+
+double ParallelLtvMpc::RollOut(bool use_next)
+{
+    double cost = 0;
+    for(size_t k = 0; k < segments.size(); k++)
+    {
+        Segment &segment = segments[k];
+        QpVector &x = use_next ? segment.next_x : segment.x;
+        if(segment.boundary >= 0)
+        {
+            const Segment &previous = segments[k - 1];
+            x.segment<K_BOUNDARY_SIZE>(segment.boundary).noalias() =
+                previous.end * (use_next ? previous.next_x : previous.x);
+        }
+        cost += 0.5 * x.dot(segment.H * x) + segment.g.dot(x);
+    }
+    return cost;
+}
+
+bool ParallelLtvMpc::SolveHorizon(int max_iterations, int &iterations)
+{
+    double cost = RollOut(false);
+    for(int iteration = 0; iteration < max_iterations; iteration++)
+    {
+        iterations++;
+
+        // 1. Gradients: the one of the boundary is passed to the previous segment
+        Boundary tail_gradient = Boundary::Zero();
+        for(size_t k = segments.size(); k-- > 0;)
+        {
+            Segment &segment = segments[k];
+            segment.gradient.noalias() = segment.H * segment.x + segment.g;
+            segment.total_gradient = segment.gradient;
+            segment.total_gradient.noalias() += segment.end.transpose() * tail_gradient;
+            if(segment.boundary >= 0)
+            {
+                tail_gradient = segment.total_gradient.segment<K_BOUNDARY_SIZE>(segment.boundary);
+            }
+        }
+
+        // 2. The actuation is fixed if it is at the bound and the gradient pushes it outside
+        double projected_gradient = 0;
+        for(Segment &segment : segments)
+        {
+            segment.free_num = 0;
+            for(int i = 0; i < 2 * segment.steps; i++)
+            {
+                double gradient = segment.total_gradient[i];
+                bool at_lower = segment.x[i] <= segment.lower[i] + 1e-12 && gradient > 0;
+                bool at_upper = segment.x[i] >= segment.upper[i] - 1e-12 && gradient < 0;
+                if(!at_lower && !at_upper)
+                {
+                    segment.free_vars[segment.free_num++] = i;
+                    projected_gradient = max(projected_gradient, fabs(gradient));
+                }
+            }
+        }
+        if(projected_gradient <= K_NEWTON_TOLERANCE)
+        {
+            return true;
+        }
+
+        // 3. Riccati recursion backwards: the cost of the rest of the horizon is a quadratic function of the boundary
+        // after the free actuations of the segments minimize it, 0.5 * b' * P * b + p' * b
+        BoundaryMatrix P = BoundaryMatrix::Zero();
+        Boundary p = Boundary::Zero();
+        for(size_t k = segments.size(); k-- > 0;)
+        {
+            Segment &segment = segments[k];
+            QpMatrix Q = segment.H;
+            Q.noalias() += segment.end.transpose() * (P * segment.end);
+            QpVector q = segment.gradient;
+            q.noalias() += segment.end.transpose() * p;
+
+            int free_num = segment.free_num;
+            QpMatrix Q_free(free_num, free_num);
+            BoundaryGain Q_coupling(free_num, K_BOUNDARY_SIZE);
+            QpVector q_free(free_num);
+            for(int i = 0; i < free_num; i++)
+            {
+                int row = segment.free_vars[i];
+                for(int j = 0; j < free_num; j++)
+                {
+                    Q_free(i, j) = Q(row, segment.free_vars[j]);
+                }
+                if(segment.boundary >= 0)
+                {
+                    Q_coupling.row(i) = Q.block(row, segment.boundary, 1, K_BOUNDARY_SIZE);
+                }
+                q_free[i] = q[row];
+            }
+
+            segment.gain.setZero(free_num, K_BOUNDARY_SIZE);
+            segment.feedforward.setZero(free_num);
+            if(free_num > 0)
+            {
+                segment.ldlt.compute(Q_free);
+                segment.feedforward = segment.ldlt.solve(q_free);
+                if(segment.boundary >= 0)
+                {
+                    segment.gain = segment.ldlt.solve(Q_coupling);
+                }
+            }
+            if(segment.boundary >= 0)
+            {
+                P = Q.block<K_BOUNDARY_SIZE, K_BOUNDARY_SIZE>(segment.boundary, segment.boundary);
+                P.noalias() -= Q_coupling.transpose() * segment.gain;
+                P = (0.5 * (P + P.transpose())).eval();
+                p = q.segment<K_BOUNDARY_SIZE>(segment.boundary);
+                p.noalias() -= Q_coupling.transpose() * segment.feedforward;
+            }
+        }
+
+        // 4. Newton step forwards, the step of a boundary is the step of the end of the previous segment
+        Boundary boundary_step = Boundary::Zero();
+        for(Segment &segment : segments)
+        {
+            int n = (int)segment.x.size();
+            segment.step.setZero(n);
+            QpVector free_step = -segment.feedforward;
+            if(segment.boundary >= 0)
+            {
+                segment.step.segment<K_BOUNDARY_SIZE>(segment.boundary) = boundary_step;
+                free_step.noalias() -= segment.gain * boundary_step;
+            }
+            for(int i = 0; i < segment.free_num; i++)
+            {
+                segment.step[segment.free_vars[i]] = free_step[i];
+            }
+            boundary_step.noalias() = segment.end * segment.step;
+        }
+
+        // 5. Backtrack along the projection of the step onto the limits until the cost decreases enough,
+        // an iteration without such a step stops the solve
+        double alpha = 1;
+        double next_cost = cost;
+        double decrease = 0;
+        double change = 0;
+        bool accepted = false;
+        for(int k = 0; k < K_LINE_SEARCH_STEPS && !accepted; k++, alpha *= 0.5)
+        {
+            decrease = 0;
+            change = 0;
+            for(Segment &segment : segments)
+            {
+                int actuations = 2 * segment.steps;
+                segment.next_x = segment.x;
+                segment.next_x.head(actuations) = (segment.x.head(actuations) + alpha * segment.step.head(actuations))
+                                                      .cwiseMax(segment.lower.head(actuations))
+                                                      .cwiseMin(segment.upper.head(actuations));
+                QpVector difference = segment.next_x.head(actuations) - segment.x.head(actuations);
+                decrease += segment.total_gradient.head(actuations).dot(difference);
+                change = max(change, difference.lpNorm<Eigen::Infinity>());
+            }
+            next_cost = RollOut(true);
+            accepted = next_cost <= cost + K_ARMIJO * decrease;
+        }
+        if(!accepted)
+        {
+            return false;
+        }
+
+        for(Segment &segment : segments)
+        {
+            segment.x.swap(segment.next_x);
+        }
+        cost = next_cost;
+        if(change < 1e-14)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+MPCSolution ParallelLtvMpc::Solve(const Eigen::VectorXd &state, const Eigen::VectorXd &coeffs, int points_num,
+                                  const vector<double> &delta_guess, const vector<double> &a_guess)
+{
+    MPCSolution sl;
+    int M = points_num - 1;
+    if(M < 1)
+    {
+        return sl;
+    }
+
+    Config config = Config::GetConfig();
+    vector<double> stage_dt = config.GetStageDt(M);
+
+    // 1. Split the horizon into segments of equal length
+    int segment_steps = max(1, min(config.parallel_segment_steps, K_MAX_SEGMENT_STEPS));
+    int segments_num = (M + segment_steps - 1) / segment_steps;
+    segments.resize(segments_num);
+    for(int k = 0; k < segments_num; k++)
+    {
+        Segment &segment = segments[k];
+        segment.begin = M * k / segments_num;
+        segment.steps = M * (k + 1) / segments_num - segment.begin;
+        segment.boundary = k == 0 ? -1 : 2 * segment.steps;
+    }
+
+    // The nominal actuations are the previous plan shifted to now, its last actuation is held
+    vector<double> u_delta(M), u_a(M);
+    for(int i = 0; i < M; i++)
+    {
+        u_delta[i] = delta_guess.empty() ? 0 : delta_guess[min((size_t)i, delta_guess.size() - 1)];
+        u_a[i] = a_guess.empty() ? 0 : a_guess[min((size_t)i, a_guess.size() - 1)];
+        u_delta[i] = max(-K_MAX_DELTA, min(u_delta[i], K_MAX_DELTA));
+        u_a[i] = max(-K_MAX_ACCELERATION, min(u_a[i], K_MAX_ACCELERATION));
+    }
+
+    // weights and references of the state costs: cte, epsi and velocity
+    const int cost_rows[3] = {4, 5, 3};
+    const double cost_weights[3] = {config.cte_w, config.epsi_w, config.velocity_diff_w};
+    const double cost_refs[3] = {0, 0, config.target_v};
+
+    NominalStates states(M + 1);
+    LtvStateJacobian A;
+    LtvInputJacobian B;
+    bool converged = false;
+    sl.iterations = 0;
+    for(int l = 0; l < linearizations; l++)
+    {
+        // 2. Roll out the nominal trajectory
+        states[0] = state.head<6>();
+        for(int t = 0; t < M; t++)
+        {
+            states[t + 1] = LtvStep(states[t], u_delta[t], u_a[t], coeffs, stage_dt[t], A, B);
+        }
+
+        // 3. Condense every segment: its state deviations are S * x, S starts with the boundary
+        ForEachSegment([&](Segment &segment, size_t) {
+            int L = segment.steps;
+            int n = 2 * L + (segment.boundary >= 0 ? K_BOUNDARY_SIZE : 0);
+            segment.H.setZero(n, n);
+            segment.g.setZero(n);
+            segment.x.setZero(n);
+            segment.lower.resize(2 * L);
+            segment.upper.resize(2 * L);
+
+            SegmentSensitivity S = SegmentSensitivity::Zero(6, n);
+            if(segment.boundary >= 0)
+            {
+                S.block<6, 6>(0, segment.boundary).setIdentity();
+            }
+            LtvStateJacobian step_A;
+            LtvInputJacobian step_B;
+            for(int i = 0; i < L; i++)
+            {
+                int t = segment.begin + i;
+                LtvStep(states[t], u_delta[t], u_a[t], coeffs, stage_dt[t], step_A, step_B);
+                S = step_A * S;
+                S.col(i) += step_B.col(0);
+                S.col(L + i) += step_B.col(1);
+
+                for(int c = 0; c < 3; c++)
+                {
+                    double residual = states[t + 1][cost_rows[c]] - cost_refs[c];
+                    segment.H.noalias() += (2 * cost_weights[c]) * S.row(cost_rows[c]).transpose()
+                                           * S.row(cost_rows[c]);
+                    segment.g.noalias() += (2 * cost_weights[c] * residual) * S.row(cost_rows[c]).transpose();
+                }
+            }
+
+            // actuator magnitude and smoothness costs, the first actuation is smoothed against the boundary
+            for(int i = 0; i < L; i++)
+            {
+                int t = segment.begin + i;
+                segment.H(i, i) += 2 * config.delta_w;
+                segment.g[i] += 2 * config.delta_w * u_delta[t];
+                segment.H(L + i, L + i) += 2 * config.a_w;
+                segment.g[L + i] += 2 * config.a_w * u_a[t];
+            }
+            for(int i = 0; i + 1 < L; i++)
+            {
+                int t = segment.begin + i;
+                AddDiffCost(segment.H, segment.g, i, i + 1, u_delta[t], u_delta[t + 1], config.delta_diff_w);
+                AddDiffCost(segment.H, segment.g, L + i, L + i + 1, u_a[t], u_a[t + 1], config.a_diff_w);
+            }
+            if(segment.boundary >= 0)
+            {
+                int t = segment.begin;
+                AddDiffCost(segment.H, segment.g, segment.boundary + 6, 0, u_delta[t - 1], u_delta[t],
+                            config.delta_diff_w);
+                AddDiffCost(segment.H, segment.g, segment.boundary + 7, L, u_a[t - 1], u_a[t], config.a_diff_w);
+            }
+
+            // actuator limits relative to the nominal actuations
+            for(int i = 0; i < L; i++)
+            {
+                int t = segment.begin + i;
+                segment.lower[i] = -K_MAX_DELTA - u_delta[t];
+                segment.upper[i] = K_MAX_DELTA - u_delta[t];
+                segment.lower[L + i] = -K_MAX_ACCELERATION - u_a[t];
+                segment.upper[L + i] = K_MAX_ACCELERATION - u_a[t];
+            }
+
+            // the boundary with the next segment: the last state and actuations
+            segment.end.setZero(K_BOUNDARY_SIZE, n);
+            segment.end.topRows<6>() = S;
+            segment.end(6, L - 1) = 1;
+            segment.end(7, 2 * L - 1) = 1;
+        });
+
+        // 4. Solve the QP of the whole horizon
+        converged = SolveHorizon(config.parallel_iterations, sl.iterations);
+
+        // 5. The actuations of all the segments are the next nominal ones
+        for(const Segment &segment : segments)
+        {
+            for(int i = 0; i < segment.steps; i++)
+            {
+                int t = segment.begin + i;
+                u_delta[t] = max(-K_MAX_DELTA, min(u_delta[t] + segment.x[i], K_MAX_DELTA));
+                u_a[t] = max(-K_MAX_ACCELERATION, min(u_a[t] + segment.x[segment.steps + i], K_MAX_ACCELERATION));
+            }
+        }
+    }
+
+    // The actuations are always within the limits, so the solution can be used even if the QP is not solved exactly.
+    // The trajectory is rolled out with the model itself.
+    sl.ok = converged;
+    sl.feasible = true;
+    sl.dt_vals = stage_dt;
+    LtvState s = state.head<6>();
+    for(int t = 0; t < M; t++)
+    {
+        sl.delta_vals.push_back(u_delta[t]);
+        sl.a_vals.push_back(u_a[t]);
+        s = LtvStep(s, u_delta[t], u_a[t], coeffs, stage_dt[t], A, B);
+        sl.x_vals.push_back(s[0]);
+        sl.y_vals.push_back(s[1]);
+    }
+    sl.delta = sl.delta_vals[0];
+    sl.acceleration = sl.a_vals[0];
+
+    return sl;
+}
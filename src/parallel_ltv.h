@@ -0,0 +1,106 @@
+#ifndef MPC_PARALLEL_LTV_H
+#define MPC_PARALLEL_LTV_H
+
+#include <functional>
+#include <vector>
+
+#include "Eigen-3.3/Eigen/Cholesky"
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+#include "box_qp.h"
+#include "ltv_mpc.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+// Variables shared by the neighbouring segments: the state at the boundary and the actuations applied before it
+const int K_BOUNDARY_SIZE = 8;
+
+// Maximum number of steps of a segment, its QP has the actuations of the steps and the boundary variables
+const int K_MAX_SEGMENT_STEPS = (K_QP_MAX_VARS - K_BOUNDARY_SIZE) / 2;
+
+// Parallel-in-time linear time-varying MPC of the polynomial formulation for long horizons (SolverType::ParallelLtv).
+// The model is linearized along the nominal trajectory as in LtvMpc, but the horizon is split into segments
+// of Config::parallel_segment_steps. Every segment is condensed into a small QP over its actuations and the boundary
+// with the previous segment independently, on the threads of the pool. The QP of the whole horizon is solved exactly
+// by projected Newton iterations as in BoxQP: the Newton step is found by a Riccati recursion over the segments,
+// every segment is reduced to the Schur complement of its Hessian on its start boundary and passes it to the previous
+// one. An iteration costs linearly in the horizon and runs on the calling thread, only the condensation is parallel.
+class ParallelLtvMpc
+{
+    public:
+        // The segments are solved on the pool, nullptr solves them on the calling thread
+        explicit ParallelLtvMpc(ThreadPool *pool) : pool(pool) {}
+
+        // Same as LtvMpc::Solve without its limit of the horizon
+        MPCSolution Solve(const Eigen::VectorXd &state, const Eigen::VectorXd &coeffs, int points_num,
+                          const vector<double> &delta_guess, const vector<double> &a_guess);
+
+        // number of linearizations
+        int linearizations = 2;
+
+    private:
+        typedef Eigen::Matrix<double, K_BOUNDARY_SIZE, 1> Boundary;
+        typedef Eigen::Matrix<double, K_BOUNDARY_SIZE, Eigen::Dynamic, 0, K_BOUNDARY_SIZE, K_QP_MAX_VARS> BoundaryMap;
+        typedef Eigen::Matrix<double, K_BOUNDARY_SIZE, K_BOUNDARY_SIZE> BoundaryMatrix;
+        typedef Eigen::Matrix<double, Eigen::Dynamic, K_BOUNDARY_SIZE, 0, K_QP_MAX_VARS, K_BOUNDARY_SIZE> BoundaryGain;
+
+        // Segment of the horizon with its condensed QP. All the variables are deviations from the nominal trajectory:
+        // the actuations [delta..., a...] of its steps followed by the boundary with the previous segment
+        // (its state and the actuations of the step before it), the first segment starts at the current state.
+        // The boundary is not free: it is the end of the previous segment.
+        // It has fixed size vectorizable members, so it is allocated aligned.
+        class Segment
+        {
+            public:
+                EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+                int begin = 0;
+                int steps = 0;
+
+                // offset of the boundary in the variables, -1 for the first segment
+                int boundary = -1;
+
+                QpMatrix H;
+                QpVector g;
+                QpVector x;
+
+                // limits of the actuations
+                QpVector lower;
+                QpVector upper;
+
+                // boundary with the next segment as a linear function of the variables
+                BoundaryMap end;
+
+                // gradient of the segment's cost and of the cost of the rest of the horizon
+                QpVector gradient;
+                QpVector total_gradient;
+
+                // Newton step: the free actuations and the ones fixed at the bounds, the step of the free ones is
+                // -(gain * step of the boundary + feedforward)
+                int free_vars[K_QP_MAX_VARS];
+                int free_num = 0;
+                BoundaryGain gain;
+                QpVector feedforward;
+                QpVector step;
+                QpVector next_x;
+
+                Eigen::LDLT<QpMatrix> ldlt{K_QP_MAX_VARS};
+        };
+
+        ThreadPool *pool;
+        vector<Segment, Eigen::aligned_allocator<Segment>> segments;
+
+        // Runs the work for every segment, the segments are divided between the workers of the pool
+        void ForEachSegment(const function<void(Segment &segment, size_t index)> &work);
+
+        // Solves the QP of the whole horizon from the variables of the segments, at most max_iterations Newton steps.
+        // Returns true if the projected gradient is below the tolerance.
+        bool SolveHorizon(int max_iterations, int &iterations);
+
+        // Sets the boundaries to the ends of the previous segments and returns the cost of the horizon,
+        // use_next takes the variables from next_x
+        double RollOut(bool use_next);
+};
+
+#endif //MPC_PARALLEL_LTV_H
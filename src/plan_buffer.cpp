@@ -0,0 +1,123 @@
+#include "plan_buffer.h"
+
+#include <algorithm>
+#include <cmath>
+
+void PlanBuffer::Publish(const MPCSolution &plan, double start_time)
+{
+    Replace(plan, start_time, PlanOrigin(), false);
+}
+
+void PlanBuffer::Publish(const MPCSolution &plan, double start_time, const PlanOrigin &origin)
+{
+    Replace(plan, start_time, origin, true);
+}
+
+void PlanBuffer::Replace(const MPCSolution &plan, double start_time, const PlanOrigin &origin, bool has_origin)
+{
+    if(plan.delta_vals.empty() || plan.dt_vals.size() != plan.delta_vals.size())
+    {
+        return;
+    }
+
+    lock_guard<mutex> lock(plan_mutex);
+    this->plan = plan;
+    this->start_time = start_time;
+    this->origin = origin;
+    this->has_origin = has_origin;
+    times.resize(plan.dt_vals.size() + 1);
+    times[0] = 0;
+    for(size_t i = 0; i < plan.dt_vals.size(); i++)
+    {
+        times[i + 1] = times[i] + plan.dt_vals[i];
+    }
+}
+
+bool PlanBuffer::Sample(double time, MPCSolution &solution) const
+{
+    lock_guard<mutex> lock(plan_mutex);
+    if(plan.delta_vals.empty())
+    {
+        return false;
+    }
+
+    // the last actuation is held until the end of its time step
+    double offset = time - start_time;
+    if(offset < 0 || offset >= times.back())
+    {
+        return false;
+    }
+
+    size_t size = plan.delta_vals.size();
+    size_t i = upper_bound(times.begin(), times.end(), offset) - times.begin() - 1;
+    size_t next = min(i + 1, size - 1);
+    double ratio = (offset - times[i]) / plan.dt_vals[i];
+
+    solution.delta = plan.delta_vals[i] + (plan.delta_vals[next] - plan.delta_vals[i]) * ratio;
+    solution.acceleration = plan.a_vals[i] + (plan.a_vals[next] - plan.a_vals[i]) * ratio;
+    solution.feasible = true;
+
+    // the trajectory is in car's coordinates of the moment the plan was made,
+    // it is only displayed, so it is not moved with the car
+    solution.x_vals = plan.x_vals;
+    solution.y_vals = plan.y_vals;
+    return true;
+}
+
+bool PlanBuffer::GetShiftedPlan(double time, vector<double> &delta_vals, vector<double> &a_vals) const
+{
+    lock_guard<mutex> lock(plan_mutex);
+    double offset = time - start_time;
+    if(plan.delta_vals.empty() || offset < 0 || offset >= times.back())
+    {
+        return false;
+    }
+
+    size_t i = upper_bound(times.begin(), times.end(), offset) - times.begin() - 1;
+    delta_vals.assign(plan.delta_vals.begin() + i, plan.delta_vals.end());
+    a_vals.assign(plan.a_vals.begin() + i, plan.a_vals.end());
+    return true;
+}
+
+bool PlanBuffer::Reference(double time, double &x, double &y, double &psi, double &v) const
+{
+    lock_guard<mutex> lock(plan_mutex);
+    double offset = time - start_time;
+    if(!has_origin || plan.x_vals.size() != plan.delta_vals.size() || plan.delta_vals.empty()
+       || offset < 0 || offset >= times.back())
+    {
+        return false;
+    }
+
+    // the trajectory point i is reached at the end of the time step i, the car is at the origin at the start
+    size_t i = upper_bound(times.begin(), times.end(), offset) - times.begin() - 1;
+    double x0 = i == 0 ? 0 : plan.x_vals[i - 1];
+    double y0 = i == 0 ? 0 : plan.y_vals[i - 1];
+    double dx = plan.x_vals[i] - x0;
+    double dy = plan.y_vals[i] - y0;
+    double ratio = (offset - times[i]) / plan.dt_vals[i];
+    double length = sqrt(dx * dx + dy * dy);
+
+    double car_x = x0 + dx * ratio;
+    double car_y = y0 + dy * ratio;
+    x = origin.px + car_x * cos(origin.psi) - car_y * sin(origin.psi);
+    y = origin.py + car_x * sin(origin.psi) + car_y * cos(origin.psi);
+    psi = origin.psi + (length > 1e-6 ? atan2(dy, dx) : 0);
+    v = length / plan.dt_vals[i];
+    return true;
+}
+
+double PlanBuffer::StartTime() const
+{
+    lock_guard<mutex> lock(plan_mutex);
+    return plan.delta_vals.empty() ? -1 : start_time;
+}
+
+void PlanBuffer::Clear()
+{
+    lock_guard<mutex> lock(plan_mutex);
+    plan = MPCSolution();
+    start_time = -1;
+    times.clear();
+    has_origin = false;
+}
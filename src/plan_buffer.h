@@ -0,0 +1,63 @@
+#ifndef MPC_PLAN_BUFFER_H
+#define MPC_PLAN_BUFFER_H
+
+#include <mutex>
+
+#include "MPC.h"
+
+using namespace std;
+
+// Car's pose in global coordinates the plan was made for, the planned trajectory is in car's coordinates of this pose
+class PlanOrigin
+{
+    public:
+        double px = 0;
+        double py = 0;
+        double psi = 0;
+};
+
+// The last plan found by the optimizer with the time when its first actuation is applied.
+// Every actuation of the plan is applied for its own time step (MPCSolution::dt_vals), so commands
+// for any time in between are interpolated from the neighbouring actuations.
+// The plan is published by the solver and sampled by the message handler, possibly from different threads.
+class PlanBuffer
+{
+    public:
+        // Replaces the plan. Plans without actuations are ignored.
+        // Without the origin the planned trajectory can't be followed (see Reference).
+        void Publish(const MPCSolution &plan, double start_time);
+        void Publish(const MPCSolution &plan, double start_time, const PlanOrigin &origin);
+
+        // Fills actuations interpolated at the given time and the planned trajectory.
+        // Returns false if there is no plan or it doesn't cover this time.
+        bool Sample(double time, MPCSolution &solution) const;
+
+        // Fills actuations of the plan starting from the one applied at the given time.
+        // Returns false if there is no plan or it doesn't cover this time.
+        bool GetShiftedPlan(double time, vector<double> &delta_vals, vector<double> &a_vals) const;
+
+        // Fills the planned pose (global coordinates) and velocity at the given time, the trajectory points are
+        // interpolated. Returns false if there is no plan with the origin or it doesn't cover this time.
+        bool Reference(double time, double &x, double &y, double &psi, double &v) const;
+
+        // Time when the first actuation of the current plan is applied, -1 if there is no plan
+        double StartTime() const;
+
+        void Clear();
+
+    private:
+        mutable mutex plan_mutex;
+
+        MPCSolution plan;
+        double start_time = -1;
+
+        // time since start_time when every actuation starts to be applied
+        vector<double> times;
+
+        PlanOrigin origin;
+        bool has_origin = false;
+
+        void Replace(const MPCSolution &plan, double start_time, const PlanOrigin &origin, bool has_origin);
+};
+
+#endif //MPC_PLAN_BUFFER_H
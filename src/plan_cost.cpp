@@ -0,0 +1,49 @@
+#include "plan_cost.h"
+
+#include <vector>
+
+#include "FG_eval_single.h"
+#include "cost_residuals.h"
+
+double PlanCost(const MPCSolution &plan, const Eigen::VectorXd &state, const Eigen::VectorXd &coeffs,
+                const Config &reference)
+{
+    size_t N = (size_t)max(2, reference.max_points_num);
+    vector<double> stage_dt = reference.GetStageDt(N - 1);
+
+    // 1. Actuations of the plan at the start of every reference step
+    vector<double> delta(N - 1);
+    vector<double> a(N - 1);
+    double time = 0;
+    double plan_time = 0;
+    size_t k = 0;
+    for(size_t t = 0; t + 1 < N; t++)
+    {
+        while(k + 1 < plan.delta_vals.size() && k < plan.dt_vals.size() && plan_time + plan.dt_vals[k] <= time)
+        {
+            plan_time += plan.dt_vals[k];
+            k++;
+        }
+        delta[t] = plan.delta_vals.empty() ? plan.delta : plan.delta_vals[k];
+        a[t] = plan.a_vals.empty() ? plan.acceleration : plan.a_vals[k];
+        time += stage_dt[t];
+    }
+
+    // 2. Roll out the trajectory and sum up the squared residuals
+    vector<double> r(CostResidualsNum(N));
+    ModelState<double> s = {state[0], state[1], state[2], state[3], state[4], state[5]};
+    SetStateResiduals(r, 0, s.cte, s.epsi, s.v, reference);
+    for(size_t t = 1; t < N; t++)
+    {
+        s = ModelStep(s, delta[t - 1], a[t - 1], coeffs, stage_dt[t - 1]);
+        SetStateResiduals(r, t, s.cte, s.epsi, s.v, reference);
+    }
+    SetActuatorResiduals(r, N, delta, a, reference);
+
+    double cost = 0;
+    for(double residual : r)
+    {
+        cost += residual * residual;
+    }
+    return cost;
+}
@@ -0,0 +1,15 @@
+#ifndef MPC_PLAN_COST_H
+#define MPC_PLAN_COST_H
+
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+#include "config.h"
+
+// Cost of the plan of the polynomial formulation measured the same way for any horizon and preset:
+// the planned actuations (the last one is held) are rolled out with the model over the horizon of the reference config
+// and the cost of the optimizer with the reference weights is calculated for the trajectory.
+// state is [x, y, psi, v, cte, epsi]. Plans of different problems for the same state can be compared by it.
+double PlanCost(const MPCSolution &plan, const Eigen::VectorXd &state, const Eigen::VectorXd &coeffs,
+                const Config &reference);
+
+#endif //MPC_PLAN_COST_H
@@ -0,0 +1,342 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "config.h"
+#include "metrics.h"
+#include "mlp_policy.h"
+#include "MPC.h"
+#include "offline_solve.h"
+
+// Distills MPC::Solve into a small neural network policy (see mlp_policy.h).
+// Problems are sampled uniformly over the region of the offline solutions and solved in worker processes,
+// then the network is trained to reproduce the first actuations of the converged ones.
+// A part of the samples is held out to report the error of the policy.
+//
+// Usage: ./policy_train output.mlp [preset: 50|60|70] [samples number] [workers number]
+
+Config Config::Instance = Config70();
+
+Metrics Metrics::Instance;
+
+// Neurons of each hidden layer
+const uint32_t K_HIDDEN = 32;
+
+// Adam optimizer settings
+const int K_EPOCHS = 200;
+const int K_BATCH_SIZE = 64;
+const double K_LEARNING_RATE = 0.003;
+const double K_BETA1 = 0.9;
+const double K_BETA2 = 0.999;
+
+// Share of the samples held out for validation
+const double K_VALIDATION_SHARE = 0.1;
+
+// Training sample: network inputs and the optimizer actuations divided by their limits
+struct TrainSample
+{
+    float input[K_PROBLEM_FEATURES];
+    float target[K_MLP_OUTPUTS];
+};
+
+// Activations of the network for one sample, kept for the backward pass
+struct ForwardPass
+{
+    float z1[K_MLP_MAX_HIDDEN], h1[K_MLP_MAX_HIDDEN];
+    float z2[K_MLP_MAX_HIDDEN], h2[K_MLP_MAX_HIDDEN];
+    float output[K_MLP_OUTPUTS];
+};
+
+// Scalar forward pass with the same weights layout as MlpPolicy
+static void Forward(const MlpWeights &w, const float *input, ForwardPass &pass)
+{
+    int hidden = (int)w.hidden;
+    for(int i = 0; i < hidden; i++)
+    {
+        float sum = w.b1[i];
+        for(int j = 0; j < K_PROBLEM_FEATURES; j++)
+        {
+            sum += w.w1[j * hidden + i] * input[j];
+        }
+        pass.z1[i] = sum;
+        pass.h1[i] = MlpActivation(sum);
+    }
+    for(int i = 0; i < hidden; i++)
+    {
+        float sum = w.b2[i];
+        for(int j = 0; j < hidden; j++)
+        {
+            sum += w.w2[j * hidden + i] * pass.h1[j];
+        }
+        pass.z2[i] = sum;
+        pass.h2[i] = MlpActivation(sum);
+    }
+    for(int o = 0; o < K_MLP_OUTPUTS; o++)
+    {
+        float sum = w.b3[o];
+        for(int j = 0; j < hidden; j++)
+        {
+            sum += w.w3[o * hidden + j] * pass.h2[j];
+        }
+        pass.output[o] = sum;
+    }
+}
+
+// Adds gradient of the squared error of one sample to grad
+static void Backward(const MlpWeights &w, const TrainSample &sample, const ForwardPass &pass, MlpWeights &grad)
+{
+    int hidden = (int)w.hidden;
+    float d2[K_MLP_MAX_HIDDEN] = {0};
+    float d1[K_MLP_MAX_HIDDEN] = {0};
+
+    for(int o = 0; o < K_MLP_OUTPUTS; o++)
+    {
+        float error = 2 * (pass.output[o] - sample.target[o]);
+        grad.b3[o] += error;
+        for(int j = 0; j < hidden; j++)
+        {
+            grad.w3[o * hidden + j] += error * pass.h2[j];
+            d2[j] += error * w.w3[o * hidden + j];
+        }
+    }
+
+    for(int i = 0; i < hidden; i++)
+    {
+        d2[i] *= MlpActivationDerivative(pass.z2[i]);
+        grad.b2[i] += d2[i];
+        for(int j = 0; j < hidden; j++)
+        {
+            grad.w2[j * hidden + i] += d2[i] * pass.h1[j];
+            d1[j] += d2[i] * w.w2[j * hidden + i];
+        }
+    }
+
+    for(int i = 0; i < hidden; i++)
+    {
+        d1[i] *= MlpActivationDerivative(pass.z1[i]);
+        grad.b1[i] += d1[i];
+        for(int j = 0; j < K_PROBLEM_FEATURES; j++)
+        {
+            grad.w1[j * hidden + i] += d1[i] * sample.input[j];
+        }
+    }
+}
+
+// Trains the network with Adam on mini batches
+static void Train(MlpWeights &weights, vector<TrainSample> samples, mt19937 &generator)
+{
+    MlpWeights grad, m, v;
+    grad.Resize(weights.hidden);
+    m.Resize(weights.hidden);
+    v.Resize(weights.hidden);
+    vector<vector<float> *> params = weights.Tensors();
+    vector<vector<float> *> grads = grad.Tensors();
+    vector<vector<float> *> ms = m.Tensors();
+    vector<vector<float> *> vs = v.Tensors();
+
+    ForwardPass pass;
+    int step = 0;
+    for(int epoch = 0; epoch < K_EPOCHS; epoch++)
+    {
+        shuffle(samples.begin(), samples.end(), generator);
+
+        // the learning rate decays linearly to a tenth of the initial one
+        double rate = K_LEARNING_RATE * (1 - 0.9 * epoch / K_EPOCHS);
+        double loss = 0;
+        for(size_t start = 0; start < samples.size(); start += K_BATCH_SIZE)
+        {
+            size_t end = min(samples.size(), start + K_BATCH_SIZE);
+            for(vector<float> *g : grads)
+            {
+                fill(g->begin(), g->end(), 0.f);
+            }
+            for(size_t k = start; k < end; k++)
+            {
+                Forward(weights, samples[k].input, pass);
+                Backward(weights, samples[k], pass, grad);
+                for(int o = 0; o < K_MLP_OUTPUTS; o++)
+                {
+                    loss += pow(pass.output[o] - samples[k].target[o], 2);
+                }
+            }
+
+            step++;
+            double correction1 = 1 - pow(K_BETA1, step);
+            double correction2 = 1 - pow(K_BETA2, step);
+            for(size_t t = 0; t < params.size(); t++)
+            {
+                for(size_t i = 0; i < params[t]->size(); i++)
+                {
+                    double g = (*grads[t])[i] / (end - start);
+                    (*ms[t])[i] = (float)(K_BETA1 * (*ms[t])[i] + (1 - K_BETA1) * g);
+                    (*vs[t])[i] = (float)(K_BETA2 * (*vs[t])[i] + (1 - K_BETA2) * g * g);
+                    double m_hat = (*ms[t])[i] / correction1;
+                    double v_hat = (*vs[t])[i] / correction2;
+                    (*params[t])[i] -= (float)(rate * m_hat / (sqrt(v_hat) + 1e-8));
+                }
+            }
+        }
+
+        if(epoch % 20 == 0 || epoch + 1 == K_EPOCHS)
+        {
+            cout << "epoch " << epoch << " loss " << loss / samples.size() << endl;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2)
+    {
+        cerr << "Usage: " << argv[0] << " output.mlp [preset: 50|60|70] [samples number] [workers number]" << endl;
+        return -1;
+    }
+    string path = argv[1];
+    string preset = argc > 2 ? argv[2] : "70";
+    int samples_num = argc > 3 ? atoi(argv[3]) : 20000;
+    int workers = argc > 4 ? atoi(argv[4]) : (int)thread::hardware_concurrency();
+    workers = max(1, workers);
+
+    if(preset == "50")
+    {
+        Config::Instance = Config50();
+    }
+    else if(preset == "60")
+    {
+        Config::Instance = Config60();
+    }
+
+    auto start = chrono::steady_clock::now();
+    Config config = Config::GetConfig();
+    int points_num = config.max_points_num;
+
+    // 1. Sample the problems and solve them
+    mt19937 generator(42);
+    vector<double> features(samples_num * K_PROBLEM_FEATURES);
+    for(int i = 0; i < samples_num; i++)
+    {
+        for(int k = 0; k < K_PROBLEM_FEATURES; k++)
+        {
+            uniform_real_distribution<double> distribution(K_FEATURES_MIN[k], K_FEATURES_MAX[k]);
+            features[i * K_PROBLEM_FEATURES + k] = distribution(generator);
+        }
+    }
+
+    cout << "Solving " << samples_num << " problems with " << workers << " workers" << endl;
+    vector<WorkerResult> results = RunWorkers(samples_num, workers, [&features, points_num](size_t i, double &delta, double &a) {
+        return SolveFeatures(&features[i * K_PROBLEM_FEATURES], points_num, delta, a);
+    });
+
+    // 2. Inputs are scaled to [-1, 1] over the region, outputs are divided by the actuator limits
+    MlpPolicyHeader header;
+    memset(&header, 0, sizeof(header));
+    config.GetKey(header.config);
+    for(int k = 0; k < K_PROBLEM_FEATURES; k++)
+    {
+        header.input_center[k] = (K_FEATURES_MIN[k] + K_FEATURES_MAX[k]) / 2;
+        header.input_scale[k] = 2 / (K_FEATURES_MAX[k] - K_FEATURES_MIN[k]);
+    }
+
+    vector<TrainSample> train;
+    vector<TrainSample> validation;
+    vector<int> validation_problems;
+    for(int i = 0; i < samples_num; i++)
+    {
+        if(!results[i].ok)
+        {
+            continue;
+        }
+        TrainSample sample;
+        for(int k = 0; k < K_PROBLEM_FEATURES; k++)
+        {
+            double value = features[i * K_PROBLEM_FEATURES + k];
+            sample.input[k] = (float)((value - header.input_center[k]) * header.input_scale[k]);
+        }
+        sample.target[0] = (float)(results[i].delta / K_MAX_DELTA);
+        sample.target[1] = (float)(results[i].a / K_MAX_ACCELERATION);
+
+        if(i < samples_num * K_VALIDATION_SHARE)
+        {
+            validation.push_back(sample);
+            validation_problems.push_back(i);
+        }
+        else
+        {
+            train.push_back(sample);
+        }
+    }
+    cout << "Converged " << train.size() + validation.size() << "/" << samples_num << " problems" << endl;
+    if(train.empty() || validation.empty())
+    {
+        cerr << "Not enough samples" << endl;
+        return -1;
+    }
+
+    // 3. Train the network, initial weights are uniform with the variance preserving scale
+    MlpWeights weights;
+    weights.Resize(K_HIDDEN);
+    auto init = [&generator](vector<float> &w, int fan_in) {
+        uniform_real_distribution<float> distribution(-sqrt(3.f / fan_in), sqrt(3.f / fan_in));
+        for(float &value : w)
+        {
+            value = distribution(generator);
+        }
+    };
+    init(weights.w1, K_PROBLEM_FEATURES);
+    init(weights.w2, K_HIDDEN);
+    init(weights.w3, K_HIDDEN);
+    Train(weights, train, generator);
+
+    if(!WriteMlpPolicy(path, header, weights))
+    {
+        cerr << "Failed to write " << path << endl;
+        return -1;
+    }
+
+    // 4. Report the error and the inference time of the written policy on the held out problems
+    MlpPolicy policy;
+    if(!policy.Load(path))
+    {
+        cerr << "Failed to load " << path << endl;
+        return -1;
+    }
+
+    double delta_error2 = 0, a_error2 = 0, delta_error_max = 0;
+    for(size_t k = 0; k < validation.size(); k++)
+    {
+        double delta, a;
+        policy.EvaluateFeatures(&features[validation_problems[k] * K_PROBLEM_FEATURES], delta, a);
+        double delta_error = delta - results[validation_problems[k]].delta;
+        double a_error = a - results[validation_problems[k]].a;
+        delta_error2 += delta_error * delta_error;
+        a_error2 += a_error * a_error;
+        delta_error_max = max(delta_error_max, fabs(delta_error));
+    }
+
+    double delta_sum = 0;
+    int evaluations = 0;
+    auto inference_start = chrono::steady_clock::now();
+    for(int repeat = 0; repeat < 100; repeat++)
+    {
+        for(int problem : validation_problems)
+        {
+            double delta, a;
+            policy.EvaluateFeatures(&features[problem * K_PROBLEM_FEATURES], delta, a);
+            delta_sum += delta;
+            evaluations++;
+        }
+    }
+    auto end = chrono::steady_clock::now();
+
+    cout << "Validation rms delta " << sqrt(delta_error2 / validation.size()) << " rad (max " << delta_error_max << ")"
+         << ", rms a " << sqrt(a_error2 / validation.size()) << " m/s^2" << endl;
+    cout << "Inference " << chrono::duration<double, nano>(end - inference_start).count() / evaluations << " ns"
+         << " (mean delta " << delta_sum / evaluations << ")" << endl;
+    cout << "Written " << path << " in " << chrono::duration<double>(end - start).count() << " s" << endl;
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include "preset_schedule.h"
+
+#include <cmath>
+
+Config PresetSchedule::Select(const Config &base, double v, double curvature)
+{
+    vector<Config> presets = SpeedPresets();
+
+    // 1. Scheduling speed: a step above the measured speed, but not faster than the curvature allows
+    double new_speed = v + base.schedule_speed_margin;
+    if(curvature > 1e-6)
+    {
+        new_speed = min(new_speed, sqrt(base.schedule_lateral_acceleration / curvature));
+    }
+    if(speed < 0 || fabs(new_speed - speed) > base.schedule_hysteresis)
+    {
+        speed = new_speed;
+    }
+
+    // 2. The preset with the closest target below it, blended with the next one near the middle between them
+    Config blended = presets[0];
+    for(size_t i = 0; i + 1 < presets.size(); i++)
+    {
+        double middle = (presets[i].target_v + presets[i + 1].target_v) / 2;
+        double half_width = max(base.schedule_blend_width / 2, 1e-6);
+        if(speed >= middle + half_width)
+        {
+            blended = presets[i + 1];
+        }
+        else if(speed > middle - half_width)
+        {
+            blended = Blend(presets[i], presets[i + 1], (speed - middle + half_width) / (2 * half_width));
+            break;
+        }
+    }
+
+    Config scheduled = base;
+    scheduled.CopyTuning(blended);
+    return scheduled;
+}
+
+double PresetSchedule::MaxCurvature(const vector<double> &x, const vector<double> &y)
+{
+    // curvature of the circle through every three consecutive points: 4 * area / product of the sides
+    double max_curvature = 0;
+    for(size_t i = 2; i < x.size() && i < y.size(); i++)
+    {
+        double ax = x[i - 1] - x[i - 2], ay = y[i - 1] - y[i - 2];
+        double bx = x[i] - x[i - 1], by = y[i] - y[i - 1];
+        double cx = x[i] - x[i - 2], cy = y[i] - y[i - 2];
+        double sides = sqrt((ax * ax + ay * ay) * (bx * bx + by * by) * (cx * cx + cy * cy));
+        if(sides > 1e-9)
+        {
+            max_curvature = max(max_curvature, 2 * fabs(ax * by - ay * bx) / sides);
+        }
+    }
+    return max_curvature;
+}
+
+Config PresetSchedule::Blend(const Config &a, const Config &b, double w)
+{
+    w = min(max(w, 0.), 1.);
+    Config blended = w < 0.5 ? a : b;
+    auto mix = [w](double va, double vb) { return va + (vb - va) * w; };
+    blended.target_v = mix(a.target_v, b.target_v);
+    blended.cte_w = mix(a.cte_w, b.cte_w);
+    blended.epsi_w = mix(a.epsi_w, b.epsi_w);
+    blended.velocity_diff_w = mix(a.velocity_diff_w, b.velocity_diff_w);
+    blended.delta_w = mix(a.delta_w, b.delta_w);
+    blended.a_w = mix(a.a_w, b.a_w);
+    blended.delta_diff_w = mix(a.delta_diff_w, b.delta_diff_w);
+    blended.a_diff_w = mix(a.a_diff_w, b.a_diff_w);
+    return blended;
+}
@@ -0,0 +1,35 @@
+#ifndef MPC_PRESET_SCHEDULE_H
+#define MPC_PRESET_SCHEDULE_H
+
+#include <vector>
+
+#include "config.h"
+
+using namespace std;
+
+// Chooses the speed preset for every cycle (see Config::preset_schedule).
+// The scheduling speed is the measured speed plus a margin, so the car can step up to the next preset,
+// limited by the speed the curvature ahead allows with Config::schedule_lateral_acceleration.
+// Near the middle between the target speeds of two presets their weights and targets are blended,
+// the grid (dt, horizon, input parameterization) is taken from the closer one, so straights run the coarse
+// Config70 problem and turns the fine Config50 one. Small changes of the speed don't change the choice.
+class PresetSchedule
+{
+    public:
+        // Returns the config for the measured speed (m/s) and the maximum curvature of the waypoints ahead (1/m).
+        // The solver settings are copied from base.
+        Config Select(const Config &base, double v, double curvature);
+
+        // Maximum curvature of the polyline through the points, it doesn't depend on the coordinate system
+        static double MaxCurvature(const vector<double> &x, const vector<double> &y);
+
+        // Config between a and b: continuous parameters are interpolated with weight w of b,
+        // the discrete ones are taken from the closer preset
+        static Config Blend(const Config &a, const Config &b, double w);
+
+    private:
+        // scheduling speed the current choice was made for, negative before the first cycle
+        double speed = -1;
+};
+
+#endif //MPC_PRESET_SCHEDULE_H
@@ -1,10 +1,19 @@
 #include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <system_error>
 #include <thread>
 
 #include "processor.h"
 #include "MPC.h"
+#include "metrics.h"
+#include "plan_cost.h"
 
-int Processor::CalcPointsNum(vector<double> &x, vector<double> &y, double v, double dt, int max_points_num)
+// Number of waypoints taken from the track map, the simulator sends 6 of them
+const int K_TRACK_WAYPOINTS_NUM = 8;
+
+int Processor::CalcPointsNum(vector<double> &x, vector<double> &y, double v, const vector<double> &stage_dt,
+                             int max_points_num)
 {
     // calculate number of points in the predicted trajectory.
     // the trajectory should not be longer than the target line,
@@ -20,18 +29,469 @@ int Processor::CalcPointsNum(vector<double> &x, vector<double> &y, double v, dou
         length += sqrt(dx * dx + dy * dy);
     }
 
-    double distance_per_dt = v * dt;
-    int points_num = distance_per_dt > 0.05 ? (int)(length / distance_per_dt) : max_points_num;
+    if(stage_dt.empty() || v * stage_dt[0] <= 0.05)
+    {
+        return max_points_num;
+    }
+
+    // time steps grow along the horizon, so count the steps the car passes before the end of the target line
+    int points_num = 0;
+    double distance = 0;
+    while(points_num < max_points_num && points_num < (int)stage_dt.size())
+    {
+        distance += v * stage_dt[points_num];
+        if(distance > length)
+        {
+            break;
+        }
+        points_num++;
+    }
+
+    return points_num;
+}
+
+bool Processor::SamplePlan(double time, double px, double py, double psi, double v, MPCSolution &solution)
+{
+    if(!Config::GetConfig().tracking_law)
+    {
+        return plan_buffer.Sample(time, solution);
+    }
+
+    if(!tracking_controller.Control(plan_buffer, time, px, py, psi, v, solution))
+    {
+        return false;
+    }
+    Metrics::Instance.tracking_commands++;
+    return true;
+}
+
+bool Processor::GetTrackWaypoints(double px, double py, vector<double> &x, vector<double> &y)
+{
+    if(track_map == nullptr || !track_map->IsLoaded())
+    {
+        return false;
+    }
+
+    Config config = Config::GetConfig();
+    double s = track_map->FindNearest(px, py);
+    double distance = config.track_lookahead / (K_TRACK_WAYPOINTS_NUM - 1);
+    track_map->GetHorizon(s, distance, K_TRACK_WAYPOINTS_NUM, x, y);
+    return true;
+}
+
+MPCSolution Processor::SolvePolynomial(const Eigen::VectorXd &xs, const Eigen::VectorXd &ys, double v, int points_num,
+                                       chrono::steady_clock::time_point deadline,
+                                       const vector<double> &previous_delta, const vector<double> &previous_a,
+                                       const atomic<bool> *cancel, bool timed)
+{
+    // Fit 3d order polynomial to the waypoints so it is in cars predicted coordinate system.
+    auto coeffs = polyfit(xs, ys, 3);
+
+    // Explicit MPC: take the first actuations from the table and hold them over the horizon
+    Config config = Config::GetConfig();
+    if(config.solver == SolverType::ExplicitTable && explicit_table != nullptr)
+    {
+        MPCSolution solution;
+        if(explicit_table->Matches(config, points_num)
+           && explicit_table->Lookup(v, coeffs, solution.delta, solution.acceleration))
+        {
+            Metrics::Instance.table_hits++;
+            solution.ok = true;
+            solution.feasible = true;
+
+            // the predicted trajectory is only displayed
+            double x = 0, y = 0, psi = 0, speed = v;
+            for(double dt : config.GetStageDt(points_num - 1))
+            {
+                x += speed * cos(psi) * dt;
+                y += speed * sin(psi) * dt;
+                psi += speed * solution.delta / Lf * dt;
+                speed += solution.acceleration * dt;
+                solution.x_vals.push_back(x);
+                solution.y_vals.push_back(y);
+            }
+            solution.delta_vals.push_back(solution.delta);
+            solution.a_vals.push_back(solution.acceleration);
+            solution.dt_vals.push_back(config.dt);
+            return solution;
+        }
+        Metrics::Instance.table_misses++;
+    }
+
+    Eigen::VectorXd state(6);
+    state << 0., 0., 0., v, coeffs[0], atan(-coeffs[1]);
+    MPC mpc;
+    mpc.SetDeadline(deadline);
+    mpc.SetCancel(cancel);
+    mpc.SetPreviousPlan(previous_delta, previous_a);
+    solution_cache.SetCapacity(config.solution_cache_size);
+    mpc.SetSolutionCache(config.solution_cache_size > 0 ? &solution_cache : nullptr);
+    shared_ptr<ThreadPool> segment_pool = GetTimePool(config);
+    mpc.SetThreadPool(segment_pool.get());
+    auto solve_start = chrono::steady_clock::now();
+    MPCSolution solution = mpc.Solve(state, coeffs, points_num);
+    if(timed)
+    {
+        solve_time_model.Add(config, solution.warm_start, points_num,
+                             chrono::duration<double>(chrono::steady_clock::now() - solve_start).count());
+        last_warm_start = solution.warm_start;
+    }
+    return solution;
+}
+
+void Processor::WarmUpPresets()
+{
+    Config config = Config::GetConfig();
+    for(const Config &preset : SpeedPresets())
+    {
+        Config warm = config;
+        warm.CopyTuning(preset);
+        ScopedConfig scoped(warm);
+
+        // a straight line and a turn of 100 m radius ahead of the car
+        for(double radius : {0., 100.})
+        {
+            vector<double> x, y;
+            for(double s = 0; s <= warm.track_lookahead; s += warm.track_lookahead / 7)
+            {
+                x.push_back(radius > 0 ? radius * sin(s / radius) : s);
+                y.push_back(radius > 0 ? radius * (1 - cos(s / radius)) : 0);
+            }
+            Eigen::VectorXd xs = Eigen::Map<Eigen::VectorXd>(x.data(), x.size());
+            Eigen::VectorXd ys = Eigen::Map<Eigen::VectorXd>(y.data(), y.size());
+            int points_num = CalcPointsNum(x, y, warm.target_v, warm.GetStageDt(warm.max_points_num),
+                                           warm.max_points_num);
+            // the first solves pay for the allocations, so they would only skew the solve time model
+            SolvePolynomial(xs, ys, warm.target_v, points_num, chrono::steady_clock::now() + chrono::seconds(1),
+                            vector<double>(), vector<double>(), nullptr, false);
+        }
+    }
+}
+
+void Processor::OnConfigChanged()
+{
+    Metrics::Instance.config_reloads++;
+    Config config = Config::GetConfig();
+    solution_cache.SetCapacity(config.solution_cache_size);
+
+    // a running rebuild is cancelled even if there is nothing to rebuild with the new config
+    {
+        lock_guard<mutex> lock(rebuild_mutex);
+        rebuild_generation++;
+        rebuild_pending = config.solution_cache_size > 0 && solution_cache.Size() > 0;
+        if(rebuild_pending && !rebuild_thread.joinable())
+        {
+            try
+            {
+                rebuild_cppad_thread.reset(new CppADThread());
+            }
+            catch(const runtime_error &e)
+            {
+                cerr << "Solution cache is not rebuilt: " << e.what() << endl;
+                rebuild_pending = false;
+                return;
+            }
+            rebuild_thread = thread(&Processor::RunRebuilds, this);
+        }
+    }
+    rebuild_changed.notify_all();
+}
+
+Processor::~Processor()
+{
+    {
+        lock_guard<mutex> lock(rebuild_mutex);
+        rebuild_stop = true;
+    }
+    rebuild_changed.notify_all();
+    if(rebuild_thread.joinable())
+    {
+        rebuild_thread.join();
+    }
+}
+
+void Processor::RunRebuilds()
+{
+    rebuild_cppad_thread->Enter();
+    unique_lock<mutex> lock(rebuild_mutex);
+    while(true)
+    {
+        rebuild_changed.wait(lock, [this]() { return rebuild_stop || rebuild_pending; });
+        if(rebuild_stop)
+        {
+            rebuild_cppad_thread->Leave();
+            return;
+        }
+        rebuild_pending = false;
+        uint64_t generation = rebuild_generation;
+        lock.unlock();
 
-    return min(points_num, max_points_num);
+        // the solves are stopped as soon as a newer config is published or the processor is destroyed
+        bool rebuilt = solution_cache.Rebuild([this, generation](const Eigen::VectorXd &state,
+                                                                 const Eigen::VectorXd &coeffs, int points_num,
+                                                                 SolutionCache &rebuilt) {
+            {
+                lock_guard<mutex> lock(rebuild_mutex);
+                if(rebuild_stop || rebuild_generation != generation)
+                {
+                    return false;
+                }
+            }
+            MPC mpc;
+            mpc.SetSolutionCache(&rebuilt);
+            mpc.Solve(state, coeffs, points_num);
+            Metrics::Instance.cache_rebuild_solves++;
+            return true;
+        });
+        if(!rebuilt)
+        {
+            Metrics::Instance.cancelled_rebuilds++;
+        }
+        lock.lock();
+    }
+}
+
+shared_ptr<ThreadPool> Processor::GetTimePool(const Config &config)
+{
+    if(config.solver != SolverType::ParallelLtv || config.parallel_threads <= 1)
+    {
+        return nullptr;
+    }
+
+    lock_guard<mutex> lock(time_pool_mutex);
+    if(time_pool_size != config.parallel_threads)
+    {
+        // the old pool stops its workers unless a solve on another thread still uses it,
+        // the segments don't use CppAD, so the workers don't take its thread numbers
+        time_pool = nullptr;
+        time_pool_size = config.parallel_threads;
+        try
+        {
+            time_pool = make_shared<ThreadPool>(config.parallel_threads, false);
+        }
+        catch(const system_error &e)
+        {
+            cerr << "ParallelLtv segments are solved on the calling thread: " << e.what() << endl;
+        }
+    }
+    return time_pool;
+}
+
+MPCSolution Processor::SolveMultiStart(const Eigen::VectorXd &xs, const Eigen::VectorXd &ys, double v, int points_num,
+                                       chrono::steady_clock::time_point deadline,
+                                       const vector<double> &previous_delta, const vector<double> &previous_a)
+{
+    Config config = Config::GetConfig();
+    if(!MPC::ConcurrentSolves(config))
+    {
+        if(!multi_start_refused.exchange(true))
+        {
+            cerr << "Multi-start is disabled: IPOPT solves can't run concurrently with the configured linear solver"
+                 << endl;
+        }
+        return SolvePolynomial(xs, ys, v, points_num, deadline, previous_delta, previous_a);
+    }
+
+    if(thread_pool_size != config.multi_start_threads)
+    {
+        thread_pool.reset();
+        thread_pool_size = config.multi_start_threads;
+        try
+        {
+            thread_pool.reset(new ThreadPool(config.multi_start_threads));
+        }
+        catch(const runtime_error &e)
+        {
+            cerr << "Multi-start is disabled: " << e.what() << endl;
+        }
+    }
+    if(thread_pool == nullptr)
+    {
+        return SolvePolynomial(xs, ys, v, points_num, deadline, previous_delta, previous_a);
+    }
+
+    // the candidates share the segment pool of the config, it is created once before they start
+    shared_ptr<ThreadPool> segment_pool = GetTimePool(config);
+
+    // 1. Candidates: the heuristic horizon and a few points shorter and longer with the current config
+    vector<Config> configs;
+    vector<int> points_nums;
+    int step = max(1, points_num / 6);
+    for(int n : {points_num, points_num - step, points_num + step})
+    {
+        if(n == points_num || (n >= 3 && n <= config.max_points_num))
+        {
+            configs.push_back(config);
+            points_nums.push_back(n);
+        }
+    }
+
+    // and the speed presets next to the current one, solved the same way with their own horizons
+    vector<Config> presets = SpeedPresets();
+    size_t current = 0;
+    for(size_t i = 1; i < presets.size(); i++)
+    {
+        if(fabs(presets[i].target_v - config.target_v) < fabs(presets[current].target_v - config.target_v))
+        {
+            current = i;
+        }
+    }
+    vector<double> x(xs.data(), xs.data() + xs.size());
+    vector<double> y(ys.data(), ys.data() + ys.size());
+    for(size_t i = 0; i < presets.size(); i++)
+    {
+        if(i + 1 != current && i != current + 1)
+        {
+            continue;
+        }
+        Config preset = presets[i];
+        preset.CopySolverSettings(config);
+        int n = CalcPointsNum(x, y, v, preset.GetStageDt(preset.max_points_num), preset.max_points_num);
+        if(n >= 3)
+        {
+            configs.push_back(preset);
+            points_nums.push_back(n);
+        }
+    }
+
+    // 2. Solve all of them concurrently with the same deadline
+    vector<MPCSolution> solutions(configs.size());
+    vector<function<void()>> tasks;
+    for(size_t i = 0; i < configs.size(); i++)
+    {
+        tasks.push_back([&, i]() {
+            ScopedConfig scoped(configs[i]);
+            solutions[i] = SolvePolynomial(xs, ys, v, points_nums[i], deadline, previous_delta, previous_a, nullptr,
+                                           false);
+        });
+    }
+    thread_pool->Run(tasks);
+    Metrics::Instance.multi_start_candidates += configs.size();
+
+    // 3. Choose the best feasible plan by the cost with the current weights over the current horizon
+    auto coeffs = polyfit(xs, ys, 3);
+    Eigen::VectorXd state(6);
+    state << 0., 0., 0., v, coeffs[0], atan(-coeffs[1]);
+    size_t best = 0;
+    double best_cost = numeric_limits<double>::max();
+    for(size_t i = 0; i < solutions.size(); i++)
+    {
+        if(!solutions[i].feasible)
+        {
+            continue;
+        }
+        double cost = PlanCost(solutions[i], state, coeffs, config);
+        if(cost < best_cost)
+        {
+            best = i;
+            best_cost = cost;
+        }
+    }
+    if(best != 0 && solutions[best].feasible)
+    {
+        Metrics::Instance.multi_start_switches++;
+    }
+
+    return solutions[best];
+}
+
+MPCSolution Processor::RunPolicy(const AsyncSolver::Problem &problem, const Eigen::VectorXd &coeffs, double v,
+                                 double time, chrono::steady_clock::time_point deadline)
+{
+    Config config = Config::GetConfig();
+    MPCSolution solution;
+    policy->Evaluate(v, coeffs, solution.delta, solution.acceleration);
+    solution.feasible = true;
+
+    // 1. Check the policy with the optimizer on a slower cadence, while the optimizer is in control it solves every message
+    bool takeover = time < policy_takeover_until;
+    if(takeover || policy_check_time < 0 || time - policy_check_time >= config.policy_check_period)
+    {
+        policy_check_time = time;
+        MPCSolution checked = problem(deadline);
+        if(checked.feasible)
+        {
+            Metrics::Instance.policy_checks++;
+            plan_buffer.Publish(checked, time);
+            if(fabs(checked.delta - solution.delta) > config.policy_delta_tolerance
+               || fabs(checked.acceleration - solution.acceleration) > config.policy_a_tolerance)
+            {
+                Metrics::Instance.policy_disagreements++;
+                policy_takeover_until = time + config.policy_takeover_time;
+                takeover = true;
+            }
+        }
+    }
+
+    // 2. After a disagreement the commands are taken from the optimizer plan
+    MPCSolution planned;
+    if(takeover && plan_buffer.Sample(time, planned))
+    {
+        return planned;
+    }
+
+    Metrics::Instance.policy_commands++;
+    return solution;
+}
+
+FrenetProblem Processor::StateFrenet(double px, double py, double psi, double v, int points_num)
+{
+    Config config = Config::GetConfig();
+    FrenetProblem problem;
+    problem.px = px;
+    problem.py = py;
+    problem.psi = psi;
+
+    // 1. Find car's position in path coordinates
+    problem.s0 = track_map->FindNearest(px, py);
+    TrackPoint p = track_map->GetPoint(problem.s0);
+    double n = -(px - p.x) * sin(p.heading) + (py - p.y) * cos(p.heading);
+    double mu = normalize_angle(psi - p.heading);
+
+    // 2. Look up curvature at the points the car is going to pass with its current speed
+    vector<double> stage_dt = config.GetStageDt(points_num);
+    problem.curvature.resize(points_num);
+    double time = 0;
+    for(int t = 0; t < points_num; t++)
+    {
+        problem.curvature[t] = track_map->GetCurvature(problem.s0 + v * time);
+        time += stage_dt[t];
+    }
+
+    problem.state = Eigen::VectorXd(3);
+    problem.state << n, mu, v;
+    return problem;
+}
+
+MPCSolution Processor::SolveFrenet(const FrenetProblem &problem, chrono::steady_clock::time_point deadline)
+{
+    MPC mpc;
+    mpc.SetDeadline(deadline);
+    MPCSolution solution = mpc.SolveFrenet(problem.state, problem.curvature, problem.curvature.size());
+
+    // Convert predicted trajectory to car's coordinates so it can be displayed
+    for(size_t i = 0; i < solution.s_vals.size(); i++)
+    {
+        TrackPoint q = track_map->GetPoint(problem.s0 + solution.s_vals[i]);
+        double new_x = q.x - solution.n_vals[i] * sin(q.heading) - problem.px;
+        double new_y = q.y + solution.n_vals[i] * cos(q.heading) - problem.py;
+        solution.x_vals.push_back(new_x * cos(problem.psi) + new_y * sin(problem.psi));
+        solution.y_vals.push_back(-new_x * sin(problem.psi) + new_y * cos(problem.psi));
+    }
+
+    return solution;
 }
 
 Response Processor::Process(vector<double> &pts_x, vector<double> &pts_y,
                             double px, double py, double psi, double v,
-                            double throttle, double steering_angle)
+                            double throttle, double steering_angle,
+                            chrono::steady_clock::time_point received)
 {
     // 1. Get start time to measure internal execution time and time between method calls
     double start_time = GetTimeS();
+    auto timeout = chrono::duration<double>(Config::GetConfig().solve_deadline);
+    auto deadline = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(timeout);
+    Metrics::Instance.cycles++;
 
     // 2. Calculate time between the method calls
     double time_delta = prev_time < 0 ? 0.1 : start_time - prev_time;
@@ -41,54 +501,216 @@ Response Processor::Process(vector<double> &pts_x, vector<double> &pts_y,
     // 3. convert speed from mile/h to m/s
     v = mileshour2meterssecond(v);
 
-    // 4. calculate current acceleration in m/s**2
-    double acceleration = (v - prev_speed) / time_delta;
-    prev_speed = v;
+    // 4. The telemetry describes the car when the message was received. The command is applied when it is sent,
+    // which is expected after the delay measured for the previous messages.
+    double received_time = ToSeconds(received);
+    double apply_time = received_time + av_command_delay;
 
-    // 5. calculate number of points in the predicted trajectory
+    // 5. take waypoints from the preprocessed track if it is available,
+    // so the reference doesn't depend on a few waypoints sent by the simulator
     Config config = Config::GetConfig();
-    int points_num = CalcPointsNum(pts_x, pts_y, v, config.dt, config.max_points_num);
+    if(GetTrackWaypoints(px, py, track_x, track_y))
+    {
+        pts_x = track_x;
+        pts_y = track_y;
+    }
+
+    // choose the preset for the speed and the curvature ahead, the whole cycle uses it
+    if(config.preset_schedule)
+    {
+        config = preset_schedule.Select(config, v, PresetSchedule::MaxCurvature(pts_x, pts_y));
+        if(config.target_v != scheduled_target_v)
+        {
+            Metrics::Instance.preset_switches++;
+            scheduled_target_v = config.target_v;
+        }
+        timeout = chrono::duration<double>(config.solve_deadline);
+        deadline = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(timeout);
+    }
+    ScopedConfig scoped_config(config);
+
+    // 6. calculate number of points in the predicted trajectory
+    int points_num = CalcPointsNum(pts_x, pts_y, v, config.GetStageDt(config.max_points_num),
+                                   config.max_points_num);
+
+    // and shorten it if its solve is not expected to finish in time: the solver thread has the whole deadline,
+    // otherwise it is the time left in this cycle. The model has the solve times of the polynomial formulation only,
+    // so the Frenet one is not governed.
+    bool frenet = config.formulation == Formulation::Frenet && track_map != nullptr && track_map->IsLoaded();
+    if(config.solve_time_governor && !frenet)
+    {
+        double budget = config.solve_deadline;
+        if(!config.async_solve)
+        {
+            budget = chrono::duration<double>(deadline - chrono::steady_clock::now()).count();
+        }
+        int governed = solve_time_model.Govern(config, last_warm_start, points_num, config.governor_min_points, budget);
+        if(governed < points_num)
+        {
+            Metrics::Instance.governor_shortened++;
+            points_num = governed;
+        }
+    }
+
+    // the telemetry is kept to predict the next one (see Speculate)
+    last_telemetry.pts_x = pts_x;
+    last_telemetry.pts_y = pts_y;
+    last_telemetry.px = px;
+    last_telemetry.py = py;
+    last_telemetry.psi = psi;
+    last_telemetry.v = v;
+    last_telemetry.delta = -steering_angle;
+    last_telemetry.a = throttle * 4;
+    last_telemetry.received_time = received_time;
+    last_config = config;
 
-    // 6. handle latency
-    // we consider latecy as the average execution time of this method
-    // and apply motion equations to the current state given this time
-    double latency = av_local_processing_time;
-    px = px + v * cos(psi) * latency;
-    py = py + v * sin(psi) * latency;
-    psi = psi - v * steering_angle / Lf * latency;
-    v = v + acceleration * latency;
+    // 7. handle latency
+    // until the command is applied the car follows the commands already sent (the actuations reported
+    // by the telemetry before the oldest kept one), so the motion equations are integrated with them over the delay
+    command_history.Predict(received_time, apply_time, -steering_angle, throttle * 4, px, py, psi, v);
 
     Response response;
-    Eigen::VectorXd xs(pts_x.size());
-    Eigen::VectorXd ys(pts_y.size());
-    Eigen::VectorXd state(6);
+    Eigen::VectorXd xs;
+    Eigen::VectorXd ys;
 
-    // 7. Convert waypoints to the new car's coordinates system keeping in mind latency
-    for(size_t i = 0; i < pts_x.size(); i++)
+    // 8. Convert waypoints to the new car's coordinates system keeping in mind latency
+    ToCarCoordinates(pts_x, pts_y, px, py, psi, xs, ys);
+
+    // also fill response waypoints
+    response.x_car_waypoints.assign(xs.data(), xs.data() + xs.size());
+    response.y_car_waypoints.assign(ys.data(), ys.data() + ys.size());
+
+    // 9. State the problem. Path coordinates formulation doesn't need any fitting, it takes curvature from the track map.
+    // The track map is searched here, so the problem can be solved on the solver thread.
+    // Commands are applied after the latency, so the plan starts at that time.
+    double plan_time = apply_time;
+    PlanOrigin origin;
+    origin.px = px;
+    origin.py = py;
+    origin.psi = psi;
+    AsyncSolver::Problem problem;
+    if(frenet)
     {
-        double new_x = pts_x.at(i) - px;
-        double new_y = pts_y.at(i) - py;
-        double x = new_x * cos(psi) + new_y * sin(psi);
-        double y = -new_x * sin(psi) + new_y * cos(psi);
+        FrenetProblem frenet = StateFrenet(px, py, psi, v, config.max_points_num);
+        problem = [this, frenet](chrono::steady_clock::time_point solve_deadline) {
+            return SolveFrenet(frenet, solve_deadline);
+        };
+    }
+    else
+    {
+        // the previous plan shifted to the time the command is applied is the nominal trajectory for the QP solver
+        vector<double> previous_delta, previous_a;
+        plan_buffer.GetShiftedPlan(plan_time, previous_delta, previous_a);
+        bool multi_start = config.multi_start_threads > 0;
+        problem = [this, xs, ys, v, points_num, previous_delta, previous_a, multi_start]
+                  (chrono::steady_clock::time_point solve_deadline) {
+            if(multi_start)
+            {
+                return SolveMultiStart(xs, ys, v, points_num, solve_deadline, previous_delta, previous_a);
+            }
+            return SolvePolynomial(xs, ys, v, points_num, solve_deadline, previous_delta, previous_a);
+        };
+    }
+
+    // the problem can be solved on the solver thread, it needs the config of this cycle there too
+    if(config.preset_schedule)
+    {
+        problem = [problem, config](chrono::steady_clock::time_point solve_deadline) {
+            ScopedConfig scoped(config);
+            return problem(solve_deadline);
+        };
+    }
 
-        xs[i] = x;
-        ys[i] = y;
+    // 10. Solve the problem.
+    // In asynchronous mode the optimizer runs in the background and the command is interpolated
+    // from the last plan it found, otherwise the optimizer has to find the solution before the deadline.
+    // In the geometric mode, selected or forced by the overload governor, the optimizer is not used at all.
+    MPCSolution solution;
+    bool has_solution = false;
+    bool geometric = config.controller == ControllerMode::Geometric
+                     || (config.overload_governor && !overload_governor.AllowSolve(start_time));
+    bool policy_primary = config.policy_primary && policy != nullptr && policy->Matches(config);
 
-        // also fill response waypoints
-        response.x_car_waypoints.push_back(x);
-        response.y_car_waypoints.push_back(y);
+    // after the config switches away from the background solver, its last solve is finished before solving here
+    if(geometric || policy_primary || !config.async_solve)
+    {
+        async_solver.Drain();
     }
 
-    // 8. Fit 3d order polynomial to the waypoints so it is in cars predicted coordinate system.
-    auto coeffs = polyfit(xs, ys, 3);
+    // the speculation made for this message is of no use when the optimizer doesn't answer it
+    if((geometric || policy_primary) && speculative_solver != nullptr)
+    {
+        speculative_solver->Cancel();
+    }
+
+    if(geometric)
+    {
+        solution = geometric_controller.Control(polyfit(xs, ys, 3), v, plan_time);
+        Metrics::Instance.geometric_commands++;
+        has_solution = true;
+    }
+    else if(policy_primary)
+    {
+        // the distilled policy answers and the optimizer only checks it
+        solution = RunPolicy(problem, polyfit(xs, ys, 3), v, plan_time, deadline);
+        has_solution = true;
+    }
+    else if(config.async_solve)
+    {
+        async_solver.SetSolvePeriod(config.solve_period);
+        async_solver.Submit(problem, plan_time, origin);
+        if(SamplePlan(plan_time, px, py, psi, v, solution))
+        {
+            Metrics::Instance.plan_commands++;
+            has_solution = true;
+        }
+    }
+    else
+    {
+        // the solution found before the message arrived is used if the state is close to the predicted one
+        if(config.speculative_solve && speculative_solver != nullptr
+           && speculative_solver->Take({px, py, psi, v}, config, deadline, solution))
+        {
+            Metrics::Instance.speculative_hits++;
+        }
+        else
+        {
+            if(config.speculative_solve)
+            {
+                Metrics::Instance.speculative_misses++;
+            }
 
+            // the speculation may have taken the whole cycle, the optimizer can't find anything after the deadline
+            if(chrono::steady_clock::now() < deadline)
+            {
+                solution = problem(deadline);
+            }
+            if(config.overload_governor)
+            {
+                overload_governor.Record(config, start_time, chrono::steady_clock::now() < deadline);
+            }
+        }
+        if(solution.feasible)
+        {
+            plan_buffer.Publish(solution, plan_time, origin);
+            has_solution = true;
+        }
+        else if(SamplePlan(plan_time, px, py, psi, v, solution))
+        {
+            // the optimizer didn't find anything usable in time, use the previous plan at the time passed
+            Metrics::Instance.fallback_previous_plan++;
+            has_solution = true;
+        }
+    }
 
-    // 9. Let optimizer find the solution to this polynomial trajectory given number of points
-    state << 0., 0., 0., v, coeffs[0], atan(-coeffs[1]);
-    MPC mpc;
-    auto solution = mpc.Solve(state, coeffs, points_num);
+    // 11. If there is no plan for this time, use the geometric controller which always has an answer.
+    if(!has_solution)
+    {
+        solution = geometric_controller.Control(polyfit(xs, ys, 3), v, plan_time);
+        Metrics::Instance.fallback_geometric++;
+    }
 
-    // 10. Fill the results structure
+    // 12. Fill the results structure
 
     // Convert steering angle according to simulator rules [-1 == -25 degrees, +1 == 25 degrees]
     response.steering_angle = -solution.delta/ deg2rad(25);
@@ -108,9 +730,84 @@ Response Processor::Process(vector<double> &pts_x, vector<double> &pts_y,
     // sleep to emulate actuators latency
     this_thread::sleep_for(chrono::milliseconds(100));
 
-    // memorize execution time
-    double end_time = GetTimeS();
-    av_local_processing_time = AddToEMA(av_local_processing_time, end_time - start_time);
-
     return response;
 }
+
+void Processor::CommandSent(const Response &response, chrono::steady_clock::time_point received,
+                            chrono::steady_clock::time_point sent)
+{
+    // the same conversions as in Process, in the opposite direction
+    double delta = -response.steering_angle * deg2rad(25);
+    double a = response.throttle * 4;
+    command_history.Add(ToSeconds(sent), delta, a);
+    av_command_delay = AddToEMA(av_command_delay, chrono::duration<double>(sent - received).count());
+
+    Speculate();
+}
+
+void Processor::ToCarCoordinates(const vector<double> &pts_x, const vector<double> &pts_y,
+                                 double px, double py, double psi, Eigen::VectorXd &xs, Eigen::VectorXd &ys)
+{
+    xs.resize(pts_x.size());
+    ys.resize(pts_y.size());
+    for(size_t i = 0; i < pts_x.size(); i++)
+    {
+        double new_x = pts_x.at(i) - px;
+        double new_y = pts_y.at(i) - py;
+        xs[i] = new_x * cos(psi) + new_y * sin(psi);
+        ys[i] = -new_x * sin(psi) + new_y * cos(psi);
+    }
+}
+
+void Processor::Speculate()
+{
+    Config config = last_config;
+    bool frenet = config.formulation == Formulation::Frenet && track_map != nullptr && track_map->IsLoaded();
+    bool geometric = config.controller == ControllerMode::Geometric
+                     || (config.overload_governor && overload_governor.IsShedding());
+    bool policy_primary = config.policy_primary && policy != nullptr && policy->Matches(config);
+    if(!config.speculative_solve || config.async_solve || frenet || geometric || policy_primary
+       || last_telemetry.received_time < 0)
+    {
+        return;
+    }
+
+    // 1. The next message is expected the average iteration time after the last one and the command sent now
+    // is held until the command for it is applied, so the state at that time is predicted with the sent commands
+    const Telemetry &last = last_telemetry;
+    double next_apply_time = last.received_time + av_iteration_time + av_command_delay;
+    SpeculativeState state = {last.px, last.py, last.psi, last.v};
+    command_history.Predict(last.received_time, next_apply_time, last.delta, last.a,
+                            state.px, state.py, state.psi, state.v);
+
+    // 2. State the problem the same way as Process does
+    vector<double> pts_x = last.pts_x;
+    vector<double> pts_y = last.pts_y;
+    GetTrackWaypoints(state.px, state.py, pts_x, pts_y);
+    int points_num = CalcPointsNum(pts_x, pts_y, state.v, config.GetStageDt(config.max_points_num),
+                                   config.max_points_num);
+    if(config.solve_time_governor)
+    {
+        // the speculation has the whole deadline
+        points_num = solve_time_model.Govern(config, last_warm_start, points_num, config.governor_min_points,
+                                             config.solve_deadline);
+    }
+    Eigen::VectorXd xs, ys;
+    ToCarCoordinates(pts_x, pts_y, state.px, state.py, state.psi, xs, ys);
+    vector<double> previous_delta, previous_a;
+    plan_buffer.GetShiftedPlan(next_apply_time, previous_delta, previous_a);
+
+    // 3. Solve it in the background. Its solve time is not recorded: a missed speculation is not the solve
+    // the governor plans for.
+    if(speculative_solver == nullptr)
+    {
+        speculative_solver.reset(new SpeculativeSolver());
+    }
+    double v = state.v;
+    speculative_solver->Start(state, config, [this, xs, ys, v, points_num, previous_delta, previous_a, config]
+                                            (chrono::steady_clock::time_point solve_deadline,
+                                             const atomic<bool> &cancel) {
+        ScopedConfig scoped(config);
+        return SolvePolynomial(xs, ys, v, points_num, solve_deadline, previous_delta, previous_a, &cancel, false);
+    });
+}
@@ -1,10 +1,29 @@
 #ifndef MPC_PROCESSOR_H
 #define MPC_PROCESSOR_H
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include "config.h"
+#include "track.h"
+#include "MPC.h"
+#include "geometric_controller.h"
+#include "plan_buffer.h"
+#include "async_solver.h"
+#include "explicit_table.h"
+#include "mlp_policy.h"
+#include "thread_pool.h"
+#include "preset_schedule.h"
+#include "solve_time_model.h"
+#include "command_history.h"
+#include "speculative_solver.h"
+#include "tracking_controller.h"
+#include "overload_governor.h"
 
 using namespace std;
 
@@ -29,38 +48,193 @@ class Response
         double throttle;
 };
 
+// Telemetry of a message in global coordinates with the speed in m/s and the actuations in the model units
+class Telemetry
+{
+    public:
+        vector<double> pts_x;
+        vector<double> pts_y;
+        double px = 0;
+        double py = 0;
+        double psi = 0;
+        double v = 0;
+        double delta = 0;
+        double a = 0;
+
+        // time the message was received, seconds (see Processor::GetTimeS), negative if there was none
+        double received_time = -1;
+};
+
+// Problem in path coordinates stated from the car's pose.
+// Stating it needs the nearest point search, solving it only reads the track points.
+class FrenetProblem
+{
+    public:
+        // car's pose in global coordinates
+        double px = 0;
+        double py = 0;
+        double psi = 0;
+
+        // car's progress along the track
+        double s0 = 0;
+
+        // lateral offset, heading error and velocity
+        Eigen::VectorXd state;
+
+        // track curvature at every point of the horizon
+        vector<double> curvature;
+};
+
 
 //Represents processing of telemetry recieved from simulator
 class Processor
 {
     private:
-        // Last recorded speed. It is needed for acceleration calculation.
-        double prev_speed = 0;
-
         // Last recorded time.
         double prev_time = -1;
 
-        // Average time that it takes to execute Process method.
-        double av_local_processing_time = 0.1;
+        // Average time between receiving the telemetry and sending the command for it,
+        // measured with the timestamps of every message (see CommandSent).
+        double av_command_delay = 0.1;
+
+        // Commands sent to the simulator, the state is predicted with them over the delay
+        CommandHistory command_history;
 
         // Average time span between calls of Process method.
         // I.e. after how much time since calling Process method it will be called again.
         double av_iteration_time        = 0.1;
 
+        // Preprocessed track, if it is set waypoints are taken from it instead of the telemetry
+        Track *track_map = nullptr;
+
+        // Offline solutions used when Config::solver is ExplicitTable
+        const ExplicitTable *explicit_table = nullptr;
+
+        // Buffers for waypoints taken from the track map
+        vector<double> track_x;
+        vector<double> track_y;
+
+        // The last plan found by the optimizer, commands between the solves are interpolated from it
+        PlanBuffer plan_buffer;
+
+        // Runs the optimizer in the background if Config::async_solve is set
+        AsyncSolver async_solver{plan_buffer};
+
+        // Primary controller if Config::policy_primary is set
+        const MlpPolicy *policy = nullptr;
+
+        // Time of the last optimizer check of the policy and until when the optimizer keeps control after a disagreement
+        double policy_check_time = -1;
+        double policy_takeover_until = -1;
+
+        // Past solutions used as initial points of the optimizer if Config::solution_cache_size is set
+        SolutionCache solution_cache;
+
+        // Solves the multi-start candidates, it is created when Config::multi_start_threads is set
+        unique_ptr<ThreadPool> thread_pool;
+        int thread_pool_size = 0;
+        atomic<bool> multi_start_refused{false};
+
+        // Condenses the segments of the horizon with SolverType::ParallelLtv, it is created when Config::parallel_threads
+        // is more than 1. Its workers don't use CppAD. The problems can be solved on other threads, they keep the pool
+        // they started with.
+        shared_ptr<ThreadPool> time_pool;
+        int time_pool_size = 0;
+        mutex time_pool_mutex;
+
+        // Rebuilds the solution cache after the config is reloaded, the thread has its own CppAD thread number.
+        // Every reload increments the generation, the rebuild of an older one is cancelled between its solves.
+        unique_ptr<CppADThread> rebuild_cppad_thread;
+        thread rebuild_thread;
+        mutex rebuild_mutex;
+        condition_variable rebuild_changed;
+        uint64_t rebuild_generation = 0;
+        bool rebuild_pending = false;
+        bool rebuild_stop = false;
+
+        // Chooses the speed preset every cycle if Config::preset_schedule is set
+        PresetSchedule preset_schedule;
+        double scheduled_target_v = -1;
+
+        // Solve times of the optimizer by the number of points, the governor picks the horizon with it.
+        // last_warm_start is the warm start kind of the last solve, the next one is most likely the same.
+        SolveTimeModel solve_time_model;
+        atomic<bool> last_warm_start{false};
+
+        // Solves the problem of the next message while waiting for it if Config::speculative_solve is set,
+        // it is created on the first speculation. The last telemetry and the config of its cycle are kept
+        // to predict the next state.
+        unique_ptr<SpeculativeSolver> speculative_solver;
+        Telemetry last_telemetry;
+        Config last_config;
+
+        // Follows the last plan between the solves if Config::tracking_law is set
+        TrackingController tracking_controller;
+
+        // Switches to the geometric controller when the solves don't finish in time if Config::overload_governor is set
+        OverloadGovernor overload_governor;
+
+        // Controller used when the optimizer can't find a solution in time and there is no plan,
+        // and the whole controller in the geometric mode
+        GeometricController geometric_controller;
+
     public:
 
-        // returns current time in seconds (ms part is shown after the decimal point)
+        // sets preprocessed track, nullptr disables it
+        void SetTrackMap(Track *track_map)
+        {
+            this->track_map = track_map;
+        }
+
+        // sets explicit MPC table, nullptr disables it
+        void SetExplicitTable(const ExplicitTable *explicit_table)
+        {
+            this->explicit_table = explicit_table;
+        }
+
+        // sets distilled policy, nullptr disables it
+        void SetPolicy(const MlpPolicy *policy)
+        {
+            this->policy = policy;
+        }
+
+        // Solves a straight and a curved problem with every speed preset, so the first solves after switching
+        // between them don't pay for the first allocations and the solution cache has entries for all of them.
+        // Their solve times are not added to the solve time model.
+        void WarmUpPresets();
+
+        // Called after a new config is published (see ConfigWatcher): solves the cached problems again
+        // with the new config on the rebuild thread and returns immediately, the controller keeps using the old
+        // solutions meanwhile. A rebuild still running for an older config is cancelled and started again.
+        // Unless IPOPT solves can run concurrently (see MPC::ConcurrentSolves), the rebuild solves take turns
+        // with the ones of the controller.
+        void OnConfigChanged();
+
+        // Stops the rebuild thread
+        ~Processor();
+
+        // returns the time point in seconds of the monotonic clock with its full resolution
+        static double ToSeconds(chrono::steady_clock::time_point time)
+        {
+            return chrono::duration<double>(time.time_since_epoch()).count();
+        }
+
+        // returns current time in seconds
         double GetTimeS()
         {
-            auto now = std::chrono::system_clock::now().time_since_epoch();
-            auto now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
-            return now_ms / 1000.;
+            return ToSeconds(chrono::steady_clock::now());
         }
 
         // recieves telemetry data and returns actinos and displayed points
+        // received is the time the message was received, as close to the socket as possible
         Response Process(vector<double> &pts_x, vector<double> &pts_y,
                          double px, double py, double psi, double v,
-                         double throttle, double steering_angle);
+                         double throttle, double steering_angle,
+                         chrono::steady_clock::time_point received);
+
+        // Records the command of the response sent at the given time for the message received at the given time
+        void CommandSent(const Response &response, chrono::steady_clock::time_point received,
+                         chrono::steady_clock::time_point sent);
 
 
         // adds values using exponential moving average
@@ -73,7 +247,61 @@ class Processor
         // approximately the same length as the target trajectory.
         // Otherwise if we try to fit a trajectory that is much longer that the target line,
         // the optimizer produces bad results.
-        int CalcPointsNum(vector<double> &x, vector<double> &y, double v, double dt, int max_points_num);
+        // stage_dt are time steps of the horizon (see Config::GetStageDt).
+        int CalcPointsNum(vector<double> &x, vector<double> &y, double v, const vector<double> &stage_dt,
+                          int max_points_num);
+
+        // Converts the waypoints to the coordinates of the car at the given pose
+        static void ToCarCoordinates(const vector<double> &pts_x, const vector<double> &pts_y,
+                                     double px, double py, double psi, Eigen::VectorXd &xs, Eigen::VectorXd &ys);
+
+        // Predicts the state when the command for the next message is applied and starts solving its problem
+        // (see Config::speculative_solve)
+        void Speculate();
+
+        // Command from the last plan at the given time for the car's pose (global coordinates) and velocity then,
+        // corrected by the tracking law if Config::tracking_law is set. Returns false if there is no plan for this time.
+        bool SamplePlan(double time, double px, double py, double psi, double v, MPCSolution &solution);
+
+        // Fills waypoints ahead of the car from the track map. Returns false if the track map is not loaded.
+        bool GetTrackWaypoints(double px, double py, vector<double> &x, vector<double> &y);
+
+        // Pool condensing the segments of SolverType::ParallelLtv with the config, it is created when parallel_threads
+        // changes. Returns nullptr if the segments are condensed on the calling thread: parallel_threads is at most 1
+        // or the pool can't start its threads. Thread safe.
+        shared_ptr<ThreadPool> GetTimePool(const Config &config);
+
+        // Loop of the rebuild thread: rebuilds the solution cache for the latest reload
+        void RunRebuilds();
+
+        // Fits polynomial to the waypoints in car's coordinates and solves the problem against it.
+        // The previous plan shifted to now is used by the QP solver, it can be empty.
+        // With the explicit MPC the first actuations are taken from the table if the problem is in its validated region.
+        // The optimizer is stopped as at the deadline once cancel is set (see MPC::SetCancel).
+        // The solve time is added to the solve time model if timed is set, the concurrent solves don't set it.
+        MPCSolution SolvePolynomial(const Eigen::VectorXd &xs, const Eigen::VectorXd &ys, double v, int points_num,
+                                    chrono::steady_clock::time_point deadline,
+                                    const vector<double> &previous_delta = vector<double>(),
+                                    const vector<double> &previous_a = vector<double>(),
+                                    const atomic<bool> *cancel = nullptr, bool timed = true);
+
+        // Solves the problem for a few horizons around points_num and for the neighbouring speed presets concurrently
+        // (see Config::multi_start_threads), returns the best feasible plan by the common cost.
+        // Solves only points_num with the current config if IPOPT solves can't run concurrently.
+        MPCSolution SolveMultiStart(const Eigen::VectorXd &xs, const Eigen::VectorXd &ys, double v, int points_num,
+                                    chrono::steady_clock::time_point deadline,
+                                    const vector<double> &previous_delta, const vector<double> &previous_a);
+
+        // Commands from the distilled policy checked by the optimizer on a slower cadence (see Config::policy_primary).
+        // problem is the optimizer problem for the same state, coeffs are the fitted polynomial.
+        MPCSolution RunPolicy(const AsyncSolver::Problem &problem, const Eigen::VectorXd &coeffs, double v,
+                              double time, chrono::steady_clock::time_point deadline);
+
+        // States the problem in path coordinates along the track map, car's pose is in global coordinates.
+        FrenetProblem StateFrenet(double px, double py, double psi, double v, int points_num);
+
+        // Solves the problem in path coordinates. Predicted trajectory is converted to car's coordinates.
+        MPCSolution SolveFrenet(const FrenetProblem &problem, chrono::steady_clock::time_point deadline);
 };
 
 #endif //MPC_PROCESSOR_H
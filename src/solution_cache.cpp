@@ -0,0 +1,184 @@
+#include "solution_cache.h"
+
+#include <cmath>
+#include <limits>
+
+// Feature differences of this size are considered equally far, so the distance is in "typical steps" of every feature:
+// velocity (m/s), cte (m), epsi (rad), quadratic and cubic polynomial coefficients
+const double K_FEATURE_SCALES[K_CACHE_FEATURES] = {2, 0.25, 0.03, 0.003, 0.0001};
+
+void SolutionCache::GetFeatures(const Eigen::VectorXd &state, const Eigen::VectorXd &coeffs,
+                                float features[K_CACHE_FEATURES])
+{
+    double values[K_CACHE_FEATURES] = {state[3], state[4], state[5], coeffs[2], coeffs[3]};
+    for(int i = 0; i < K_CACHE_FEATURES; i++)
+    {
+        features[i] = (float)(values[i] / K_FEATURE_SCALES[i]);
+    }
+}
+
+void SolutionCache::SetCapacity(size_t capacity)
+{
+    lock_guard<mutex> lock(cache_mutex);
+    this->capacity = capacity;
+    if(points_nums.size() > capacity)
+    {
+        features.resize(capacity * K_CACHE_FEATURES);
+        points_nums.resize(capacity);
+        solutions.resize(capacity);
+        last_used.resize(capacity);
+        added.resize(capacity);
+    }
+}
+
+bool SolutionCache::Find(const Eigen::VectorXd &state, const Eigen::VectorXd &coeffs, int points_num, size_t vars_num,
+                         double max_distance, vector<double> &vars)
+{
+    float query[K_CACHE_FEATURES];
+    GetFeatures(state, coeffs, query);
+
+    lock_guard<mutex> lock(cache_mutex);
+    size_t best = points_nums.size();
+    float best_distance2 = (float)(max_distance * max_distance);
+    for(size_t i = 0; i < points_nums.size(); i++)
+    {
+        const float *entry = &features[i * K_CACHE_FEATURES];
+        float distance2 = 0;
+        for(int k = 0; k < K_CACHE_FEATURES; k++)
+        {
+            float d = entry[k] - query[k];
+            distance2 += d * d;
+        }
+        if(distance2 <= best_distance2 && points_nums[i] == points_num && solutions[i].size() == vars_num)
+        {
+            best = i;
+            best_distance2 = distance2;
+        }
+    }
+
+    if(best == points_nums.size())
+    {
+        return false;
+    }
+
+    last_used[best] = ++tick;
+    vars = solutions[best];
+    return true;
+}
+
+void SolutionCache::Add(const Eigen::VectorXd &state, const Eigen::VectorXd &coeffs, int points_num,
+                        const vector<double> &vars)
+{
+    lock_guard<mutex> lock(cache_mutex);
+    if(capacity == 0)
+    {
+        return;
+    }
+
+    // append while there is space, otherwise replace the least recently used entry
+    size_t slot = points_nums.size();
+    if(slot < capacity)
+    {
+        features.resize(features.size() + K_CACHE_FEATURES);
+        points_nums.push_back(points_num);
+        solutions.push_back(vars);
+        last_used.push_back(0);
+        added.push_back(0);
+    }
+    else
+    {
+        uint64_t oldest = numeric_limits<uint64_t>::max();
+        for(size_t i = 0; i < last_used.size(); i++)
+        {
+            if(last_used[i] < oldest)
+            {
+                oldest = last_used[i];
+                slot = i;
+            }
+        }
+        points_nums[slot] = points_num;
+        solutions[slot] = vars;
+    }
+
+    GetFeatures(state, coeffs, &features[slot * K_CACHE_FEATURES]);
+    last_used[slot] = ++tick;
+    added[slot] = tick;
+}
+
+bool SolutionCache::Rebuild(const function<bool(const Eigen::VectorXd &state, const Eigen::VectorXd &coeffs,
+                                                int points_num, SolutionCache &rebuilt)> &solve)
+{
+    // 1. Copy the problems
+    vector<float> old_features;
+    vector<int> old_points_nums;
+    uint64_t start_tick;
+    SolutionCache rebuilt;
+    {
+        lock_guard<mutex> lock(cache_mutex);
+        old_features = features;
+        old_points_nums = points_nums;
+        start_tick = tick;
+        rebuilt.capacity = capacity;
+    }
+
+    // 2. Solve them again, the state and the polynomial are restored from the features
+    Eigen::VectorXd state(6);
+    Eigen::VectorXd coeffs(4);
+    for(size_t i = 0; i < old_points_nums.size(); i++)
+    {
+        double values[K_CACHE_FEATURES];
+        for(int k = 0; k < K_CACHE_FEATURES; k++)
+        {
+            values[k] = old_features[i * K_CACHE_FEATURES + k] * K_FEATURE_SCALES[k];
+        }
+        state << 0., 0., 0., values[0], values[1], values[2];
+        coeffs << values[1], -tan(values[2]), values[3], values[4];
+        if(!solve(state, coeffs, old_points_nums[i], rebuilt))
+        {
+            return false;
+        }
+    }
+
+    // 3. Keep the entries added since the start, they are solved with the new config, and replace the rest
+    lock_guard<mutex> lock(cache_mutex);
+    for(size_t i = 0; i < points_nums.size() && rebuilt.points_nums.size() < capacity; i++)
+    {
+        if(added[i] > start_tick)
+        {
+            rebuilt.features.insert(rebuilt.features.end(), &features[i * K_CACHE_FEATURES],
+                                    &features[(i + 1) * K_CACHE_FEATURES]);
+            rebuilt.points_nums.push_back(points_nums[i]);
+            rebuilt.solutions.push_back(solutions[i]);
+            rebuilt.last_used.push_back(0);
+            rebuilt.added.push_back(0);
+        }
+    }
+    features.swap(rebuilt.features);
+    points_nums.swap(rebuilt.points_nums);
+    solutions.swap(rebuilt.solutions);
+    last_used.swap(rebuilt.last_used);
+    added.swap(rebuilt.added);
+    for(size_t i = 0; i < points_nums.size(); i++)
+    {
+        last_used[i] = ++tick;
+        added[i] = tick;
+    }
+    return true;
+}
+
+size_t SolutionCache::Size() const
+{
+    lock_guard<mutex> lock(cache_mutex);
+    return points_nums.size();
+}
+
+void SolutionCache::Clear()
+{
+    lock_guard<mutex> lock(cache_mutex);
+    features.clear();
+    points_nums.clear();
+    solutions.clear();
+    last_used.clear();
+    added.clear();
+    tick = 0;
+}
@@ -0,0 +1,76 @@
+#ifndef MPC_SOLUTION_CACHE_H
+#define MPC_SOLUTION_CACHE_H
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "Eigen-3.3/Eigen/Core"
+
+using namespace std;
+
+// Number of the problem features the solutions are compared by:
+// velocity, cte, epsi and the quadratic and cubic polynomial coefficients.
+// The state of the polynomial formulation is [0, 0, 0, v, cte, epsi] and the linear coefficient is -tan(epsi),
+// so together with the number of points they define the whole problem for the given config.
+const int K_CACHE_FEATURES = 5;
+
+// Cache of the solutions found by the optimizer: (state, polynomial, number of points) -> optimizer variables
+// (the trajectory and the actuations). The solution of the closest cached problem is a better initial point
+// than zeros, especially after sharp transients when the previous plan doesn't fit anymore.
+//
+// Memory is bounded by the number of entries, the least recently used entry is replaced when the cache is full.
+// Features are stored in one contiguous array which is scanned on every lookup, for a few thousand entries
+// it takes microseconds, which is nothing compared to an optimizer run.
+// It is used by the solver thread and the message handler, so all the methods are synchronized.
+class SolutionCache
+{
+    public:
+        // Sets the maximum number of entries, 0 disables the cache. Entries above the capacity are dropped.
+        void SetCapacity(size_t capacity);
+
+        // Finds the closest cached solution of a problem with the same number of points and variables.
+        // Returns false if there is none within max_distance (in the scaled features, see solution_cache.cpp).
+        bool Find(const Eigen::VectorXd &state, const Eigen::VectorXd &coeffs, int points_num, size_t vars_num,
+                  double max_distance, vector<double> &vars);
+
+        // Adds the solution, replaces the least recently used one if the cache is full
+        void Add(const Eigen::VectorXd &state, const Eigen::VectorXd &coeffs, int points_num,
+                 const vector<double> &vars);
+
+        // Re-solves the cached problems after the config has changed, so the cache keeps its coverage.
+        // solve must solve the problem with the new config and add the solution to the given cache,
+        // it returns false to cancel the rebuild. The problems are copied and solved without holding the lock,
+        // so Find and Add work meanwhile; the solutions are swapped in at the end together with the entries added
+        // since the start. Returns false if the rebuild was cancelled, the cache is not changed then.
+        bool Rebuild(const function<bool(const Eigen::VectorXd &state, const Eigen::VectorXd &coeffs, int points_num,
+                                         SolutionCache &rebuilt)> &solve);
+
+        size_t Size() const;
+
+        void Clear();
+
+    private:
+        mutable mutex cache_mutex;
+
+        size_t capacity = 0;
+
+        // features of every entry, K_CACHE_FEATURES values per entry
+        vector<float> features;
+
+        vector<int> points_nums;
+        vector<vector<double>> solutions;
+
+        // tick of the last lookup or insert of every entry
+        vector<uint64_t> last_used;
+
+        // tick of the insert of every entry
+        vector<uint64_t> added;
+        uint64_t tick = 0;
+
+        static void GetFeatures(const Eigen::VectorXd &state, const Eigen::VectorXd &coeffs,
+                                float features[K_CACHE_FEATURES]);
+};
+
+#endif //MPC_SOLUTION_CACHE_H
@@ -0,0 +1,126 @@
+#include "solve_time_model.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Eigen-3.3/Eigen/Dense"
+#include "ltv_mpc.h"
+
+// Scale of the number of points in the features, so the least squares problem is well conditioned
+const double K_POINTS_SCALE = 30;
+
+// Weight of the past solves is multiplied by this with every new one (effective memory of 200 solves)
+const double K_FORGETTING = 0.995;
+
+// Initial uncertainty of the coefficients, milliseconds
+const double K_INITIAL_COVARIANCE = 1e4;
+
+// Solves needed before the predictions are used
+const int K_MIN_SOLVES = 20;
+
+// 99th percentile of the standard normal distribution
+const double K_P99_SIGMAS = 2.33;
+
+SolveTimeModel::SolveTimeModel()
+{
+    for(auto &solver_fits : fits)
+    {
+        for(auto &preset_fits : solver_fits)
+        {
+            for(Fit &fit : preset_fits)
+            {
+                fit.theta.setZero();
+                fit.covariance = Eigen::Matrix3d::Identity() * K_INITIAL_COVARIANCE;
+            }
+        }
+    }
+}
+
+int SolveTimeModel::SolverIndex(const Config &config, int points_num)
+{
+    if(config.solver == SolverType::ParallelLtv
+       || (config.solver == SolverType::LtvQp && points_num > K_LTV_MAX_POINTS))
+    {
+        return 2;
+    }
+    return config.solver == SolverType::LtvQp ? 1 : 0;
+}
+
+int SolveTimeModel::PresetIndex(const Config &config)
+{
+    static const vector<Config> presets = SpeedPresets();
+    int closest = 0;
+    for(int i = 1; i < (int)presets.size() && i < K_MODEL_PRESETS; i++)
+    {
+        if(fabs(presets[i].target_v - config.target_v) < fabs(presets[closest].target_v - config.target_v))
+        {
+            closest = i;
+        }
+    }
+    return closest;
+}
+
+Eigen::Vector3d SolveTimeModel::Features(int points_num)
+{
+    double n = points_num / K_POINTS_SCALE;
+    return Eigen::Vector3d(1, n, n * n);
+}
+
+void SolveTimeModel::Add(const Config &config, bool warm_start, int points_num, double solve_time)
+{
+    Eigen::Vector3d x = Features(points_num);
+    double y = solve_time * 1000;
+    int solver = SolverIndex(config, points_num);
+    int preset = PresetIndex(config);
+
+    lock_guard<mutex> lock(model_mutex);
+    Fit &fit = fits[solver][preset][warm_start ? 1 : 0];
+
+    // spread is measured against the prediction before the update
+    double predicted = max(x.dot(fit.theta), 1e-2);
+    if(fit.solves > 0)
+    {
+        double relative = (y - predicted) / predicted;
+        fit.relative_variance = K_FORGETTING * fit.relative_variance + (1 - K_FORGETTING) * relative * relative;
+        fit.variance_weight = K_FORGETTING * fit.variance_weight + (1 - K_FORGETTING);
+    }
+
+    // recursive least squares with exponential forgetting
+    Eigen::Vector3d px = fit.covariance * x;
+    Eigen::Vector3d gain = px / (K_FORGETTING + x.dot(px));
+    fit.theta += gain * (y - x.dot(fit.theta));
+    fit.covariance = (fit.covariance - gain * px.transpose()) / K_FORGETTING;
+    fit.solves++;
+}
+
+bool SolveTimeModel::PredictP99(const Config &config, bool warm_start, int points_num, double &solve_time) const
+{
+    int solver = SolverIndex(config, points_num);
+    int preset = PresetIndex(config);
+
+    lock_guard<mutex> lock(model_mutex);
+    const Fit &fit = fits[solver][preset][warm_start ? 1 : 0];
+    if(fit.solves < K_MIN_SOLVES)
+    {
+        return false;
+    }
+
+    double mean = max(Features(points_num).dot(fit.theta), 1e-2);
+    double relative_variance = fit.relative_variance / fit.variance_weight;
+    solve_time = mean * (1 + K_P99_SIGMAS * sqrt(relative_variance)) / 1000;
+    return true;
+}
+
+int SolveTimeModel::Govern(const Config &config, bool warm_start, int points_num, int min_points_num,
+                           double budget) const
+{
+    for(int n = points_num; n > min_points_num; n--)
+    {
+        double p99;
+        if(!PredictP99(config, warm_start, n, p99) || p99 <= budget)
+        {
+            return n;
+        }
+    }
+    return min(points_num, min_points_num);
+}
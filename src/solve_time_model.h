@@ -0,0 +1,63 @@
+#ifndef MPC_SOLVE_TIME_MODEL_H
+#define MPC_SOLVE_TIME_MODEL_H
+
+#include <mutex>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "config.h"
+
+using namespace std;
+
+// Number of the solvers, speed presets and warm start kinds the model keeps separate fits for
+const int K_MODEL_SOLVERS = 3;
+const int K_MODEL_PRESETS = 3;
+const int K_MODEL_STARTS = 2;
+
+// Online model of the optimizer solve time learned from the measured solves.
+// For every solver (IPOPT, LtvQp and ParallelLtv), speed preset and warm start kind (started from the previous plan
+// or from nothing) the mean solve time
+// is fitted as a quadratic in the number of points by recursive least squares with forgetting, the spread is tracked
+// as an exponential average of the squared relative residuals, bias corrected for its zero start.
+// The p99 is mean * (1 + 2.33 * relative deviation).
+// Forgetting makes the model follow the machine: when other processes take the CPU, the predictions grow within
+// a few dozen solves. It is used by the solver threads and the message handler, so the methods are synchronized.
+class SolveTimeModel
+{
+    public:
+        SolveTimeModel();
+
+        // Adds a measured solve, seconds. Only the solves which had the CPU for themselves should be added.
+        void Add(const Config &config, bool warm_start, int points_num, double solve_time);
+
+        // Predicted 99th percentile of the solve time, seconds. Returns false if there are not enough solves yet.
+        bool PredictP99(const Config &config, bool warm_start, int points_num, double &solve_time) const;
+
+        // The largest number of points not above points_num and not below min_points_num whose predicted p99
+        // fits into the budget (seconds). points_num is returned while the model has not enough solves.
+        int Govern(const Config &config, bool warm_start, int points_num, int min_points_num, double budget) const;
+
+    private:
+        struct Fit
+        {
+            // coefficients of [1, n, n^2] with n = points_num / K_POINTS_SCALE, milliseconds
+            Eigen::Vector3d theta;
+            Eigen::Matrix3d covariance;
+            double relative_variance = 0;
+
+            // total weight of the squared residuals in relative_variance, 1 - K_FORGETTING^residuals:
+            // the average starts at zero, so it is divided by this until it has forgotten its start
+            double variance_weight = 0;
+            int solves = 0;
+        };
+
+        mutable mutex model_mutex;
+        Fit fits[K_MODEL_SOLVERS][K_MODEL_PRESETS][K_MODEL_STARTS];
+
+        // Solver which solves the problem of points_num points with the config: the table misses are solved by IPOPT,
+        // long LtvQp problems by ParallelLtv (see MPC::SolveLtv)
+        static int SolverIndex(const Config &config, int points_num);
+        static int PresetIndex(const Config &config);
+        static Eigen::Vector3d Features(int points_num);
+};
+
+#endif //MPC_SOLVE_TIME_MODEL_H
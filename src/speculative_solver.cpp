@@ -0,0 +1,124 @@
+#include "speculative_solver.h"
+
+#include <cmath>
+
+SpeculativeSolver::SpeculativeSolver()
+{
+    driver_thread = thread(&SpeculativeSolver::Run, this);
+}
+
+SpeculativeSolver::~SpeculativeSolver()
+{
+    {
+        lock_guard<mutex> lock(speculation_mutex);
+        stop = true;
+    }
+    speculation_changed.notify_all();
+    driver_thread.join();
+}
+
+void SpeculativeSolver::Start(const SpeculativeState &state, const Config &config, Problem problem)
+{
+    {
+        lock_guard<mutex> lock(speculation_mutex);
+        this->state = state;
+        config.GetKey(config_key);
+        solve_deadline = config.solve_deadline;
+        this->problem = move(problem);
+        has_problem = true;
+        has_solution = false;
+        generation++;
+        if(solving)
+        {
+            cancel = true;
+        }
+    }
+    speculation_changed.notify_all();
+}
+
+void SpeculativeSolver::Drop(unique_lock<mutex> &lock)
+{
+    has_problem = false;
+    has_solution = false;
+    generation++;
+    if(solving)
+    {
+        cancel = true;
+        speculation_changed.wait(lock, [this]() { return !solving; });
+    }
+}
+
+void SpeculativeSolver::Cancel()
+{
+    unique_lock<mutex> lock(speculation_mutex);
+    Drop(lock);
+}
+
+bool SpeculativeSolver::Take(const SpeculativeState &state, const Config &config,
+                             chrono::steady_clock::time_point deadline, MPCSolution &solution)
+{
+    unique_lock<mutex> lock(speculation_mutex);
+    bool matches = fabs(state.px - this->state.px) <= config.speculative_position_tolerance
+                   && fabs(state.py - this->state.py) <= config.speculative_position_tolerance
+                   && fabs(normalize_angle(state.psi - this->state.psi)) <= config.speculative_heading_tolerance
+                   && fabs(state.v - this->state.v) <= config.speculative_speed_tolerance
+                   && config.MatchesKey(config_key);
+
+    // the speculation which is not started yet is not ahead of solving now
+    bool started = !has_problem && (has_solution || (solving && solving_generation == generation));
+    if(!matches || !started)
+    {
+        Drop(lock);
+        return false;
+    }
+
+    // the optimizer stopped at the deadline returns its best feasible iterate
+    if(!speculation_changed.wait_until(lock, deadline, [this]() { return !solving; }))
+    {
+        cancel = true;
+        speculation_changed.wait(lock, [this]() { return !solving; });
+    }
+    bool taken = has_solution && this->solution.feasible;
+    if(taken)
+    {
+        solution = this->solution;
+    }
+    has_solution = false;
+    generation++;
+    return taken;
+}
+
+void SpeculativeSolver::Run()
+{
+    cppad_thread.Enter();
+    unique_lock<mutex> lock(speculation_mutex);
+    while(true)
+    {
+        speculation_changed.wait(lock, [this]() { return stop || has_problem; });
+        if(stop)
+        {
+            cppad_thread.Leave();
+            return;
+        }
+
+        Problem current = move(problem);
+        has_problem = false;
+        solving = true;
+        solving_generation = generation;
+        cancel = false;
+        auto timeout = chrono::duration<double>(solve_deadline);
+        lock.unlock();
+
+        auto deadline = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(timeout);
+        MPCSolution result = current(deadline, cancel);
+
+        lock.lock();
+        if(solving_generation == generation)
+        {
+            solution = result;
+            has_solution = true;
+        }
+        solving = false;
+        speculation_changed.notify_all();
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef MPC_SPECULATIVE_SOLVER_H
+#define MPC_SPECULATIVE_SOLVER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "MPC.h"
+#include "config.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+// Car's pose and speed in global coordinates at the time the command is applied
+struct SpeculativeState
+{
+    double px;
+    double py;
+    double psi;
+    double v;
+};
+
+// Solves the problem of the next telemetry message before it arrives (see Config::speculative_solve).
+// Right after a command is sent the next state is predicted and its problem is solved in the background,
+// when the message arrives and its state is within the tolerances of the predicted one, the solution is taken
+// instead of solving (waiting for it if it is not finished yet). Otherwise the speculation is cancelled and stopped
+// before the message handler solves, so the two solves don't run at once.
+// The solving thread has its own CppAD thread number, so its tapes don't interfere with the ones of the message handler.
+class SpeculativeSolver
+{
+    public:
+        // Solves the problem on the speculation thread with the deadline of the run,
+        // the optimizer must be stopped once cancel is set (see MPC::SetCancel)
+        typedef function<MPCSolution(chrono::steady_clock::time_point deadline, const atomic<bool> &cancel)> Problem;
+
+        SpeculativeSolver();
+
+        ~SpeculativeSolver();
+
+        // Starts solving the problem predicted for the state with the config within its solve_deadline,
+        // replaces and cancels the previous speculation
+        void Start(const SpeculativeState &state, const Config &config, Problem problem);
+
+        // Takes the solution of the speculation if it was made for a state within the tolerances of the config
+        // and with the same config. Waits for it until the deadline if it is still being solved, then cancels it
+        // and takes the best feasible iterate the optimizer found so far.
+        // Returns false if there is no such speculation or its solution is not feasible.
+        // The speculation is used up either way and nothing is being solved when it returns.
+        bool Take(const SpeculativeState &state, const Config &config, chrono::steady_clock::time_point deadline,
+                  MPCSolution &solution);
+
+        // Drops the speculation when the cycle doesn't solve at all (the geometric controller or the policy answers),
+        // the running one is cancelled and waited for
+        void Cancel();
+
+    private:
+        CppADThread cppad_thread;
+        thread driver_thread;
+
+        mutex speculation_mutex;
+        condition_variable speculation_changed;
+
+        // the speculation: the state and the config key it was made for, the time to solve it, its problem and solution
+        SpeculativeState state;
+        double config_key[K_CONFIG_KEY_SIZE];
+        double solve_deadline = 0;
+        Problem problem;
+        MPCSolution solution;
+        bool has_problem = false;
+        bool solving = false;
+        bool has_solution = false;
+
+        // incremented by every speculation, a solution of an older one is dropped
+        uint64_t generation = 0;
+        uint64_t solving_generation = 0;
+
+        bool stop = false;
+
+        // stops the optimizer of the running speculation
+        atomic<bool> cancel{false};
+
+        // Drops the speculation, the running one is cancelled and waited for
+        void Drop(unique_lock<mutex> &lock);
+
+        void Run();
+};
+
+#endif //MPC_SPECULATIVE_SOLVER_H
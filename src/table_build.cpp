@@ -0,0 +1,201 @@
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "config.h"
+#include "explicit_table.h"
+#include "metrics.h"
+#include "offline_solve.h"
+
+// Builds the explicit MPC table for the Config70 preset (see explicit_table.h).
+// Every grid point is solved by MPC::Solve, then every cell is checked by solving the problem at its center
+// and comparing the result with the interpolation. Cells which don't match are excluded from the validated region.
+//
+// Usage: ./table_build output.mpct [workers number]
+
+Config Config::Instance = Config70();
+
+Metrics Metrics::Instance;
+
+// Number of grid values along every axis, the axes cover the region of the offline solutions
+const uint32_t K_AXES_SIZES[K_TABLE_AXES] = {9, 9, 9, 7, 5};
+
+// Maximum difference between the interpolation and the optimizer at the cell center
+const double K_DELTA_TOLERANCE = 0.01;
+const double K_A_TOLERANCE = 0.2;
+
+// Converts index of a grid point or a cell to the point of the table axes.
+// Cells have one step less along every axis and their point is the center.
+static void IndexToPoint(uint64_t index, bool cell, double point[K_TABLE_AXES])
+{
+    for(int axis = K_TABLE_AXES - 1; axis >= 0; axis--)
+    {
+        uint32_t size = K_AXES_SIZES[axis] - (cell ? 1 : 0);
+        double step = (K_FEATURES_MAX[axis] - K_FEATURES_MIN[axis]) / (K_AXES_SIZES[axis] - 1);
+        point[axis] = K_FEATURES_MIN[axis] + (index % size + (cell ? 0.5 : 0)) * step;
+        index /= size;
+    }
+}
+
+// Returns true if the optimizer converged at all the corners of the cell
+static bool CornersSolved(uint64_t cell, const vector<WorkerResult> &points)
+{
+    uint64_t indices[K_TABLE_AXES];
+    for(int axis = K_TABLE_AXES - 1; axis >= 0; axis--)
+    {
+        indices[axis] = cell % (K_AXES_SIZES[axis] - 1);
+        cell /= K_AXES_SIZES[axis] - 1;
+    }
+
+    for(int corner = 0; corner < (1 << K_TABLE_AXES); corner++)
+    {
+        uint64_t point = 0;
+        for(int axis = 0; axis < K_TABLE_AXES; axis++)
+        {
+            point = point * K_AXES_SIZES[axis] + indices[axis] + ((corner >> axis) & 1);
+        }
+        if(!points[point].ok)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2)
+    {
+        cerr << "Usage: " << argv[0] << " output.mpct [workers number]" << endl;
+        return -1;
+    }
+    string path = argv[1];
+    int workers = argc > 2 ? atoi(argv[2]) : (int)thread::hardware_concurrency();
+    workers = max(1, workers);
+
+    auto start = chrono::steady_clock::now();
+    Config config = Config::GetConfig();
+    int points_num = config.max_points_num;
+
+    ExplicitTableHeader header;
+    memset(&header, 0, sizeof(header));
+    header.horizon_points = (uint32_t)points_num;
+    header.points_num = 1;
+    header.cells_num = 1;
+    for(int axis = 0; axis < K_TABLE_AXES; axis++)
+    {
+        header.sizes[axis] = K_AXES_SIZES[axis];
+        header.min[axis] = K_FEATURES_MIN[axis];
+        header.max[axis] = K_FEATURES_MAX[axis];
+        header.points_num *= K_AXES_SIZES[axis];
+        header.cells_num *= K_AXES_SIZES[axis] - 1;
+    }
+    config.GetKey(header.config);
+
+    // 1. Solve the problem at every grid point
+    cout << "Solving " << header.points_num << " grid points with " << workers << " workers" << endl;
+    vector<WorkerResult> points = RunWorkers(header.points_num, workers, [points_num](size_t i, double &delta, double &a) {
+        double point[K_TABLE_AXES];
+        IndexToPoint(i, false, point);
+        return SolveFeatures(point, points_num, delta, a);
+    });
+
+    vector<float> values(header.points_num * 2);
+    uint64_t solved_num = 0;
+    for(uint64_t i = 0; i < header.points_num; i++)
+    {
+        values[2 * i] = points[i].delta;
+        values[2 * i + 1] = points[i].a;
+        solved_num += points[i].ok;
+    }
+
+    // 2. Write the table with every cell whose corners are solved, so the interpolation can be checked with it
+    vector<uint8_t> valid(header.cells_num);
+    for(uint64_t cell = 0; cell < header.cells_num; cell++)
+    {
+        valid[cell] = CornersSolved(cell, points) ? 1 : 0;
+    }
+    if(!WriteExplicitTable(path, header, values, valid))
+    {
+        cerr << "Failed to write " << path << endl;
+        return -1;
+    }
+
+    // 3. Solve the problem at every cell center and exclude the cells where the interpolation doesn't match
+    cout << "Checking " << header.cells_num << " cells" << endl;
+    vector<WorkerResult> centers = RunWorkers(header.cells_num, workers,
+                                              [points_num, &valid](size_t cell, double &delta, double &a) {
+        double point[K_TABLE_AXES];
+        IndexToPoint(cell, true, point);
+        return valid[cell] && SolveFeatures(point, points_num, delta, a);
+    });
+
+    ExplicitTable table;
+    if(!table.Open(path))
+    {
+        cerr << "Failed to open " << path << endl;
+        return -1;
+    }
+    uint64_t valid_num = 0;
+    for(uint64_t cell = 0; cell < header.cells_num; cell++)
+    {
+        double point[K_TABLE_AXES];
+        IndexToPoint(cell, true, point);
+        double delta, a;
+        valid[cell] = centers[cell].ok && table.Interpolate(point, delta, a)
+                      && fabs(delta - centers[cell].delta) <= K_DELTA_TOLERANCE
+                      && fabs(a - centers[cell].a) <= K_A_TOLERANCE;
+        valid_num += valid[cell];
+    }
+    table.Close();
+
+    if(!WriteExplicitTable(path, header, values, valid))
+    {
+        cerr << "Failed to write " << path << endl;
+        return -1;
+    }
+
+    // 4. Measure the lookup time at the cell centers
+    table.Open(path);
+    vector<double> queries_v;
+    vector<Eigen::VectorXd> queries_coeffs;
+    for(uint64_t cell = 0; cell < header.cells_num; cell++)
+    {
+        double point[K_TABLE_AXES];
+        IndexToPoint(cell, true, point);
+        Eigen::VectorXd coeffs(4);
+        coeffs << point[1], -tan(point[2]), point[3], point[4];
+        queries_v.push_back(point[0]);
+        queries_coeffs.push_back(coeffs);
+    }
+
+    double delta_sum = 0;
+    uint64_t lookups = 0;
+    auto lookup_start = chrono::steady_clock::now();
+    for(int repeat = 0; repeat < 10; repeat++)
+    {
+        for(size_t i = 0; i < queries_v.size(); i++)
+        {
+            double delta, a;
+            if(table.Lookup(queries_v[i], queries_coeffs[i], delta, a))
+            {
+                delta_sum += delta;
+            }
+            lookups++;
+        }
+    }
+    auto end = chrono::steady_clock::now();
+
+    cout << "Solved " << solved_num << "/" << header.points_num << " points, "
+         << "valid " << valid_num << "/" << header.cells_num << " cells" << endl;
+    if(lookups > 0)
+    {
+        cout << "Lookup " << chrono::duration<double, nano>(end - lookup_start).count() / lookups << " ns"
+             << " (mean delta " << delta_sum / lookups << ")" << endl;
+    }
+    cout << "Written " << path << " in " << chrono::duration<double>(end - start).count() << " s" << endl;
+    return 0;
+}
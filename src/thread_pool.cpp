@@ -0,0 +1,174 @@
+#include "thread_pool.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+
+#include <cppad/cppad.hpp>
+
+// CppAD thread number of the current thread, 0 if it has none
+static thread_local size_t cppad_thread_number = 0;
+
+// Numbers of the threads which are not reserved and the number of the reserved ones
+static mutex numbers_mutex;
+static vector<size_t> free_numbers;
+static atomic<size_t> reserved_numbers{0};
+
+// CppAD is in its parallel mode while any thread besides the main one may use it
+static bool InParallel()
+{
+    return reserved_numbers > 0;
+}
+
+static size_t ThreadNumber()
+{
+    return cppad_thread_number;
+}
+
+// Switches CppAD to the multithreading mode once, it must be done while no other thread uses CppAD
+static void SetupCppAD()
+{
+    static once_flag setup;
+    call_once(setup, []() {
+        CppAD::thread_alloc::parallel_setup(K_MAX_CPPAD_THREADS + 1, InParallel, ThreadNumber);
+        CppAD::parallel_ad<double>();
+        for(size_t number = K_MAX_CPPAD_THREADS; number >= 1; number--)
+        {
+            free_numbers.push_back(number);
+        }
+    });
+}
+
+CppADThread::CppADThread()
+{
+    lock_guard<mutex> lock(numbers_mutex);
+    SetupCppAD();
+    if(free_numbers.empty())
+    {
+        throw runtime_error("All " + to_string(K_MAX_CPPAD_THREADS) + " CppAD thread numbers are taken");
+    }
+    number = free_numbers.back();
+    free_numbers.pop_back();
+    reserved_numbers++;
+}
+
+CppADThread::~CppADThread()
+{
+    lock_guard<mutex> lock(numbers_mutex);
+    free_numbers.push_back(number);
+    reserved_numbers--;
+}
+
+void CppADThread::Enter() const
+{
+    cppad_thread_number = number;
+}
+
+void CppADThread::Leave() const
+{
+    CppAD::thread_alloc::free_available(number);
+    cppad_thread_number = 0;
+}
+
+ThreadPool::ThreadPool(size_t threads_num, bool cppad)
+{
+    // all the numbers are reserved before the workers start, so the pool which can't get them has no workers
+    for(size_t i = 0; i < threads_num && cppad; i++)
+    {
+        cppad_threads.emplace_back(new CppADThread());
+    }
+    for(size_t i = 0; i < threads_num; i++)
+    {
+        workers.emplace_back(&ThreadPool::Work, this, cppad ? cppad_threads[i].get() : nullptr);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> lock(pool_mutex);
+        stop = true;
+    }
+    tasks_added.notify_all();
+    for(thread &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::Run(const vector<function<void()>> &tasks)
+{
+    if(tasks.empty())
+    {
+        return;
+    }
+
+    if(workers.empty())
+    {
+        for(const function<void()> &task : tasks)
+        {
+            task();
+        }
+        return;
+    }
+
+    lock_guard<mutex> batch_lock(batch_mutex);
+    unique_lock<mutex> lock(pool_mutex);
+    this->tasks = &tasks;
+    next_task = 0;
+    unfinished = tasks.size();
+    tasks_added.notify_all();
+    tasks_done.wait(lock, [this]() { return unfinished == 0; });
+    this->tasks = nullptr;
+
+    if(task_error != nullptr)
+    {
+        exception_ptr error = task_error;
+        task_error = nullptr;
+        rethrow_exception(error);
+    }
+}
+
+void ThreadPool::Work(const CppADThread *cppad_thread)
+{
+    if(cppad_thread != nullptr)
+    {
+        cppad_thread->Enter();
+    }
+    unique_lock<mutex> lock(pool_mutex);
+    while(true)
+    {
+        tasks_added.wait(lock, [this]() { return stop || (tasks != nullptr && next_task < tasks->size()); });
+        if(stop)
+        {
+            if(cppad_thread != nullptr)
+            {
+                cppad_thread->Leave();
+            }
+            return;
+        }
+
+        const function<void()> &task = (*tasks)[next_task++];
+        lock.unlock();
+        exception_ptr error;
+        try
+        {
+            task();
+        }
+        catch(...)
+        {
+            error = current_exception();
+        }
+        lock.lock();
+
+        if(error != nullptr && task_error == nullptr)
+        {
+            task_error = error;
+        }
+
+        if(--unfinished == 0)
+        {
+            tasks_done.notify_all();
+        }
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef MPC_THREAD_POOL_H
+#define MPC_THREAD_POOL_H
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Maximum number of the threads using CppAD besides the main one, CppAD is set up for this number of threads
+const size_t K_MAX_CPPAD_THREADS = 16;
+
+// CppAD thread number reserved for a thread recording tapes besides the main one, which has number 0.
+// CppAD is switched to its multithreading mode when the first number is reserved. Every thread using CppAD
+// concurrently with the others must have its own number: pool workers, the background and speculative solvers.
+// The number is returned when it is destroyed, so its thread must have stopped using CppAD by then.
+class CppADThread
+{
+    public:
+        // Reserves a free number, throws runtime_error if all K_MAX_CPPAD_THREADS of them are taken
+        CppADThread();
+
+        ~CppADThread();
+
+        CppADThread(const CppADThread &) = delete;
+        CppADThread &operator=(const CppADThread &) = delete;
+
+        // Called by the thread before it uses CppAD, CppAD identifies it by this number from then on
+        void Enter() const;
+
+        // Called by the thread when it stops using CppAD, its free CppAD memory is returned to the system
+        void Leave() const;
+
+    private:
+        size_t number;
+};
+
+// Fixed set of worker threads running batches of tasks: Run returns when all the tasks of the batch are done.
+// Workers can record CppAD tapes concurrently, every worker has its own CppAD thread number.
+// The pool which can't reserve the numbers for all of its workers throws runtime_error.
+// A pool created without CppAD reserves no numbers, its tasks must not use CppAD.
+// IPOPT solves of the tasks run concurrently only if the linear solver allows it (see MPC::ConcurrentSolves).
+class ThreadPool
+{
+    public:
+        explicit ThreadPool(size_t threads_num, bool cppad = true);
+
+        ~ThreadPool();
+
+        size_t Size() const { return workers.size(); }
+
+        // Runs the tasks on the workers and waits until all of them are finished, a pool without workers
+        // runs them on the calling thread. The pool runs one batch at a time, concurrent calls wait for each other.
+        // An exception of a task doesn't stop the workers, the first one is rethrown here after the batch is done.
+        void Run(const vector<function<void()>> &tasks);
+
+    private:
+        vector<unique_ptr<CppADThread>> cppad_threads;
+        vector<thread> workers;
+
+        mutex batch_mutex;
+        mutex pool_mutex;
+        condition_variable tasks_added;
+        condition_variable tasks_done;
+
+        const vector<function<void()>> *tasks = nullptr;
+        size_t next_task = 0;
+        size_t unfinished = 0;
+        bool stop = false;
+        exception_ptr task_error;
+
+        void Work(const CppADThread *cppad_thread);
+};
+
+#endif //MPC_THREAD_POOL_H
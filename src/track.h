@@ -0,0 +1,81 @@
+#ifndef MPC_TRACK_H
+#define MPC_TRACK_H
+
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+// Point of the preprocessed track.
+// Track is resampled with a constant arc length step, so the point with arc length s
+// is located at index s / step.
+struct TrackPoint
+{
+    // arc length from the first waypoint
+    double s;
+
+    double x;
+    double y;
+
+    // direction of the track in radians
+    double heading;
+
+    // signed curvature, positive when the track turns left
+    double curvature;
+};
+
+// Linearly interpolates two sequential track points, ratio is in [0, 1]
+inline TrackPoint InterpolateTrackPoints(const TrackPoint &p0, const TrackPoint &p1, double ratio, double s)
+{
+    double heading_diff = p1.heading - p0.heading;
+    heading_diff = atan2(sin(heading_diff), cos(heading_diff));
+
+    TrackPoint point;
+    point.s = s;
+    point.x = p0.x + (p1.x - p0.x) * ratio;
+    point.y = p0.y + (p1.y - p0.y) * ratio;
+    point.heading = p0.heading + heading_diff * ratio;
+    point.curvature = p0.curvature + (p1.curvature - p0.curvature) * ratio;
+    return point;
+}
+
+// Track used by the controller as a reference.
+// Implemented by TrackMap (built in memory from csv) and TrackDatabase (memory mapped binary file).
+class Track
+{
+    public:
+        virtual ~Track() {}
+
+        virtual bool IsLoaded() const = 0;
+
+        // Full length of the loop in meters
+        virtual double Length() const = 0;
+
+        // Returns arc length of the track point closest to (x, y).
+        // It is not const because a track may load the data around the requested point.
+        virtual double FindNearest(double x, double y) = 0;
+
+        // Returns interpolated track point at arc length s, s is wrapped around the loop
+        virtual TrackPoint GetPoint(double s) const = 0;
+
+        // Returns curvature at arc length s, s is wrapped around the loop
+        double GetCurvature(double s) const
+        {
+            return GetPoint(s).curvature;
+        }
+
+        // Fills points_num points of the track starting from arc length s with the given distance between them
+        void GetHorizon(double s, double distance, int points_num, vector<double> &x, vector<double> &y) const
+        {
+            x.resize(points_num);
+            y.resize(points_num);
+            for(int k = 0; k < points_num; k++)
+            {
+                TrackPoint point = GetPoint(s + k * distance);
+                x[k] = point.x;
+                y[k] = point.y;
+            }
+        }
+};
+
+#endif //MPC_TRACK_H
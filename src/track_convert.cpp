@@ -0,0 +1,178 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "track_db.h"
+#include "track_map.h"
+
+// Converts csv waypoint files (e.g. lake_track_waypoints.csv) into the memory mapped track database.
+// Every csv file becomes a separate track of the database.
+//
+// Usage: ./track_convert output.trk input1.csv [input2.csv ...]
+//        ./track_convert output.trk --synthetic tracks_num track_length_km
+//        ./track_convert --open map.trk
+// --synthetic generates a large map of wavy loops on a grid instead of reading csv files.
+// --open measures the startup of the controller with the database: open time, resident memory and query time.
+
+// Distance between the points of the resampled tracks
+const double K_STEP = 0.5;
+
+// Distance between the waypoints of the synthetic tracks, m
+const double K_SYNTHETIC_WAYPOINTS_STEP = 20;
+
+// Number of the FindNearest queries of --open, they follow the first track like a car does
+const int K_OPEN_QUERIES = 10000;
+
+// Generates wavy loops of the given length placed on a square grid so they don't overlap
+static void GenerateTracks(int tracks_num, double length, vector<vector<double>> &xs, vector<vector<double>> &ys)
+{
+    double radius = length / (2 * M_PI);
+    double spacing = 3 * radius;
+    int grid_size = (int)ceil(sqrt((double)tracks_num));
+    int waypoints_num = max(16, (int)(length / K_SYNTHETIC_WAYPOINTS_STEP));
+    for(int t = 0; t < tracks_num; t++)
+    {
+        double center_x = (t % grid_size) * spacing;
+        double center_y = (t / grid_size) * spacing;
+        vector<double> x(waypoints_num);
+        vector<double> y(waypoints_num);
+        for(int i = 0; i < waypoints_num; i++)
+        {
+            double angle = 2 * M_PI * i / waypoints_num;
+            double r = radius * (1 + 0.15 * sin(5 * angle + t));
+            x[i] = center_x + r * cos(angle);
+            y[i] = center_y + r * sin(angle);
+        }
+        xs.push_back(x);
+        ys.push_back(y);
+    }
+}
+
+// Resident set size of the process, KB, 0 if it is unknown
+static long ReadRssKb()
+{
+    ifstream status("/proc/self/status");
+    string line;
+    while(getline(status, line))
+    {
+        if(line.compare(0, 6, "VmRSS:") == 0)
+        {
+            return atol(line.c_str() + 6);
+        }
+    }
+    return 0;
+}
+
+static int OpenDatabase(const string &path)
+{
+    long rss_before = ReadRssKb();
+    auto start = chrono::steady_clock::now();
+    TrackDatabase database;
+    if(!database.Open(path))
+    {
+        cerr << "Failed to open " << path << endl;
+        return -1;
+    }
+    double open_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    long rss_open = ReadRssKb();
+
+    // drive along the first track with the car 1 m off it
+    database.FindNearest(database.GetPoint(0).x, database.GetPoint(0).y);
+    double length = database.Length();
+    start = chrono::steady_clock::now();
+    for(int i = 0; i < K_OPEN_QUERIES; i++)
+    {
+        TrackPoint p = database.GetPoint(length * i / K_OPEN_QUERIES);
+        database.FindNearest(p.x - sin(p.heading), p.y + cos(p.heading));
+    }
+    double query_us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / K_OPEN_QUERIES;
+
+    cout << path << ": " << database.TracksNum() << " tracks, open " << open_ms << " ms, RSS " << rss_before
+         << " KB before, " << rss_open << " KB after open, " << ReadRssKb() << " KB after driving one track, "
+         << "FindNearest " << query_us << " us" << endl;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc == 3 && string(argv[1]) == "--open")
+    {
+        return OpenDatabase(argv[2]);
+    }
+
+    bool synthetic = argc == 5 && string(argv[2]) == "--synthetic";
+    if(argc < 3 || (!synthetic && string(argv[2]).compare(0, 2, "--") == 0))
+    {
+        cerr << "Usage: " << argv[0] << " output.trk input1.csv [input2.csv ...]" << endl
+             << "       " << argv[0] << " output.trk --synthetic tracks_num track_length_km" << endl
+             << "       " << argv[0] << " --open map.trk" << endl;
+        return -1;
+    }
+
+    auto start = chrono::steady_clock::now();
+
+    vector<vector<double>> xs;
+    vector<vector<double>> ys;
+    vector<string> names;
+    if(synthetic)
+    {
+        GenerateTracks(atoi(argv[3]), atof(argv[4]) * 1000, xs, ys);
+        names.assign(xs.size(), "synthetic");
+    }
+    else
+    {
+        for(int i = 2; i < argc; i++)
+        {
+            vector<double> x;
+            vector<double> y;
+            if(!ReadWaypointsCsv(argv[i], x, y))
+            {
+                cerr << "Failed to read track " << argv[i] << endl;
+                return -1;
+            }
+            xs.push_back(x);
+            ys.push_back(y);
+            names.push_back(argv[i]);
+        }
+    }
+
+    vector<vector<TrackPoint>> tracks;
+    vector<double> lengths;
+    for(size_t i = 0; i < xs.size(); i++)
+    {
+        vector<TrackPoint> points;
+        double length;
+        if(!ResampleLoop(xs[i], ys[i], K_STEP, points, length))
+        {
+            cerr << "Failed to resample track " << names[i] << endl;
+            return -1;
+        }
+
+        if(!synthetic)
+        {
+            cout << names[i] << ": " << xs[i].size() << " waypoints, length " << length << " m, "
+                 << points.size() << " points" << endl;
+        }
+        tracks.push_back(points);
+        lengths.push_back(length);
+    }
+    if(tracks.empty())
+    {
+        cerr << "No tracks" << endl;
+        return -1;
+    }
+
+    if(!WriteTrackDatabase(argv[1], tracks, lengths))
+    {
+        cerr << "Failed to write " << argv[1] << endl;
+        return -1;
+    }
+
+    auto end = chrono::steady_clock::now();
+    cout << "Written " << tracks.size() << " tracks to " << argv[1] << " in "
+         << chrono::duration<double>(end - start).count() << " s" << endl;
+    return 0;
+}
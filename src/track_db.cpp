@@ -0,0 +1,528 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "track_db.h"
+
+// Tile points are aligned to this size in the file, so tiles can be paged in and out separately
+const uint64_t K_TILE_ALIGNMENT = 4096;
+
+static uint64_t Align(uint64_t offset, uint64_t alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+// Returns true if num items starting at offset are aligned and inside of the file, without overflows
+template <class T>
+static bool SectionFits(uint64_t offset, uint64_t num, uint64_t size)
+{
+    return offset % alignof(T) == 0 && offset <= size && num <= (size - offset) / sizeof(T);
+}
+
+bool WriteTrackDatabase(const string &path, const vector<vector<TrackPoint>> &tracks, const vector<double> &lengths,
+                        uint32_t tile_points, double cell_size)
+{
+    TrackDbHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, K_TRACK_DB_MAGIC, sizeof(header.magic));
+    header.version = K_TRACK_DB_VERSION;
+    header.tracks_num = (uint32_t)tracks.size();
+    header.tile_points = tile_points;
+    header.cell_size = cell_size;
+
+    // 1. Split tracks into tiles
+    vector<TrackDbTrack> db_tracks;
+    vector<TrackDbTile> db_tiles;
+    for(size_t track = 0; track < tracks.size(); track++)
+    {
+        const vector<TrackPoint> &points = tracks[track];
+
+        TrackDbTrack db_track;
+        db_track.first_tile = (uint32_t)db_tiles.size();
+        db_track.points_num = points.size();
+        db_track.length = lengths[track];
+        db_track.step = lengths[track] / points.size();
+
+        for(size_t first = 0; first < points.size(); first += tile_points)
+        {
+            TrackDbTile tile;
+            tile.track = (uint32_t)track;
+            tile.first_point = first;
+            tile.points_num = (uint32_t)min((size_t)tile_points, points.size() - first);
+            tile.points_offset = 0;
+            tile.min_x = tile.min_y = numeric_limits<double>::max();
+            tile.max_x = tile.max_y = -numeric_limits<double>::max();
+
+            // the last segment of the tile ends at the first point of the next tile
+            for(size_t i = first; i <= first + tile.points_num; i++)
+            {
+                const TrackPoint &p = points[i % points.size()];
+                tile.min_x = min(tile.min_x, p.x);
+                tile.min_y = min(tile.min_y, p.y);
+                tile.max_x = max(tile.max_x, p.x);
+                tile.max_y = max(tile.max_y, p.y);
+            }
+            db_tiles.push_back(tile);
+            header.points_num += tile.points_num;
+        }
+
+        db_track.tiles_num = (uint32_t)db_tiles.size() - db_track.first_tile;
+        db_tracks.push_back(db_track);
+    }
+    header.tiles_num = (uint32_t)db_tiles.size();
+
+    // 2. Build the sparse grid. A segment is added to every cell that is closer than cell_size to its bounding box,
+    // so if the closest point to the car is not further than cell_size, it is found among the segments of the car's cell.
+    double max_x = -numeric_limits<double>::max();
+    double max_y = -numeric_limits<double>::max();
+    header.min_x = numeric_limits<double>::max();
+    header.min_y = numeric_limits<double>::max();
+    for(const TrackDbTile &tile : db_tiles)
+    {
+        header.min_x = min(header.min_x, tile.min_x - cell_size);
+        header.min_y = min(header.min_y, tile.min_y - cell_size);
+        max_x = max(max_x, tile.max_x + cell_size);
+        max_y = max(max_y, tile.max_y + cell_size);
+    }
+    header.cols = db_tiles.empty() ? 0 : (uint64_t)ceil((max_x - header.min_x) / cell_size);
+    header.rows = db_tiles.empty() ? 0 : (uint64_t)ceil((max_y - header.min_y) / cell_size);
+
+    // segments are added in the track order, so sequential segments of a cell are merged into runs
+    unordered_map<uint64_t, vector<TrackDbRun>> cell_runs;
+    for(size_t track = 0; track < tracks.size(); track++)
+    {
+        const vector<TrackPoint> &points = tracks[track];
+        for(size_t i = 0; i < points.size(); i++)
+        {
+            const TrackPoint &p0 = points[i];
+            const TrackPoint &p1 = points[(i + 1) % points.size()];
+            uint64_t col0 = (uint64_t)floor((min(p0.x, p1.x) - cell_size - header.min_x) / cell_size);
+            uint64_t row0 = (uint64_t)floor((min(p0.y, p1.y) - cell_size - header.min_y) / cell_size);
+            uint64_t col1 = min(header.cols - 1, (uint64_t)floor((max(p0.x, p1.x) + cell_size - header.min_x) / cell_size));
+            uint64_t row1 = min(header.rows - 1, (uint64_t)floor((max(p0.y, p1.y) + cell_size - header.min_y) / cell_size));
+            for(uint64_t row = row0; row <= row1; row++)
+            {
+                for(uint64_t col = col0; col <= col1; col++)
+                {
+                    vector<TrackDbRun> &runs = cell_runs[row * header.cols + col];
+                    if(!runs.empty() && runs.back().track == track
+                       && runs.back().first_point + runs.back().segments_num == i)
+                    {
+                        runs.back().segments_num++;
+                    }
+                    else
+                    {
+                        runs.push_back({(uint32_t)track, 1, i});
+                    }
+                }
+            }
+        }
+    }
+
+    vector<uint64_t> keys;
+    for(const auto &cell : cell_runs)
+    {
+        keys.push_back(cell.first);
+    }
+    sort(keys.begin(), keys.end());
+
+    vector<TrackDbCell> db_cells;
+    vector<TrackDbRun> db_runs;
+    for(uint64_t key : keys)
+    {
+        const vector<TrackDbRun> &runs = cell_runs[key];
+        db_cells.push_back({key, db_runs.size(), runs.size()});
+        db_runs.insert(db_runs.end(), runs.begin(), runs.end());
+    }
+    header.cells_num = db_cells.size();
+    header.runs_num = db_runs.size();
+
+    // 3. Calculate offsets of the sections
+    header.tracks_offset = sizeof(TrackDbHeader);
+    header.tiles_offset = header.tracks_offset + db_tracks.size() * sizeof(TrackDbTrack);
+    header.cells_offset = header.tiles_offset + db_tiles.size() * sizeof(TrackDbTile);
+    header.runs_offset = header.cells_offset + db_cells.size() * sizeof(TrackDbCell);
+
+    uint64_t offset = header.runs_offset + db_runs.size() * sizeof(TrackDbRun);
+    for(TrackDbTile &tile : db_tiles)
+    {
+        tile.points_offset = Align(offset, K_TILE_ALIGNMENT);
+        offset = tile.points_offset + tile.points_num * sizeof(TrackPoint);
+    }
+    header.file_size = offset;
+
+    // 4. Write everything
+    ofstream file(path, ios::binary | ios::trunc);
+    if(!file.is_open())
+    {
+        return false;
+    }
+
+    file.write((const char *)&header, sizeof(header));
+    file.write((const char *)db_tracks.data(), db_tracks.size() * sizeof(TrackDbTrack));
+    file.write((const char *)db_tiles.data(), db_tiles.size() * sizeof(TrackDbTile));
+    file.write((const char *)db_cells.data(), db_cells.size() * sizeof(TrackDbCell));
+    file.write((const char *)db_runs.data(), db_runs.size() * sizeof(TrackDbRun));
+
+    vector<char> padding(K_TILE_ALIGNMENT, 0);
+    for(const TrackDbTile &tile : db_tiles)
+    {
+        uint64_t position = (uint64_t)file.tellp();
+        file.write(padding.data(), tile.points_offset - position);
+        file.write((const char *)&tracks[tile.track][tile.first_point], tile.points_num * sizeof(TrackPoint));
+    }
+
+    return file.good();
+}
+
+TrackDatabase::~TrackDatabase()
+{
+    Close();
+}
+
+bool TrackDatabase::Open(const string &path)
+{
+    Close();
+
+    fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TrackDbHeader))
+    {
+        Close();
+        return false;
+    }
+
+    size = (size_t)st.st_size;
+    void *mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if(mapped == MAP_FAILED)
+    {
+        Close();
+        return false;
+    }
+    data = (uint8_t *)mapped;
+
+    // points are accessed only around the car, read ahead would just load unneeded tiles
+    madvise(data, size, MADV_RANDOM);
+    page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+    header = (const TrackDbHeader *)data;
+    bool valid = memcmp(header->magic, K_TRACK_DB_MAGIC, sizeof(header->magic)) == 0
+                 && header->version == K_TRACK_DB_VERSION
+                 && header->file_size == size
+                 && header->tracks_num > 0
+                 && header->tile_points > 0
+                 && header->cell_size > 0
+                 && (header->rows == 0 || header->cols <= numeric_limits<uint64_t>::max() / header->rows)
+                 && SectionFits<TrackDbTrack>(header->tracks_offset, header->tracks_num, size)
+                 && SectionFits<TrackDbTile>(header->tiles_offset, header->tiles_num, size)
+                 && SectionFits<TrackDbCell>(header->cells_offset, header->cells_num, size)
+                 && SectionFits<TrackDbRun>(header->runs_offset, header->runs_num, size);
+    if(!valid)
+    {
+        Close();
+        return false;
+    }
+
+    tracks = (const TrackDbTrack *)(data + header->tracks_offset);
+    tiles = (const TrackDbTile *)(data + header->tiles_offset);
+    cells = (const TrackDbCell *)(data + header->cells_offset);
+    runs = (const TrackDbRun *)(data + header->runs_offset);
+    if(!ValidateTables())
+    {
+        Close();
+        return false;
+    }
+    active_track = 0;
+
+    return true;
+}
+
+bool TrackDatabase::ValidateTables() const
+{
+    // tracks own consecutive ranges of the tiles, every tile holds tile_points points except the last one of a track
+    uint64_t tile_points = header->tile_points;
+    uint64_t points_num = 0;
+    uint32_t next_tile = 0;
+    for(uint32_t t = 0; t < header->tracks_num; t++)
+    {
+        const TrackDbTrack &track = tracks[t];
+        bool valid_track = track.points_num >= 2
+                           && track.first_tile == next_tile
+                           && track.tiles_num == (track.points_num + tile_points - 1) / tile_points
+                           && track.tiles_num <= header->tiles_num - track.first_tile
+                           && track.length > 0 && track.step > 0;
+        if(!valid_track)
+        {
+            return false;
+        }
+        next_tile = track.first_tile + track.tiles_num;
+
+        for(uint32_t k = 0; k < track.tiles_num; k++)
+        {
+            const TrackDbTile &tile = tiles[track.first_tile + k];
+            uint64_t first_point = k * tile_points;
+            bool valid_tile = tile.track == t
+                              && tile.first_point == first_point
+                              && tile.points_num == min(tile_points, track.points_num - first_point)
+                              && SectionFits<TrackPoint>(tile.points_offset, tile.points_num, size);
+            if(!valid_tile)
+            {
+                return false;
+            }
+            points_num += tile.points_num;
+        }
+    }
+    if(next_tile != header->tiles_num || points_num != header->points_num)
+    {
+        return false;
+    }
+
+    // cells are searched by their key, so the keys must be sorted and inside of the grid
+    uint64_t cells_area = header->cols * header->rows;
+    for(uint64_t i = 0; i < header->cells_num; i++)
+    {
+        const TrackDbCell &cell = cells[i];
+        bool valid_cell = cell.key < cells_area
+                          && (i == 0 || cells[i - 1].key < cell.key)
+                          && cell.first_run <= header->runs_num
+                          && cell.runs_num <= header->runs_num - cell.first_run;
+        if(!valid_cell)
+        {
+            return false;
+        }
+    }
+
+    for(uint64_t i = 0; i < header->runs_num; i++)
+    {
+        const TrackDbRun &run = runs[i];
+        if(run.track >= header->tracks_num || run.first_point >= tracks[run.track].points_num
+           || run.segments_num > tracks[run.track].points_num)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+void TrackDatabase::Close()
+{
+    if(data != nullptr)
+    {
+        munmap(data, size);
+        data = nullptr;
+    }
+    if(fd >= 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    header = nullptr;
+    tracks = nullptr;
+    tiles = nullptr;
+    cells = nullptr;
+    runs = nullptr;
+    resident_tiles.clear();
+    resident_cell = -1;
+}
+
+double TrackDatabase::Length() const
+{
+    return tracks[active_track].length;
+}
+
+const TrackPoint &TrackDatabase::Point(uint32_t track, uint64_t index) const
+{
+    const TrackDbTrack &db_track = tracks[track];
+    index %= db_track.points_num;
+    const TrackDbTile &tile = tiles[db_track.first_tile + index / header->tile_points];
+    return ((const TrackPoint *)(data + tile.points_offset))[index % header->tile_points];
+}
+
+double TrackDatabase::SegmentDistance2(uint32_t track, uint64_t index, double x, double y, double &t) const
+{
+    const TrackPoint &p0 = Point(track, index);
+    const TrackPoint &p1 = Point(track, index + 1);
+    double sx = p1.x - p0.x;
+    double sy = p1.y - p0.y;
+    double len2 = sx * sx + sy * sy;
+    t = len2 > 0 ? ((x - p0.x) * sx + (y - p0.y) * sy) / len2 : 0;
+    t = max(0., min(1., t));
+    double dx = p0.x + sx * t - x;
+    double dy = p0.y + sy * t - y;
+    return dx * dx + dy * dy;
+}
+
+const TrackDbCell *TrackDatabase::FindCell(int64_t col, int64_t row) const
+{
+    if(col < 0 || row < 0 || col >= (int64_t)header->cols || row >= (int64_t)header->rows)
+    {
+        return nullptr;
+    }
+
+    uint64_t key = (uint64_t)row * header->cols + (uint64_t)col;
+    const TrackDbCell *end = cells + header->cells_num;
+    const TrackDbCell *cell = lower_bound(cells, end, key, [](const TrackDbCell &c, uint64_t k) { return c.key < k; });
+    return cell != end && cell->key == key ? cell : nullptr;
+}
+
+double TrackDatabase::FindNearest(double x, double y)
+{
+    uint32_t best_track = active_track;
+    uint64_t best_index = 0;
+    double best_t = 0;
+    double best_d = numeric_limits<double>::max();
+
+    auto check_segments = [&](uint32_t track, uint64_t first, uint64_t num)
+    {
+        for(uint64_t index = first; index < first + num; index++)
+        {
+            double t;
+            double d = SegmentDistance2(track, index, x, y, t);
+            if(d < best_d)
+            {
+                best_d = d;
+                best_track = track;
+                best_index = index;
+                best_t = t;
+            }
+        }
+    };
+
+    double cell_size = header->cell_size;
+    const TrackDbCell *cell = FindCell((int64_t)floor((x - header->min_x) / cell_size),
+                                       (int64_t)floor((y - header->min_y) / cell_size));
+    if(cell != nullptr)
+    {
+        for(uint64_t k = cell->first_run; k < cell->first_run + cell->runs_num; k++)
+        {
+            check_segments(runs[k].track, runs[k].first_point, runs[k].segments_num);
+        }
+    }
+
+    // the car is far away from any track, check tiles in the order of distance to their bounding boxes
+    if(best_d > cell_size * cell_size)
+    {
+        vector<pair<double, uint32_t>> tile_distances(header->tiles_num);
+        for(uint32_t i = 0; i < header->tiles_num; i++)
+        {
+            const TrackDbTile &tile = tiles[i];
+            double dx = max(0., max(tile.min_x - x, x - tile.max_x));
+            double dy = max(0., max(tile.min_y - y, y - tile.max_y));
+            tile_distances[i] = make_pair(dx * dx + dy * dy, i);
+        }
+        sort(tile_distances.begin(), tile_distances.end());
+
+        for(size_t k = 0; k < tile_distances.size() && tile_distances[k].first < best_d; k++)
+        {
+            const TrackDbTile &tile = tiles[tile_distances[k].second];
+            check_segments(tile.track, tile.first_point, tile.points_num);
+        }
+    }
+
+    active_track = best_track;
+    UpdateResidentTiles(x, y);
+
+    const TrackDbTrack &track = tracks[active_track];
+    return fmod((best_index + best_t) * track.step, track.length);
+}
+
+TrackPoint TrackDatabase::GetPoint(double s) const
+{
+    uint32_t track_index = active_track;
+    const TrackDbTrack &track = tracks[track_index];
+    s = fmod(s, track.length);
+    s = s < 0 ? s + track.length : s;
+
+    uint64_t i = min((uint64_t)(s / track.step), track.points_num - 1);
+    const TrackPoint &p0 = Point(track_index, i);
+    const TrackPoint &p1 = Point(track_index, i + 1);
+    double ratio = (s - p0.s) / track.step;
+    return InterpolateTrackPoints(p0, p1, ratio, s);
+}
+
+void TrackDatabase::TileRange(uint32_t tile, uint8_t *&start, size_t &length) const
+{
+    uint64_t begin = tiles[tile].points_offset / page_size * page_size;
+    uint64_t end = Align(tiles[tile].points_offset + tiles[tile].points_num * sizeof(TrackPoint), page_size);
+    start = data + begin;
+    length = (size_t)(min((uint64_t)size, end) - begin);
+}
+
+void TrackDatabase::UpdateResidentTiles(double x, double y)
+{
+    double cell_size = header->cell_size;
+    int64_t col = (int64_t)floor((x - header->min_x) / cell_size);
+    int64_t row = (int64_t)floor((y - header->min_y) / cell_size);
+
+    // the set of tiles changes only when the car moves to another cell
+    int64_t cell_id = row * (int64_t)header->cols + col;
+    if(cell_id == resident_cell)
+    {
+        return;
+    }
+    resident_cell = cell_id;
+
+    // collect tiles of all the runs in the cells around the car
+    int64_t radius = (int64_t)ceil(resident_radius / cell_size);
+    vector<uint32_t> near_tiles;
+    for(int64_t r = row - radius; r <= row + radius; r++)
+    {
+        for(int64_t c = col - radius; c <= col + radius; c++)
+        {
+            const TrackDbCell *cell = FindCell(c, r);
+            if(cell == nullptr)
+            {
+                continue;
+            }
+
+            for(uint64_t k = cell->first_run; k < cell->first_run + cell->runs_num; k++)
+            {
+                const TrackDbRun &run = runs[k];
+                const TrackDbTrack &track = tracks[run.track];
+                uint64_t first_tile = run.first_point / header->tile_points;
+                uint64_t last_tile = min((run.first_point + run.segments_num) / header->tile_points,
+                                         (uint64_t)track.tiles_num - 1);
+                for(uint64_t tile = first_tile; tile <= last_tile; tile++)
+                {
+                    near_tiles.push_back(track.first_tile + (uint32_t)tile);
+                }
+            }
+        }
+    }
+    sort(near_tiles.begin(), near_tiles.end());
+    near_tiles.erase(unique(near_tiles.begin(), near_tiles.end()), near_tiles.end());
+
+    uint8_t *start;
+    size_t length;
+    for(uint32_t tile : resident_tiles)
+    {
+        if(!binary_search(near_tiles.begin(), near_tiles.end(), tile))
+        {
+            TileRange(tile, start, length);
+            madvise(start, length, MADV_DONTNEED);
+        }
+    }
+    for(uint32_t tile : near_tiles)
+    {
+        if(!binary_search(resident_tiles.begin(), resident_tiles.end(), tile))
+        {
+            TileRange(tile, start, length);
+            madvise(start, length, MADV_WILLNEED);
+        }
+    }
+
+    resident_tiles.swap(near_tiles);
+}
@@ -0,0 +1,178 @@
+#ifndef MPC_TRACK_DB_H
+#define MPC_TRACK_DB_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "track.h"
+
+using namespace std;
+
+// Binary track database format.
+// The file is memory mapped and used as is, so all the structures have fixed size and layout.
+//
+// [TrackDbHeader][TrackDbTrack x tracks_num][TrackDbTile x tiles_num]
+// [TrackDbCell x cells_num][TrackDbRun x runs_num]
+// [tile points, every tile starts at a page boundary]
+//
+// Every track is split into tiles of tile_points sequential points (the last tile of a track may be shorter).
+// Spatial index is a sparse grid: only non-empty cells are stored, sorted by their key, so the index
+// size depends on the length of the tracks and not on the area they cover. Every cell refers to runs
+// of sequential track segments which are close enough to the cell to contain the closest point for a car in the cell.
+// Points of the tiles are page aligned, so the loader can page in only the tiles around the car.
+const char K_TRACK_DB_MAGIC[8] = {'M', 'P', 'C', 'T', 'R', 'A', 'C', 'K'};
+const uint32_t K_TRACK_DB_VERSION = 1;
+
+struct TrackDbHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t tracks_num;
+    uint32_t tiles_num;
+    uint32_t tile_points;
+    uint64_t points_num;
+    uint64_t cells_num;
+    uint64_t runs_num;
+
+    // cell key is row * cols + col, where col = floor((x - min_x) / cell_size), row = floor((y - min_y) / cell_size)
+    double cell_size;
+    double min_x;
+    double min_y;
+    uint64_t cols;
+    uint64_t rows;
+
+    // offsets of the sections from the beginning of the file
+    uint64_t tracks_offset;
+    uint64_t tiles_offset;
+    uint64_t cells_offset;
+    uint64_t runs_offset;
+
+    // full size of the file
+    uint64_t file_size;
+};
+
+struct TrackDbTrack
+{
+    uint32_t first_tile;
+    uint32_t tiles_num;
+    uint64_t points_num;
+    double length;
+    double step;
+};
+
+struct TrackDbTile
+{
+    uint32_t track;
+    uint32_t points_num;
+
+    // index of the first point in the track
+    uint64_t first_point;
+
+    // offset of the points from the beginning of the file
+    uint64_t points_offset;
+
+    // bounding box of the tile points
+    double min_x;
+    double min_y;
+    double max_x;
+    double max_y;
+};
+
+struct TrackDbCell
+{
+    uint64_t key;
+    uint64_t first_run;
+    uint64_t runs_num;
+};
+
+// Sequential segments of a track, segment i connects points i and i + 1
+struct TrackDbRun
+{
+    uint32_t track;
+    uint32_t segments_num;
+    uint64_t first_point;
+};
+
+// Writes tracks to the binary database. Every track is a loop resampled with a constant step (see ResampleLoop).
+// Returns false if the file can't be written.
+bool WriteTrackDatabase(const string &path, const vector<vector<TrackPoint>> &tracks, const vector<double> &lengths,
+                        uint32_t tile_points = 1024, double cell_size = 20);
+
+// Read-only memory mapped track database.
+// Opening it doesn't parse or read the points, the pages are loaded by the OS when they are accessed.
+// Only the tiles around the last requested position are kept resident.
+//
+// Queries by arc length refer to the active track, which is the track found by the last FindNearest call.
+class TrackDatabase : public Track
+{
+    public:
+        virtual ~TrackDatabase();
+
+        // Maps the file and validates its header and index tables, the points are not read.
+        // Returns false if the file can't be mapped or has a wrong format.
+        bool Open(const string &path);
+
+        void Close();
+
+        bool IsLoaded() const override { return data != nullptr; }
+
+        // Length of the active track
+        double Length() const override;
+
+        // Finds the closest point among all the tracks, makes its track active
+        // and pages in the tiles around (x, y).
+        double FindNearest(double x, double y) override;
+
+        // Returns track point of the active track at arc length s, s is wrapped around the loop
+        TrackPoint GetPoint(double s) const override;
+
+        uint32_t TracksNum() const { return header->tracks_num; }
+
+        uint32_t ActiveTrack() const { return active_track; }
+
+        // Distance around the car within which the tiles are kept resident
+        double resident_radius = 200;
+
+    private:
+        int fd = -1;
+        uint8_t *data = nullptr;
+        size_t size = 0;
+        size_t page_size = 4096;
+
+        const TrackDbHeader *header = nullptr;
+        const TrackDbTrack *tracks = nullptr;
+        const TrackDbTile *tiles = nullptr;
+        const TrackDbCell *cells = nullptr;
+        const TrackDbRun *runs = nullptr;
+
+        // it is switched by FindNearest and read by GetPoint, which can be called from the solver thread
+        atomic<uint32_t> active_track{0};
+
+        // Tiles that were advised to be loaded
+        vector<uint32_t> resident_tiles;
+
+        // Grid cell of the last position the resident tiles were updated for
+        int64_t resident_cell = -1;
+
+        // Checks that the tracks, tiles, cells and runs refer only to each other and to the points inside of the file
+        bool ValidateTables() const;
+
+        // Returns point with the given index in the track, index is wrapped around the loop
+        const TrackPoint &Point(uint32_t track, uint64_t index) const;
+
+        // Returns the cell containing (x, y) or nullptr if the cell is empty
+        const TrackDbCell *FindCell(int64_t col, int64_t row) const;
+
+        // Squared distance from (x, y) to the segment starting at the point of the track with the given index
+        double SegmentDistance2(uint32_t track, uint64_t index, double x, double y, double &t) const;
+
+        // Advises OS to load the tiles around (x, y) and to drop the tiles that are not needed anymore
+        void UpdateResidentTiles(double x, double y);
+
+        // Page aligned range of the tile points
+        void TileRange(uint32_t tile, uint8_t *&start, size_t &length) const;
+};
+
+#endif //MPC_TRACK_DB_H
@@ -0,0 +1,371 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#include "track_map.h"
+
+// Solves cyclic tridiagonal system
+// b[0]*x[0] + c[0]*x[1] + a[0]*x[n-1] = r[0]
+// a[i]*x[i-1] + b[i]*x[i] + c[i]*x[i+1] = r[i]
+// c[n-1]*x[0] + a[n-1]*x[n-2] + b[n-1]*x[n-1] = r[n-1]
+// using Sherman-Morrison formula, so it takes O(n) even for very long tracks.
+static vector<double> SolveCyclic(const vector<double> &a, const vector<double> &b,
+                                  const vector<double> &c, const vector<double> &r)
+{
+    size_t n = b.size();
+    double alpha = c[n - 1];
+    double beta = a[0];
+    double gamma = -b[0];
+
+    vector<double> bb(b);
+    bb[0] = b[0] - gamma;
+    bb[n - 1] = b[n - 1] - alpha * beta / gamma;
+
+    // solves tridiagonal system with the modified diagonal
+    auto thomas = [&](const vector<double> &rhs)
+    {
+        vector<double> cp(n), dp(n), x(n);
+        cp[0] = c[0] / bb[0];
+        dp[0] = rhs[0] / bb[0];
+        for(size_t i = 1; i < n; i++)
+        {
+            double m = bb[i] - a[i] * cp[i - 1];
+            cp[i] = c[i] / m;
+            dp[i] = (rhs[i] - a[i] * dp[i - 1]) / m;
+        }
+        x[n - 1] = dp[n - 1];
+        for(size_t i = n - 1; i-- > 0;)
+        {
+            x[i] = dp[i] - cp[i] * x[i + 1];
+        }
+        return x;
+    };
+
+    vector<double> u(n, 0);
+    u[0] = gamma;
+    u[n - 1] = alpha;
+
+    vector<double> x = thomas(r);
+    vector<double> z = thomas(u);
+
+    double fact = (x[0] + beta * x[n - 1] / gamma) / (1 + z[0] + beta * z[n - 1] / gamma);
+    for(size_t i = 0; i < n; i++)
+    {
+        x[i] -= fact * z[i];
+    }
+    return x;
+}
+
+// Calculates second derivatives of the closed cubic spline going through values with knot spans h
+static vector<double> SplineMoments(const vector<double> &values, const vector<double> &h)
+{
+    size_t n = values.size();
+    vector<double> a(n), b(n), c(n), r(n);
+    for(size_t i = 0; i < n; i++)
+    {
+        size_t prev = (i + n - 1) % n;
+        size_t next = (i + 1) % n;
+        a[i] = h[prev];
+        b[i] = 2 * (h[prev] + h[i]);
+        c[i] = h[i];
+        r[i] = 6 * ((values[next] - values[i]) / h[i] - (values[i] - values[prev]) / h[prev]);
+    }
+    return SolveCyclic(a, b, c, r);
+}
+
+// Evaluates value, first and second derivative of the spline segment at position t in [0, h]
+static void SplineEval(double y0, double y1, double m0, double m1, double h, double t,
+                       double &value, double &d1, double &d2)
+{
+    double ht = h - t;
+    double c0 = y0 / h - m0 * h / 6;
+    double c1 = y1 / h - m1 * h / 6;
+    value = m0 * ht * ht * ht / (6 * h) + m1 * t * t * t / (6 * h) + c0 * ht + c1 * t;
+    d1 = -m0 * ht * ht / (2 * h) + m1 * t * t / (2 * h) - c0 + c1;
+    d2 = m0 * ht / h + m1 * t / h;
+}
+
+bool ReadWaypointsCsv(const string &path, vector<double> &x, vector<double> &y)
+{
+    ifstream file(path);
+    if(!file.is_open())
+    {
+        return false;
+    }
+
+    x.clear();
+    y.clear();
+    string line;
+
+    // skip header
+    getline(file, line);
+    while(getline(file, line))
+    {
+        stringstream ss(line);
+        string x_str, y_str;
+        if(getline(ss, x_str, ',') && getline(ss, y_str, ','))
+        {
+            x.push_back(atof(x_str.c_str()));
+            y.push_back(atof(y_str.c_str()));
+        }
+    }
+
+    return true;
+}
+
+bool TrackMap::LoadCsv(const string &path, double step, double cell_size)
+{
+    vector<double> x;
+    vector<double> y;
+    return ReadWaypointsCsv(path, x, y) && Build(x, y, step, cell_size);
+}
+
+bool ResampleLoop(const vector<double> &x_in, const vector<double> &y_in, double step,
+                  vector<TrackPoint> &points, double &length)
+{
+    points.clear();
+
+    // drop duplicated points, including the last one if the loop is explicitly closed
+    vector<double> x;
+    vector<double> y;
+    for(size_t i = 0; i < x_in.size(); i++)
+    {
+        if(x.empty() || fabs(x_in[i] - x.back()) + fabs(y_in[i] - y.back()) > 1e-6)
+        {
+            x.push_back(x_in[i]);
+            y.push_back(y_in[i]);
+        }
+    }
+    while(x.size() > 1 && fabs(x.front() - x.back()) + fabs(y.front() - y.back()) < 1e-6)
+    {
+        x.pop_back();
+        y.pop_back();
+    }
+
+    size_t n = x.size();
+    if(n < 3 || step <= 0)
+    {
+        return false;
+    }
+
+    // 1. Chord length parameterization of the closed spline
+    vector<double> h(n);
+    for(size_t i = 0; i < n; i++)
+    {
+        size_t next = (i + 1) % n;
+        h[i] = sqrt(pow(x[next] - x[i], 2) + pow(y[next] - y[i], 2));
+    }
+
+    vector<double> mx = SplineMoments(x, h);
+    vector<double> my = SplineMoments(y, h);
+
+    // 2. Integrate arc length on a dense grid of spline parameter values.
+    // Every knot span is split so the sub-steps are considerably smaller than the output step.
+    struct Sample { size_t segment; double t; double s; };
+    vector<Sample> samples;
+    double s = 0;
+    for(size_t i = 0; i < n; i++)
+    {
+        size_t next = (i + 1) % n;
+        int sub_num = max(4, (int)ceil(h[i] / step * 4));
+        double prev_x = 0, prev_y = 0;
+        for(int k = 0; k <= sub_num; k++)
+        {
+            double t = h[i] * k / sub_num;
+            double px, py, d1, d2;
+            SplineEval(x[i], x[next], mx[i], mx[next], h[i], t, px, d1, d2);
+            SplineEval(y[i], y[next], my[i], my[next], h[i], t, py, d1, d2);
+            if(k > 0)
+            {
+                s += sqrt(pow(px - prev_x, 2) + pow(py - prev_y, 2));
+            }
+            if(k < sub_num || i == n - 1)
+            {
+                samples.push_back({i, t, s});
+            }
+            prev_x = px;
+            prev_y = py;
+        }
+    }
+
+    // 3. Resample with a constant arc length step.
+    // Step is adjusted a bit so the loop consists of an integer number of steps.
+    length = s;
+    size_t points_num = max((size_t)3, (size_t)round(length / step));
+    step = length / points_num;
+
+    points.reserve(points_num);
+    size_t j = 0;
+    for(size_t k = 0; k < points_num; k++)
+    {
+        double target_s = k * step;
+        while(j + 2 < samples.size() && samples[j + 1].s < target_s)
+        {
+            j++;
+        }
+
+        // interpolate spline parameter between two dense samples
+        const Sample &s0 = samples[j];
+        const Sample &s1 = samples[j + 1];
+        double ratio = s1.s > s0.s ? (target_s - s0.s) / (s1.s - s0.s) : 0;
+        size_t i = s0.segment;
+        double t = s1.segment == s0.segment ? s0.t + (s1.t - s0.t) * ratio : s0.t + (h[i] - s0.t) * ratio;
+        size_t next = (i + 1) % n;
+
+        double px, dx, ddx, py, dy, ddy;
+        SplineEval(x[i], x[next], mx[i], mx[next], h[i], t, px, dx, ddx);
+        SplineEval(y[i], y[next], my[i], my[next], h[i], t, py, dy, ddy);
+
+        TrackPoint point;
+        point.s = target_s;
+        point.x = px;
+        point.y = py;
+        point.heading = atan2(dy, dx);
+        point.curvature = (dx * ddy - dy * ddx) / pow(dx * dx + dy * dy, 1.5);
+        points.push_back(point);
+    }
+
+    return true;
+}
+
+bool TrackMap::Build(const vector<double> &x, const vector<double> &y, double step, double cell_size)
+{
+    points.clear();
+    if(cell_size <= 0 || !ResampleLoop(x, y, step, points, length))
+    {
+        points.clear();
+        return false;
+    }
+
+    this->step = length / points.size();
+    this->cell_size = cell_size;
+    BuildGrid();
+
+    return true;
+}
+
+double TrackMap::SegmentDistance2(size_t i, double x, double y, double &t) const
+{
+    const TrackPoint &p0 = points[i];
+    const TrackPoint &p1 = points[(i + 1) % points.size()];
+    double sx = p1.x - p0.x;
+    double sy = p1.y - p0.y;
+    double len2 = sx * sx + sy * sy;
+    t = len2 > 0 ? ((x - p0.x) * sx + (y - p0.y) * sy) / len2 : 0;
+    t = max(0., min(1., t));
+    double dx = p0.x + sx * t - x;
+    double dy = p0.y + sy * t - y;
+    return dx * dx + dy * dy;
+}
+
+void TrackMap::BuildGrid()
+{
+    double max_x = -numeric_limits<double>::max();
+    double max_y = -numeric_limits<double>::max();
+    min_x = numeric_limits<double>::max();
+    min_y = numeric_limits<double>::max();
+    for(const TrackPoint &p : points)
+    {
+        min_x = min(min_x, p.x);
+        min_y = min(min_y, p.y);
+        max_x = max(max_x, p.x);
+        max_y = max(max_y, p.y);
+    }
+
+    // the car can be off the track, so leave a margin around it
+    min_x -= cell_size;
+    min_y -= cell_size;
+    cols = (int)ceil((max_x + cell_size - min_x) / cell_size);
+    rows = (int)ceil((max_y + cell_size - min_y) / cell_size);
+
+    // For every cell keep only segments which can be the closest ones to any point in the cell:
+    // if d is the distance from the cell center to the closest segment, then the closest segment
+    // to any point of the cell is not further than d + 2 * half_diagonal from the center.
+    double half_diagonal = cell_size * sqrt(2.) / 2;
+    cell_start.assign(1, 0);
+    cell_segments.clear();
+    vector<double> distances(points.size());
+    for(int row = 0; row < rows; row++)
+    {
+        for(int col = 0; col < cols; col++)
+        {
+            double cx = min_x + (col + 0.5) * cell_size;
+            double cy = min_y + (row + 0.5) * cell_size;
+
+            double min_d = numeric_limits<double>::max();
+            for(size_t i = 0; i < points.size(); i++)
+            {
+                double t;
+                distances[i] = sqrt(SegmentDistance2(i, cx, cy, t));
+                min_d = min(min_d, distances[i]);
+            }
+
+            for(size_t i = 0; i < points.size(); i++)
+            {
+                if(distances[i] <= min_d + 2 * half_diagonal)
+                {
+                    cell_segments.push_back((int)i);
+                }
+            }
+            cell_start.push_back((int)cell_segments.size());
+        }
+    }
+}
+
+double TrackMap::FindNearest(double x, double y)
+{
+    int col = (int)floor((x - min_x) / cell_size);
+    int row = (int)floor((y - min_y) / cell_size);
+
+    size_t best = 0;
+    double best_t = 0;
+    double best_d = numeric_limits<double>::max();
+    auto check = [&](size_t i)
+    {
+        double t;
+        double d = SegmentDistance2(i, x, y, t);
+        if(d < best_d)
+        {
+            best_d = d;
+            best = i;
+            best_t = t;
+        }
+    };
+
+    if(col >= 0 && col < cols && row >= 0 && row < rows)
+    {
+        int cell = row * cols + col;
+        for(int k = cell_start[cell]; k < cell_start[cell + 1]; k++)
+        {
+            check(cell_segments[k]);
+        }
+    }
+    else
+    {
+        // the car is far away from the track, there is no need to be fast here
+        for(size_t i = 0; i < points.size(); i++)
+        {
+            check(i);
+        }
+    }
+
+    return WrapS(points[best].s + best_t * step);
+}
+
+double TrackMap::WrapS(double s) const
+{
+    s = fmod(s, length);
+    return s < 0 ? s + length : s;
+}
+
+TrackPoint TrackMap::GetPoint(double s) const
+{
+    s = WrapS(s);
+    size_t i = min((size_t)(s / step), points.size() - 1);
+    const TrackPoint &p0 = points[i];
+    const TrackPoint &p1 = points[(i + 1) % points.size()];
+    double ratio = (s - p0.s) / step;
+    return InterpolateTrackPoints(p0, p1, ratio, s);
+}
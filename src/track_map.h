@@ -0,0 +1,74 @@
+#ifndef MPC_TRACK_MAP_H
+#define MPC_TRACK_MAP_H
+
+#include <string>
+#include <vector>
+
+#include "track.h"
+
+using namespace std;
+
+// Reads waypoints from csv file with "x,y" header (e.g. lake_track_waypoints.csv)
+bool ReadWaypointsCsv(const string &path, vector<double> &x, vector<double> &y);
+
+// Interpolates the loop of waypoints by a closed cubic spline and resamples it with a constant arc length step.
+// The last waypoint is connected to the first one. Step is adjusted a bit so the loop consists
+// of an integer number of steps. Returns false if there are too few waypoints.
+bool ResampleLoop(const vector<double> &x, const vector<double> &y, double step,
+                  vector<TrackPoint> &points, double &length);
+
+// Represents the whole track loaded once at startup.
+// Waypoints are interpolated by a closed cubic spline which is resampled by arc length,
+// so any part of the track can be queried without fitting anything per frame.
+// Spatial grid is used to find the closest track segment to the car in O(1).
+class TrackMap : public Track
+{
+    public:
+        // Loads waypoints from csv file with "x,y" header (e.g. lake_track_waypoints.csv)
+        // and builds the map. Returns false if the file can't be read or has too few points.
+        bool LoadCsv(const string &path, double step = 0.5, double cell_size = 10);
+
+        // Builds the map from the loop of waypoints. The last waypoint is connected to the first one.
+        bool Build(const vector<double> &x, const vector<double> &y, double step = 0.5, double cell_size = 10);
+
+        bool IsLoaded() const override { return !points.empty(); }
+
+        double Length() const override { return length; }
+
+        // Distance between sequential points of the table
+        double Step() const { return step; }
+
+        const vector<TrackPoint> &Points() const { return points; }
+
+        double FindNearest(double x, double y) override;
+
+        // Returns linearly interpolated track point at arc length s, s is wrapped around the loop
+        TrackPoint GetPoint(double s) const override;
+
+        // Wraps arc length into [0; length)
+        double WrapS(double s) const;
+
+    private:
+        // Track points sampled with constant arc length step
+        vector<TrackPoint> points;
+
+        double length = 0;
+        double step = 0;
+
+        // Spatial grid. Every cell contains indices of segments [i, i+1] that might be
+        // the closest ones for any point inside the cell.
+        double cell_size = 0;
+        double min_x = 0;
+        double min_y = 0;
+        int cols = 0;
+        int rows = 0;
+        vector<int> cell_start;
+        vector<int> cell_segments;
+
+        void BuildGrid();
+
+        // Squared distance from (x, y) to segment [i, i+1], t is set to the position on the segment in [0, 1]
+        double SegmentDistance2(size_t i, double x, double y, double &t) const;
+};
+
+#endif //MPC_TRACK_MAP_H
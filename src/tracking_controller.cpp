@@ -0,0 +1,56 @@
+#include <algorithm>
+#include <cmath>
+
+#include "tracking_controller.h"
+#include "config.h"
+#include "utils.h"
+
+// Pure pursuit is not used for target points closer than this along the car's heading, meters
+const double K_MIN_TARGET_DISTANCE = 1;
+
+bool TrackingController::Control(const PlanBuffer &plan_buffer, double time, double px, double py, double psi,
+                                 double v, MPCSolution &solution)
+{
+    if(!plan_buffer.Sample(time, solution))
+    {
+        return false;
+    }
+
+    Config config = Config::GetConfig();
+    double ref_x, ref_y, ref_psi, ref_v;
+    if(!plan_buffer.Reference(time, ref_x, ref_y, ref_psi, ref_v))
+    {
+        return true;
+    }
+
+    // the target point beyond the end of the plan leaves the steering to the feedforward
+    double target_x, target_y, target_psi, target_v;
+    double car_delta, ref_delta;
+    if(plan_buffer.Reference(time + config.tracking_lookahead_time, target_x, target_y, target_psi, target_v)
+       && Pursuit(px, py, psi, target_x, target_y, car_delta)
+       && Pursuit(ref_x, ref_y, ref_psi, target_x, target_y, ref_delta))
+    {
+        solution.delta = max(-K_MAX_DELTA, min(K_MAX_DELTA, solution.delta + car_delta - ref_delta));
+    }
+
+    double a = solution.acceleration + config.tracking_velocity_gain * (ref_v - v);
+    solution.acceleration = max(-K_MAX_ACCELERATION, min(K_MAX_ACCELERATION, a));
+    return true;
+}
+
+bool TrackingController::Pursuit(double px, double py, double psi, double target_x, double target_y, double &delta)
+{
+    // target in the coordinates of the pose
+    double dx = target_x - px;
+    double dy = target_y - py;
+    double x = dx * cos(psi) + dy * sin(psi);
+    double y = -dx * sin(psi) + dy * cos(psi);
+    if(x < K_MIN_TARGET_DISTANCE)
+    {
+        return false;
+    }
+
+    // circle going through the pose and the target has curvature 2 * y / l**2, in the model it is delta / Lf
+    delta = 2 * y / (x * x + y * y) * Lf;
+    return true;
+}
@@ -0,0 +1,26 @@
+#ifndef MPC_TRACKING_CONTROLLER_H
+#define MPC_TRACKING_CONTROLLER_H
+
+#include "MPC.h"
+#include "plan_buffer.h"
+
+// Fast tracking law which follows the last plan between the optimizer solves (see Config::tracking_law).
+// The planned actuations at the time are the feedforward. Steering is corrected by pure pursuit of the planned position
+// tracking_lookahead_time seconds ahead: the steering from the car's pose minus the one from the planned pose,
+// so the correction is zero while the car is on the plan. Acceleration is corrected by the planned velocity error.
+class TrackingController
+{
+    public:
+        // Fills actuations for the car's pose (global coordinates) and velocity at the given time.
+        // Returns false if there is no plan for this time. If the plan has no trajectory to follow,
+        // its actuations are used as they are.
+        bool Control(const PlanBuffer &plan_buffer, double time, double px, double py, double psi, double v,
+                     MPCSolution &solution);
+
+    private:
+        // Pure pursuit steering angle from the pose to the target point,
+        // returns false if the point is too close or behind
+        static bool Pursuit(double px, double py, double psi, double target_x, double target_y, double &delta);
+};
+
+#endif //MPC_TRACKING_CONTROLLER_H
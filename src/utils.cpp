@@ -29,6 +29,11 @@ double rad2deg(double x)
     return x * 180 / pi();
 }
 
+double normalize_angle(double x)
+{
+    return atan2(sin(x), cos(x));
+}
+
 // Evaluate a polynomial.
 double polyeval(Eigen::VectorXd coeffs, double x)
 {
@@ -34,6 +34,9 @@ double deg2rad(double x);
 
 double rad2deg(double x);
 
+// Normalizes angle to [-pi, pi]
+double normalize_angle(double x);
+
 // Evaluate a polynomial.
 double polyeval(Eigen::VectorXd coeffs, double x);
 